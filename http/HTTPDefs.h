@@ -3,6 +3,7 @@
 #include <boost/unordered/unordered_map.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/asio/buffer.hpp>
+#include <boost/function.hpp>
 #include <string>
 #include <map>
 #include <bmu/tydefs.h>
@@ -24,12 +25,19 @@ enum response_code_e {
 	HTTP_FAIL_CONSTRAINTS = 409, /// <Conflict
 	HTTP_FAIL_IF_PERFORM = 412,///< Precondition Failed
 	HTTP_FAIL_MIME = 415,///< Unsupported Media Type
-	HTTP_ERROR_INTERNAL = 500 ///< Internal Server Error
+	HTTP_ERROR_INTERNAL = 500, ///< Internal Server Error
+	HTTP_ERROR_UNAVAILABLE = 503 ///< Service Unavailable
 };
 
+/// receives consecutive parts of response body
+typedef boost::function<void (u8unit_t const*, size_t)> BodySinkFn;
+/// writes the whole response body to the sink, returns false if it failed
+typedef boost::function<bool (BodySinkFn const&)> BodyWriterFn;
+
 struct httpresponse_t {
 	response_code_e code;
 	u8vector_t      body;//trazeni dokument/fragment ili sadrzaj za 409 odziv
+	BodyWriterFn    body_writer;//ako je postavljen, body 200 odziva se formira tek pri slanju
 	std::string     etag;//etag za body
 	std::string     mime;//samo za GET je bitno
 	std::map<std::string, std::string> extra_hdrs;
@@ -56,11 +64,13 @@ class MsgParser;
 class MsgSerializer;
 class MsgReader;
 class MsgWriter;
+class Pipeline;
 
 typedef boost::shared_ptr<MsgParser>        MsgParserPtr;
 typedef boost::shared_ptr<MsgSerializer>    MsgSerializerPtr;
 typedef boost::shared_ptr<MsgReader>        MsgReaderPtr;
 typedef boost::shared_ptr<MsgWriter>        MsgWriterPtr;
+typedef boost::shared_ptr<Pipeline>         PipelinePtr;
 
 /// HTTPDefs: common data types used by HTTP
 struct HTTPDefs {
@@ -84,6 +94,7 @@ struct HTTPDefs {
 	static std::string const HEADER_ETAG;
 	static std::string const HEADER_IF_MATCH;
 	static std::string const HEADER_IF_NONE_MATCH;
+	static std::string const HEADER_RETRY_AFTER;
 
 	// common HTTP request methods
 	static std::string const REQUEST_METHOD_HEAD;
@@ -105,6 +116,7 @@ struct HTTPDefs {
 	static std::string const RESPONSE_MESSAGE_BAD_REQUEST;
 	static std::string const RESPONSE_MESSAGE_SERVER_ERROR;
 	static std::string const RESPONSE_MESSAGE_NOT_IMPLEMENTED;
+	static std::string const RESPONSE_MESSAGE_SERVICE_UNAVAILABLE;
 	static std::string const RESPONSE_MESSAGE_CONTINUE;
 
 	// common HTTP response codes
@@ -120,6 +132,7 @@ struct HTTPDefs {
 	static unsigned int const RESPONSE_CODE_BAD_REQUEST;
 	static unsigned int const RESPONSE_CODE_SERVER_ERROR;
 	static unsigned int const RESPONSE_CODE_NOT_IMPLEMENTED;
+	static unsigned int const RESPONSE_CODE_SERVICE_UNAVAILABLE;
 	static unsigned int const RESPONSE_CODE_CONTINUE;
 
 	/** base64 decoding , used internally by ResourceAuth
@@ -186,7 +199,17 @@ public:
 	void clear(void) { m_map.clear(); }
 	bool empty(void) const { return m_map.empty(); }
 
-    void serialize(std::vector<boost::asio::const_buffer>& buffer) const;
+    /// appends "name: value" CRLF lines of all headers to out
+    template<class String>
+    void serialize(String& out) const
+    {
+        for (nocasemap_t::const_iterator i(m_map.begin()); i != m_map.end(); ++i) {
+            out.append(i->first.data(), i->first.size());
+            out.append(": ", 2);
+            out.append(i->second.data(), i->second.size());
+            out.append("\r\n", 2);
+        }
+    }
 
     void dump(void) const;
 };
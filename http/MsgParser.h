@@ -1,29 +1,51 @@
 #ifndef MSG_PARSER_H
 #define MSG_PARSER_H
 #include "scarlet/http/HTTPDefs.h"
+#include "scarlet/net/Arena.h"
+#include <boost/utility/string_ref.hpp>
+#include <algorithm>
 
 namespace scarlet {
 namespace http {
 
+/** Header block is copied from read buffer(s) once into m_raw and searched for CRLF with
+  find_char (SSE2 where available). Fields are kept as views into m_raw, HeadersMultimap
+  is built only if someone asks for it.
+ */
 class MsgHeadersParser {
-    enum state_e {
-        WANTED_START,
-        WANTED_CR,
-        WANTED_LF,
-        WANTED_NOTHING,
+    MsgHeadersParser(MsgHeadersParser const&) = delete;
+    void operator=(MsgHeadersParser const&) = delete;
+    struct field_t {
+        boost::string_ref name;
+        boost::string_ref value;//trimmed, folded lines stay inside
     };
-    state_e                         m_state;
-    std::vector<std::string>        m_headers;
-	HeadersMultimap                 m_headers_map;
+    typedef std::basic_string<char, std::char_traits<char>, net::ArenaAllocator<char> > raw_t;
+    bool                            m_finished;
+    raw_t                           m_raw;//header block without terminating empty line
+    boost::string_ref               m_start_line;
+    std::vector<field_t, net::ArenaAllocator<field_t> > m_fields;
+    mutable bool                    m_map_built;
+	mutable HeadersMultimap         m_headers_map;
     mutable boost::shared_ptr<RequestLine>  m_rqline;//for request
     mutable boost::shared_ptr<StatusLine>   m_stline;//for response
     static inline bool is_white(int c) { return(c == ' ' || c == '\t'); }
     static inline bool is_white_or_crlf(int c) { return(c == ' ' || c == '\t' || c == 0x0d || c == 0x0a); }
+    /// splits m_raw to start line and fields
+    void split_lines(void);
 public:
+    explicit MsgHeadersParser(net::ArenaPtr const& arena = net::ArenaPtr())
+    : m_finished(false)
+    , m_raw(net::ArenaAllocator<char>(arena))
+    , m_fields(net::ArenaAllocator<field_t>(arena))
+    , m_map_built(false)
+    { }
     void reset(void)
     {
-        m_state = WANTED_START;
-        m_headers.clear();
+        m_finished = false;
+        m_raw.clear();
+        m_start_line.clear();
+        m_fields.clear();
+        m_map_built = false;
         m_headers_map.clear();
         m_rqline.reset();
         m_stline.reset();
@@ -31,14 +53,15 @@ public:
     RequestLine const* get_request_line(void) const;
     StatusLine const* get_status_line(void) const;
 	size_t parse(char const* data, size_t length);
-    //std::string const& get_line(std::string const& field) const;
-    std::string const& get_field(std::string const& name) const { return m_headers_map.get(name); }
+    ///@return values of all fields with name joined with ',', empty if there is no such field
+    std::string get_field(boost::string_ref name) const;
     bool checkKeepAlive(bool is_request) const;
     bool is_chunked(void) const;
     int get_content_length(void) const;
-	//HeadersMultimap const& get_headers(void) const { return m_headers; }
-    bool is_finished(void) const { return m_state == WANTED_NOTHING; }
-    void dump(void) const { m_headers_map.dump(); }
+    /// builds headers map on first call
+	HeadersMultimap const& get_headers(void) const;
+    bool is_finished(void) const { return m_finished; }
+    void dump(void) const { get_headers().dump(); }
 };
 
 
@@ -56,7 +79,7 @@ class MsgChunksParser {
     state_e                  m_state;
     size_t                   m_remaining;
     std::string              m_tmp;
-	std::vector<char>        m_body;
+    std::vector<char>&       m_body;//owned by MsgParser, filled in place
     //static inline bool is_white(char c) { return(c == ' ' || c == '\t'); }
     static inline bool is_hex(char c)
     {
@@ -65,8 +88,9 @@ class MsgChunksParser {
     }
     static inline bool is_hex_no_zero(char c) { return (c != '0' && is_hex(c)); }
 public:
-    MsgChunksParser(size_t max_body_size = HTTPDefs::DEFAULT_MAX_BODY_SIZE)
+    MsgChunksParser(std::vector<char>& body, size_t max_body_size = HTTPDefs::DEFAULT_MAX_BODY_SIZE)
     : m_max_body_size(max_body_size)
+    , m_body(body)
     { }
     void reset(void)
     {
@@ -76,8 +100,6 @@ public:
         m_body.clear();
     }
 	size_t parse(char const* data, size_t const length);
-	std::vector<char> const get_body(void) const { return m_body; }
-    void swap_body(std::vector<char>& body2) { m_body.swap(body2); }
     ///relevantno samo ako se ne cita skroz do zatvaranja konekcije
     bool is_finished(void) const { return /*!m_remaining && */m_state == CHUNK_FINISHED; }
 };
@@ -86,19 +108,21 @@ public:
 class MsgBodyParser {
     size_t const             m_max_body_size;
     int                      m_remaining;
-	std::vector<char>        m_body;
+    std::vector<char>&       m_body;//owned by MsgParser, filled in place
 public:
-    MsgBodyParser(size_t max_body_size = HTTPDefs::DEFAULT_MAX_BODY_SIZE)
+    MsgBodyParser(std::vector<char>& body, size_t max_body_size = HTTPDefs::DEFAULT_MAX_BODY_SIZE)
     : m_max_body_size(max_body_size)
+    , m_body(body)
     { }
+    ///@param remaining Content-Length if known (body is allocated once), -1 reads until connection is closed
     void reset(int remaining)
     {
         m_remaining = remaining;
         m_body.clear();
+        if(m_remaining > 0)
+            m_body.reserve(std::min(size_t(m_remaining), m_max_body_size));
     }
 	size_t parse(char const* data, size_t const length);
-	std::vector<char> const get_body(void) const { return m_body; }
-    void swap_body(std::vector<char>& body2) { m_body.swap(body2); }
     void set_finished(void);
     ///relevantno samo ako se ne cita skroz do zatvaranja konekcije
     bool is_finished(void) const { return !m_remaining; }
@@ -106,8 +130,11 @@ public:
 };
 
 class MsgParser {
+    MsgParser(MsgParser const&) = delete;
+    void operator=(MsgParser const&) = delete;
+    std::vector<char>    m_body;//body parsers write directly here
     MsgHeadersParser     m_head_parser;
-    MsgChunksParser m_chunked_parser;
+    MsgChunksParser      m_chunked_parser;
     MsgBodyParser        m_body_parser;
     enum state_e {
         WANTED_HEADERS,
@@ -117,16 +144,17 @@ class MsgParser {
         FINISHED,
     };
     state_e              m_state;
-    std::vector<char>    m_body;
     bool                 m_is_request;
     std::string          m_response_for_requested_method;
     std::string          m_authenticated_user;//username
     bool is_header_only(void) const;
 public:
-    MsgParser(size_t max_body_size = HTTPDefs::DEFAULT_MAX_BODY_SIZE)
-    : m_head_parser()
-    , m_chunked_parser(max_body_size)
-    , m_body_parser(max_body_size)
+    ///@param arena memory for header buffers, heap if null
+    MsgParser(size_t max_body_size = HTTPDefs::DEFAULT_MAX_BODY_SIZE, net::ArenaPtr const& arena = net::ArenaPtr())
+    : m_body()
+    , m_head_parser(arena)
+    , m_chunked_parser(m_body, max_body_size)
+    , m_body_parser(m_body, max_body_size)
     { }
     void reset(bool is_request, std::string const& response_for_requested_method = std::string())
     {
@@ -140,6 +168,7 @@ public:
     }
 	size_t parse(char const* data, size_t const length);
     std::string get_header(std::string const& field) const { return m_head_parser.get_field(field); }
+    HeadersMultimap const& get_headers(void) const { return m_head_parser.get_headers(); }
     bool checkKeepAlive(void) const { return m_head_parser.checkKeepAlive(m_is_request); }
 	std::vector<char> const& get_body(void) const { return m_body; }
     std::string get_requested_method(void) const;
@@ -159,6 +188,8 @@ public:
     ///relevantno samo ako se ne cita skroz do zatvaranja konekcije
     bool is_finished(void) const { return m_state == FINISHED; }
     bool is_failed(void) const { return m_state == FAILED; }
+    /// headers are parsed and body is not yet complete
+    bool is_reading_body(void) const { return m_state == WANTED_CHUNKS || m_state == WANTED_BODY; }
     void dump_header(void) const { m_head_parser.dump(); }
 };
 
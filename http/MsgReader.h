@@ -2,8 +2,8 @@
 #define MSG_READER_H
 #include <scarlet/http/MsgParser.h>
 #include <scarlet/net/TCPConnection.h>
-#include <boost/asio/deadline_timer.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
 
@@ -18,8 +18,21 @@ public:
 	virtual ~MsgReader();
 	/// Incrementally reads & parses the HTTP message
 	void receive(void);
-	/// sets the maximum number of seconds for read operations
-	inline void setTimeout(boost::uint32_t seconds) { m_read_timeout = seconds; }
+	/** sets the maximum number of seconds between reads, 0 disables the timeout
+	 * @param header while reading the request line and headers
+	 * @param body while reading the body
+	 * @param idle keep-alive connection waiting for the first byte of its next request
+	 */
+	inline void setTimeouts(boost::uint32_t header, boost::uint32_t body, boost::uint32_t idle)
+	{
+		m_header_timeout = header;
+		m_body_timeout = body;
+		m_idle_timeout = idle;
+	}
+	/** parses only bytes pipelined in the read buffer, if they don't hold the whole message the
+	 * connection handler is called with them left in the buffer instead of reading the socket
+	 */
+	inline void setBufferedOnly(bool buffered_only) { m_buffered_only = buffered_only; }
     enum msg_type_e {
         READ_AS_REQUEST,
         READ_AS_RESPONSE,
@@ -33,7 +46,7 @@ public:
         , std::string const& response_for_requested_method = std::string()
     )
     {
-        return MsgReaderPtr(new MsgReader(
+        return net::arena_shared(tcp_conn->getArena(), new(*tcp_conn->getArena()) MsgReader(
             tcp_conn, msg_handler, conn_handler, type, max_body_size, response_for_requested_method
         ));
     }
@@ -52,10 +65,14 @@ private:
         , std::string const& response_for_requested_method = std::string()
     )
     : m_tcp_conn(tcp_conn)
-    , m_read_timeout(DEFAULT_READ_TIMEOUT)
+    , m_header_timeout(DEFAULT_HEADER_TIMEOUT)
+    , m_body_timeout(DEFAULT_BODY_TIMEOUT)
+    , m_idle_timeout(DEFAULT_IDLE_TIMEOUT)
+    , m_idle(false)
+    , m_buffered_only(false)
     , m_msg_type(type)
-    , m_http_msg(new MsgParser(max_body_size))
-    , m_timer(tcp_conn->getIOService())
+    , m_http_msg(boost::allocate_shared<MsgParser>(
+        net::ArenaAllocator<MsgParser>(tcp_conn->getArena()), max_body_size, tcp_conn->getArena()))
     , m_finished(msg_handler)
     , m_finished_conn(conn_handler)
     {
@@ -75,22 +92,24 @@ private:
     void finishedReading(void) { m_finished(m_http_msg, m_tcp_conn); }
 	/// reads more bytes for parsing, with timeout support
 	void readBytesWithTimeout(void);
-	/** Callback handler for the deadline timer
-	 * @param ec deadline timer error status code
-	 */
-	void timerCallback(const boost::system::error_code& ec);
     static const std::size_t                DEFAULT_MAX_TRANSFER_SIZE = 65536;
 	/// default maximum number of seconds for read operations
-	static const boost::uint32_t			DEFAULT_READ_TIMEOUT = 3;// 10;
+	static const boost::uint32_t			DEFAULT_HEADER_TIMEOUT = 3;// 10;
+	static const boost::uint32_t			DEFAULT_BODY_TIMEOUT = 10;
+	static const boost::uint32_t			DEFAULT_IDLE_TIMEOUT = 15;
 	/// The HTTP connection that has a new HTTP message to parse
 	net::TCPConnectionPtr					m_tcp_conn;
 	/// maximum number of seconds for read operations
-	boost::uint32_t							m_read_timeout;
+	boost::uint32_t							m_header_timeout;
+	boost::uint32_t							m_body_timeout;
+	boost::uint32_t							m_idle_timeout;
+	/// kept alive connection, nothing of the next request has been read yet
+	bool									m_idle;
+	/// never reads the socket, see setBufferedOnly
+	bool									m_buffered_only;
     msg_type_e                              m_msg_type;
 	/// The new HTTP message container being created
 	MsgParserPtr            m_http_msg;
-	/// deadline timer used to timeout TCP operations
-	boost::asio::deadline_timer				m_timer;
     /// function called after the HTTP message has been parsed
 	FinishedMsgHandler m_finished;
 	FinishedConnHandler m_finished_conn;
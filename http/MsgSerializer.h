@@ -1,46 +1,65 @@
 #ifndef MSG_SERIALIZER_H
 #define MSG_SERIALIZER_H
 #include "scarlet/http/HTTPDefs.h"
-#include <list>
+#include "scarlet/net/Arena.h"
 
 
 namespace scarlet {
 namespace http {
 
 
+/** Status line, headers, chunk framing and body up to INLINE_BODY_SIZE bytes are formatted into
+  one contiguous output buffer, so a typical response is one buffer for async_write and over
+  SSL one TLS record. Larger body is referenced, not copied.
+ */
 class MsgSerializer {
+    typedef std::basic_string<char, std::char_traits<char>, net::ArenaAllocator<char> > outbuf_t;
     boost::shared_ptr<RequestLine>          m_rqline;
     boost::shared_ptr<StatusLine>           m_stline;
+    std::string const*                      m_first_line_text;//precomputed, with CRLF
     HeadersMultimap                         m_headers;
     std::vector<boost::asio::const_buffer>  m_content_buffers;
     size_t									m_content_length;
-	mutable std::list<std::string>			m_text_cache;
+	mutable outbuf_t                        m_out;//referenced by buffers until sent
 
 public:
-    MsgSerializer(void) : m_content_length(0) { }
+    /// body up to this size is copied after headers or chunk size into the output buffer
+    enum { INLINE_BODY_SIZE = 16384 };
+    ///@param arena memory for the output buffer, heap if null
+    explicit MsgSerializer(net::ArenaPtr const& arena = net::ArenaPtr())
+    : m_first_line_text(0)
+    , m_content_length(0)
+    , m_out(net::ArenaAllocator<char>(arena))
+    { }
 
     void reset(bool reset_all = false)
     {
         if(reset_all) {
             m_rqline.reset();
             m_stline.reset();
+            m_first_line_text = 0;
             m_headers.clear();
-            m_text_cache.clear();
         }
+        m_out.clear(); // referenced only by buffers already sent
 		m_content_buffers.clear();
 		m_content_length = 0;
 	}
 
-    void set_first_line(StatusLine const& first_line)
+    /** @param text precomputed first_line with CRLF, must persist until the message is sent,
+     * first_line is formatted if null
+     */
+    void set_first_line(StatusLine const& first_line, std::string const* text = 0)
     {
         m_rqline.reset();
         m_stline = boost::shared_ptr<StatusLine>(new StatusLine(first_line));
+        m_first_line_text = text;
     }
 
     void set_first_line(RequestLine const& first_line)
     {
         m_rqline = boost::shared_ptr<RequestLine>(new RequestLine(first_line));
         m_stline.reset();
+        m_first_line_text = 0;
     }
 
     void set_header(std::string const& name, std::string const& value)
@@ -65,11 +84,13 @@ public:
 
     bool does_support_chunks(void) const;
 
-    void header(std::vector<boost::asio::const_buffer>& buffer) const;
     size_t length(void) const { return m_content_length; }
-    void body(std::vector<boost::asio::const_buffer>& buffer) const;
-    void chunk(std::vector<boost::asio::const_buffer>& buffer) const;
-    void final_chunk(std::vector<boost::asio::const_buffer>& buffer) const;
+    /** fills buffer with the message or with its next chunk, buffers are valid until reset()
+     * @param with_header first line and headers are sent before the body
+     * @param as_chunk appended content is sent as one chunk
+     * @param final_chunk zero-length chunk is sent after the content, only with as_chunk
+     */
+    void serialize(std::vector<boost::asio::const_buffer>& buffer, bool with_header, bool as_chunk, bool final_chunk) const;
 };
 
 
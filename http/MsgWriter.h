@@ -12,6 +12,10 @@ namespace http {
 class MsgWriter : private boost::noncopyable, public boost::enable_shared_from_this<MsgWriter> {
 	/// function called after the HTTP message has been sent
 	typedef boost::function<void (net::TCPConnectionPtr)> FinishedConnHandler;
+	/** function called after each chunk which is not the final one, argument is false if sending
+	 * failed. Returns true if more chunks will follow, false to finish the connection.
+	 */
+	typedef boost::function<bool (bool)> ChunkSentHandler;
 	/** protected constructor: only derived classes may create objects
 	 * @param tcp_conn TCP connection used to send the message
 	 * @param handler function called after the request has been sent
@@ -21,7 +25,9 @@ class MsgWriter : private boost::noncopyable, public boost::enable_shared_from_t
     , m_msg(msg)
     , m_sending_chunks(false)
     , m_sent_headers(false)
+    , m_sent_final(false)
     , m_finished(handler)
+    , m_chunk_sent()
 	{ }
 public:
 	/** creates new MsgWriter objects
@@ -31,7 +37,7 @@ public:
 	 */
 	static inline MsgWriterPtr create(net::TCPConnectionPtr tcp_conn, MsgSerializerPtr msg, FinishedConnHandler handler)
 	{
-		return MsgWriterPtr(new MsgWriter(tcp_conn, msg, handler));
+		return net::arena_shared(tcp_conn->getArena(), new(*tcp_conn->getArena()) MsgWriter(tcp_conn, msg, handler));
 	}
 	/// default destructor
 	virtual ~MsgWriter();
@@ -44,6 +50,10 @@ public:
 	 * to the MsgWriter object until the handleWrite has been called.
 	 */
 	bool send_async_chunk(bool is_final = false) { return send_async_more(true, is_final); }
+	/** sets function called when non-final chunk is sent, without it the connection is finished
+	 * only after the final chunk. Must be set before the first chunk is sent.
+	 */
+	void set_chunk_handler(ChunkSentHandler const& handler) { m_chunk_sent = handler; }
 private:
 	/** called after the message is sent
 	 * @param write_error error status from the last write operation
@@ -63,8 +73,12 @@ private:
 	bool									m_sending_chunks;
 	/// true if the HTTP message headers have already been sent
 	bool									m_sent_headers;
+	/// true if the last write contains the whole message or its final chunk
+	bool									m_sent_final;
 	/// function called after the HTTP message has been sent
 	FinishedConnHandler						m_finished;
+	/// function called after each non-final chunk has been sent
+	ChunkSentHandler						m_chunk_sent;
 };
 
 }
@@ -0,0 +1,70 @@
+#ifndef HTTP_PIPELINE_H
+#define HTTP_PIPELINE_H
+#include <scarlet/http/HTTPDefs.h>
+#include <scarlet/net/TCPConnection.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+#include <vector>
+
+namespace scarlet {
+namespace http {
+
+/** Pipeline: requests pipelined on one connection which were already in its read buffer. They
+ * are all parsed before any of them is handled, then handled concurrently, while responses are
+ * sent strictly in request order: each response waits for its turn until all previous ones have
+ * been sent. Connection is finished as after a single request only when the last response has
+ * been sent, no more is read from the socket until then.
+ * Once a response fails, is abandoned before its turn or closes the connection, no later
+ * response is sent, the client would pair it with the wrong request: their send functions are
+ * dropped and the connection is closed as soon as no response is being sent.
+ */
+class Pipeline {
+	Pipeline(Pipeline const&) = delete;
+	void operator=(Pipeline const&) = delete;
+	typedef boost::function<void (net::TCPConnectionPtr)> FinishedConnHandler;
+	Pipeline(net::TCPConnectionPtr tcp_conn, FinishedConnHandler handler);
+public:
+	/// at most that many requests are parsed ahead, the rest waits in the read buffer
+	enum { MAX_REQUESTS = 32 };
+	typedef boost::function<void (void)> SendFn;
+	/// @param handler function called after the response to the last request has been sent
+	static PipelinePtr create(net::TCPConnectionPtr tcp_conn, FinishedConnHandler handler);
+	/// appends the next parsed request, responses are numbered by the order of add()
+	void add(MsgParserPtr http_request, bool keep_alive);
+	size_t size(void) const { return m_slots.size(); }
+	bool full(void) const { return m_slots.size() >= MAX_REQUESTS; }
+	MsgParserPtr request(size_t ticket) const { return m_slots[ticket].request; }
+	/** no more requests will be added, must be called before any response is sent
+	 * @param after lifecycle of the connection after the last response, LIFECYCLE_PIPELINED if
+	 *        unparsed bytes are left in the read buffer
+	 */
+	void close(net::TCPConnection::LifecycleType after) { m_after = after; }
+	/// calls send as soon as responses to all previous requests have been sent, never if aborted
+	void whenTurn(size_t ticket, SendFn const& send);
+	/// called when the response to request ticket has been sent or abandoned
+	void finished(size_t ticket, net::TCPConnectionPtr tcp_conn);
+private:
+	struct slot_t {
+		MsgParserPtr request;
+		bool         keep_alive;
+		bool         done;
+		SendFn       send;///< response waiting for its turn
+	};
+	/// gives the turn to the response of m_turn, assumes that the lock has already been acquired
+	SendFn takeTurn(void);
+	/// drops responses not yet sent, assumes that the lock has already been acquired
+	void abort(void);
+	net::TCPConnectionPtr         m_tcp_conn;
+	FinishedConnHandler           m_finished;
+	boost::mutex                  m_mutex;
+	std::vector<slot_t>           m_slots;
+	size_t                        m_turn;///< first request whose response has not been sent
+	bool                          m_sending;///< response of m_turn has been passed to the connection
+	bool                          m_aborted;///< no more responses are sent, connection is closed
+	net::TCPConnection::LifecycleType m_after;
+};
+
+}
+}
+
+#endif // HTTP_PIPELINE_H
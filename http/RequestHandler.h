@@ -1,5 +1,6 @@
 #pragma once
 #include <scarlet/net/TCPConnection.h>
+#include <scarlet/net/WorkerPool.h>
 #include <scarlet/http/HTTPDefs.h>
 #include <scarlet/http/ResourceAuth.h>
 #include <boost/thread/tss.hpp>
@@ -10,6 +11,8 @@ namespace scarlet {
 namespace http {
 
 typedef boost::function<void(net::TCPConnectionPtr)> FinishedConnectionFn;
+/// calls its argument when the response may be sent, keeps pipelined responses in request order
+typedef boost::function<void(boost::function<void()> const&)> SendGateFn;
 typedef boost::function<bool(MsgParserPtr, u8vector_t&)> ResourceLocatorFn;
 
 class SvcHandler;
@@ -22,26 +25,40 @@ class RequestHandler : public boost::enable_shared_from_this<RequestHandler> {
 	explicit RequestHandler(void) = delete;
 	void exceptions_handler(boost::shared_ptr<httpresponse_t> response);
 	bool formatRequest(MsgParserPtr http_request, boost::shared_ptr<httprequest_t> fmt_request, boost::shared_ptr<httpresponse_t> response);
-	void sendResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler
+	/// authenticates and handles the resource, blocking work executed in a worker thread
+	void processRequest(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, SendGateFn gate, MsgParserPtr http_request
+		, boost::shared_ptr<httprequest_t> fmt_request, boost::shared_ptr<httpresponse_t> response);
+	void sendResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, SendGateFn gate
 		, boost::shared_ptr<httpresponse_t> response, std::string const& challenge_domain);
+	/// status line and headers of the response
+	MsgSerializerPtr prepareResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn
+		, boost::shared_ptr<httpresponse_t> response, std::string const& challenge_domain);
+	/// generates body with body_writer in a worker thread and sends it in chunks as it is written
+	void streamResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, SendGateFn gate
+		, boost::shared_ptr<httpresponse_t> response, std::string const& challenge_domain, BodyWriterFn const& body_writer);
 	/** creates a new HTTPServer object
 	* @param scheduler the WorkScheduler that will be used to manage worker threads
 	* @param endpoint TCP endpoint used to listen for new connections (see ASIO docs)
 	*/
-	RequestHandler(SvcHandlerPtr svc_handler);
+	RequestHandler(SvcHandlerPtr svc_handler, net::WorkerPoolPtr workers);
 public:
+	/// seconds clients are asked to wait before retrying a request rejected because of overload
+	enum { RETRY_AFTER = 1 };
 	/// default destructor
 	virtual ~RequestHandler() { }
 	/** creates a new HTTPServer object
 	* @param scheduler the WorkScheduler that will be used to manage worker threads
 	* @param endpoint TCP endpoint used to listen for new connections (see ASIO docs)
 	*/
-	static RequestHandlerPtr create(SvcHandlerPtr svc_handler);
-	/** handles a new HTTP request
+	static RequestHandlerPtr create(SvcHandlerPtr svc_handler, net::WorkerPoolPtr workers = net::WorkerPoolPtr());
+	/** handles a new HTTP request, or rejects it at once if the IO service of the connection has
+	* too many requests in flight
 	* @param http_request the HTTP request to handle
 	* @param tcp_conn TCP connection containing a new request
+	* @param gate if set, the response is passed to the connection only through it
 	*/
-	void handleRequest(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, MsgParserPtr http_request);
+	void handleRequest(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, MsgParserPtr http_request
+		, SendGateFn const& gate = SendGateFn());
 
 	/** handles a new TCP connection
 	* @param tcp_conn the new TCP connection to handle
@@ -49,8 +66,13 @@ public:
 	//void handleConnection(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler);
 	/// sets the maximum length for HTTP request payload content
 	inline void setMaxContentLength(std::size_t n) { m_max_content_length = n; }
+	/// starts periodic expiry of authentication cache on io_service
+	void startMaintenance(boost::asio::io_service& io_service) { auth->startExpiry(io_service); }
+	void stopMaintenance(void) { auth->stopExpiry(); }
 private:
 	SvcHandlerPtr             svc_handler;
+	/// pool executing storage and resource processing, if null it is done in IO thread
+	net::WorkerPoolPtr        workers;
 	ResourceAuthenticationPtr auth;
 	/// maximum length for HTTP request payload content
 	std::size_t               m_max_content_length;
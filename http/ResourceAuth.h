@@ -1,6 +1,12 @@
 #include <scarlet/http/HTTPDefs.h>
+#include <scarlet/http/ShardedCache.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/function.hpp>
 
 namespace scarlet {
@@ -9,7 +15,8 @@ namespace http
 
 typedef boost::function<bool(std::string&, std::string const&)> ResolveUserFn;
 
-class ResourceAuth {
+/// ResourceAuth: caches authenticated users and sent Digest nonces, one instance is shared by all threads
+class ResourceAuth : public boost::enable_shared_from_this<ResourceAuth> {
 public:
     enum auth_status_t {
         AUTH_OK,
@@ -19,14 +26,21 @@ public:
 private:
     enum { CACHE_EXPIRATION = 300 }; // 5 minutes
     enum { NONCE_EXPIRATION = 20 }; // 20 seconds
-    /// time of the last cache clean up
-	boost::posix_time::ptime				m_cache_cleanup_time;
-	typedef std::map<std::string, std::pair<boost::posix_time::ptime, std::string> >  UserCredentialsCache;
-    std::map<std::string, boost::posix_time::ptime> sent_nonce_time;
-	/// cache of users that are currently active
-	UserCredentialsCache				m_user_cache;
-	/// mutex used to protect access to the user cache
-	mutable boost::mutex		m_cache_mutex;
+    enum { CACHE_MAX_USERS = 65536 };
+    enum { CACHE_MAX_NONCES = 65536 };
+    enum { CLEANUP_INTERVAL = 10 }; // seconds
+    /// Basic credentials of users that are currently active, value is username
+	ShardedCache<std::string>           m_user_cache;
+    /// stored passwords of users authenticated with Digest, key is username@domain, never grants access alone
+    ShardedCache<std::string>           m_secret_cache;
+    /// nonces sent in Digest challenges, value is unused
+    ShardedCache<bool>                  m_nonce_cache;
+    /// runs expiry of all caches
+    boost::scoped_ptr<boost::asio::deadline_timer> m_cleanup_timer;
+    /// guards m_cleanup_timer and m_stopped, timer is stopped from caller thread and re-armed from IO thread
+    boost::mutex                        m_timer_mutex;
+    bool                                m_stopped;
+    static void expire(boost::weak_ptr<ResourceAuth> weak_self, boost::system::error_code const& ec);
     auth_status_t handleBasicAuthentication(
 		ResolveUserFn resolveUser
         , http::MsgParserPtr http_request
@@ -44,8 +58,19 @@ private:
 public:
     auth_status_t handleAuthentication(ResolveUserFn resolveUser, http::MsgParserPtr http_request, std::string const& domain);
     void add_sent_nonce(std::string const& nonce);
+    /// starts periodic removal of expired users and nonces on io_service
+    void startExpiry(boost::asio::io_service& io_service);
+    void stopExpiry(void);
+    ShardedCache<std::string>::stats_t user_stats(void) const { return m_user_cache.stats(); }
+    ShardedCache<std::string>::stats_t secret_stats(void) const { return m_secret_cache.stats(); }
+    ShardedCache<bool>::stats_t nonce_stats(void) const { return m_nonce_cache.stats(); }
     ResourceAuth(void)
-     : m_cache_cleanup_time(boost::posix_time::second_clock::universal_time())
+     : m_user_cache(boost::posix_time::seconds(long(CACHE_EXPIRATION)), CACHE_MAX_USERS)
+     , m_secret_cache(boost::posix_time::seconds(long(CACHE_EXPIRATION)), CACHE_MAX_USERS)
+     , m_nonce_cache(boost::posix_time::seconds(long(NONCE_EXPIRATION)), CACHE_MAX_NONCES)
+     , m_cleanup_timer()
+     , m_timer_mutex()
+     , m_stopped(true)
      { }
 };
 
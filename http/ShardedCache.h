@@ -0,0 +1,142 @@
+#ifndef SHARDED_CACHE_H
+#define SHARDED_CACHE_H
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/cstdint.hpp>
+#include <list>
+#include <string>
+
+namespace scarlet {
+namespace http {
+
+/** ShardedCache: string keyed cache split to shards, each with its own mutex, so threads
+ * looking up different keys don't wait for each other. Entry expires after ttl since it was
+ * inserted, lookups don't extend it. Memory is bounded, when shard is full the earliest inserted
+ * entry is dropped.
+ */
+template<class Value>
+class ShardedCache {
+	ShardedCache(ShardedCache const&) = delete;
+	void operator=(ShardedCache const&) = delete;
+public:
+	enum { SHARDS = 16 };
+	struct stats_t {
+		size_t          entries;
+		boost::uint64_t hits;
+		boost::uint64_t misses;
+		boost::uint64_t evictions;///< dropped because shard was full
+		boost::uint64_t expired;
+	};
+	/** @param ttl how long entry lives after insert
+	 * @param max_entries upper limit of entries in all shards
+	 */
+	ShardedCache(boost::posix_time::time_duration const& ttl, size_t max_entries)
+	: m_ttl(ttl)
+	, m_shard_size(max_entries / SHARDS > 0 ? max_entries / SHARDS : 1)
+	{ }
+	/** copies value of not expired entry
+	 * @return false if there is no such entry or it is expired
+	 */
+	bool find(std::string const& key, Value& value, boost::posix_time::ptime const& now)
+	{
+		shard_t& s(shard(key));
+		boost::mutex::scoped_lock lock(s.mutex);
+		typename map_t::iterator it(s.map.find(key));
+		if (it == s.map.end()) {
+			++s.misses;
+			return false;
+		}
+		if (now > it->second.time + m_ttl) {
+			s.order.erase(it->second.order);
+			s.map.erase(it);
+			++s.expired;
+			++s.misses;
+			return false;
+		}
+		value = it->second.value;
+		++s.hits;
+		return true;
+	}
+	/// inserts or replaces entry
+	void insert(std::string const& key, Value const& value, boost::posix_time::ptime const& now)
+	{
+		shard_t& s(shard(key));
+		boost::mutex::scoped_lock lock(s.mutex);
+		typename map_t::iterator it(s.map.find(key));
+		if (it != s.map.end()) {
+			it->second.value = value;
+			it->second.time = now;
+			return;
+		}
+		if (s.map.size() >= m_shard_size) {
+			s.map.erase(s.order.front());
+			s.order.pop_front();
+			++s.evictions;
+		}
+		s.order.push_back(key);
+		entry_t& e(s.map[key]);
+		e.value = value;
+		e.time = now;
+		e.order = --s.order.end();
+	}
+	/// removes expired entries, one shard locked at a time
+	void expire(boost::posix_time::ptime const& now)
+	{
+		for (size_t i = 0; i < SHARDS; ++i) {
+			shard_t& s(m_shards[i]);
+			boost::mutex::scoped_lock lock(s.mutex);
+			for (typename map_t::iterator it(s.map.begin()); it != s.map.end(); ) {
+				if (now > it->second.time + m_ttl) {
+					s.order.erase(it->second.order);
+					it = s.map.erase(it);
+					++s.expired;
+				} else {
+					++it;
+				}
+			}
+		}
+	}
+	stats_t stats(void) const
+	{
+		stats_t st = { 0, 0, 0, 0, 0 };
+		for (size_t i = 0; i < SHARDS; ++i) {
+			shard_t const& s(m_shards[i]);
+			boost::mutex::scoped_lock lock(s.mutex);
+			st.entries += s.map.size();
+			st.hits += s.hits;
+			st.misses += s.misses;
+			st.evictions += s.evictions;
+			st.expired += s.expired;
+		}
+		return st;
+	}
+private:
+	typedef std::list<std::string> order_t;
+	struct entry_t {
+		Value                    value;
+		boost::posix_time::ptime time;
+		typename order_t::iterator order;
+	};
+	typedef boost::unordered_map<std::string, entry_t> map_t;
+	struct shard_t {
+		mutable boost::mutex mutex;
+		map_t                map;
+		order_t              order;///< keys by insertion, front is evicted first
+		boost::uint64_t      hits;
+		boost::uint64_t      misses;
+		boost::uint64_t      evictions;
+		boost::uint64_t      expired;
+		shard_t(void) : hits(0), misses(0), evictions(0), expired(0) { }
+	};
+	shard_t& shard(std::string const& key) { return m_shards[boost::hash<std::string>()(key) % SHARDS]; }
+	boost::posix_time::time_duration const m_ttl;
+	size_t const                           m_shard_size;
+	shard_t                                m_shards[SHARDS];
+};
+
+}
+}
+
+#endif // SHARDED_CACHE_H
@@ -0,0 +1,151 @@
+#include "ChunkedStream.h"
+#include "bmu/Logger.h"
+#include <boost/thread/thread_time.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace scarlet {
+namespace http {
+
+ChunkedStream::ChunkedStream(net::TCPConnectionPtr tcp_conn, MsgSerializerPtr msg, FinishedConnHandler handler, SendGateFn const& gate)
+	: m_tcp_conn(tcp_conn)
+	, m_msg(msg)
+	, m_writer()
+	, m_finished(handler)
+	, m_gate(gate)
+	, m_filling()
+	, m_sending()
+	, m_started(false)
+	, m_turn(!gate)
+	, m_final(false)
+	, m_mutex()
+	, m_sent_cond()
+	, m_busy(false)
+	, m_failed(false)
+	, m_writer_finishes(false)
+{
+	m_filling.reserve(CHUNK_SIZE);
+}
+
+ChunkedStreamPtr ChunkedStream::create(net::TCPConnectionPtr tcp_conn, MsgSerializerPtr msg, FinishedConnHandler handler
+	, SendGateFn const& gate)
+{
+	return ChunkedStreamPtr(new ChunkedStream(tcp_conn, msg, handler, gate));
+}
+
+void ChunkedStream::write(u8unit_t const* data, size_t length)
+{
+	while (length > 0) {
+		// puni buffer se salje tek kad stigne jos podataka, tijelo od jednog buffera ide bez chunkova
+		if (m_filling.size() >= CHUNK_SIZE && !flush(false))
+			return; // konekcija je pukla, ostatak tijela se odbacuje
+		// before its turn pipelined response collects the whole body
+		size_t const room(m_filling.size() < CHUNK_SIZE ? CHUNK_SIZE - m_filling.size() : length);
+		size_t const n(std::min<size_t>(room, length));
+		m_filling.append(data, data + n);
+		data += n;
+		length -= n;
+	}
+}
+
+bool ChunkedStream::wait_sent(boost::mutex::scoped_lock& lock)
+{
+	boost::system_time const deadline(boost::get_system_time() + boost::posix_time::seconds(long(SEND_TIMEOUT)));
+	while (m_busy && !m_failed) {
+		if (!m_sent_cond.timed_wait(lock, deadline)) {
+			WARNCLOG("Timeout sending HTTP response chunk, abandoning response");
+			m_failed = true;
+		}
+	}
+	return !m_failed;
+}
+
+bool ChunkedStream::flush(bool is_final)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (!m_turn) {
+		// pipelined odziv ceka da se posalju prethodni, worker ne ceka nego nastavlja puniti buffer
+		if (m_failed) return false;
+		bool const first(!m_started);
+		m_started = true;
+		m_final = is_final;
+		lock.unlock();
+		if (first)
+			m_tcp_conn->getIOService().post(boost::bind(m_gate
+				, boost::function<void ()>(boost::bind(&ChunkedStream::handleTurn, shared_from_this()))));
+		return true;
+	}
+	if (!wait_sent(lock)) return false;
+	send(is_final, lock);
+	return true;
+}
+
+void ChunkedStream::send(bool is_final, boost::mutex::scoped_lock& lock)
+{
+	if (!m_writer) {
+		// writer drzi stream dok ne zavrsi sa konekcijom, handleFinished prekida taj krug
+		m_writer = MsgWriter::create(m_tcp_conn, m_msg
+			, boost::bind(&ChunkedStream::handleFinished, shared_from_this(), _1));
+		m_writer->set_chunk_handler(boost::bind(&ChunkedStream::handleChunkSent, this, _1));
+	}
+	m_sending.swap(m_filling);
+	m_filling.clear();
+	m_busy = !is_final; // zavrsetak zadnjeg chunka ide direktno u finish handler
+	m_started = true;
+	MsgWriterPtr const writer(m_writer);
+	lock.unlock();
+	// IO thread ne dira m_msg dok nije poslan prethodni chunk
+	m_msg->append_nocopy(reinterpret_cast<char const*>(m_sending.data()), m_sending.size());
+	m_tcp_conn->getIOService().post(boost::bind(&MsgWriter::send_async_chunk, writer, is_final));
+}
+
+void ChunkedStream::handleTurn(void)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_turn = true;
+	// nekompletan odziv zavrsava handleAbandoned, a worker koji jos puni buffer salje ga sam
+	if (m_failed || !m_final) return;
+	send(true, lock);
+}
+
+void ChunkedStream::finish(bool complete)
+{
+	assert(m_started);
+	if (complete && flush(true)) return;
+	// nekompletan odziv klijent moze prepoznati samo po zatvorenoj konekciji
+	boost::mutex::scoped_lock lock(m_mutex);
+	wait_sent(lock);
+	m_failed = true;
+	if (m_busy || m_writer_finishes) return; // writer zavrsava konekciju kad se zavrsi slanje
+	lock.unlock();
+	// stanje konekcije mijenja IO thread, pipelined konekciju dijele odzivi vise zahtjeva
+	m_tcp_conn->getIOService().post(boost::bind(&ChunkedStream::handleAbandoned, shared_from_this()));
+}
+
+void ChunkedStream::handleAbandoned(void)
+{
+	m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE);
+	handleFinished(m_tcp_conn);
+}
+
+bool ChunkedStream::handleChunkSent(bool sent)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_busy = false;
+	if (!sent) m_failed = true;
+	m_writer_finishes = m_failed;
+	m_sent_cond.notify_all();
+	return !m_failed;
+}
+
+void ChunkedStream::handleFinished(net::TCPConnectionPtr tcp_conn)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_writer.reset();
+	}
+	m_finished(tcp_conn);
+}
+
+}
+}
@@ -0,0 +1,86 @@
+#ifndef CHUNKED_STREAM_H
+#define CHUNKED_STREAM_H
+#include <scarlet/http/MsgWriter.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+namespace scarlet {
+namespace http {
+
+class ChunkedStream;
+typedef boost::shared_ptr<ChunkedStream> ChunkedStreamPtr;
+
+/** ChunkedStream: sink for response body generated in a worker thread. Body is collected in a
+ * buffer of CHUNK_SIZE bytes, each full buffer is sent as one HTTP chunk from the IO thread of
+ * the connection while the next one is filled. Writer waits until the previous chunk is sent,
+ * so memory used by the response is bounded by two chunks whatever the size of the body.
+ * Pipelined response never blocks the worker before its turn: the body is collected until the
+ * gate gives the turn and sent as one chunk then, only the rest is bounded.
+ * If the whole body fits in one buffer nothing is sent, the caller takes the body and sends
+ * it as a usual response with Content-Length.
+ */
+class ChunkedStream : public boost::enable_shared_from_this<ChunkedStream> {
+	ChunkedStream(ChunkedStream const&) = delete;
+	void operator=(ChunkedStream const&) = delete;
+	typedef boost::function<void (net::TCPConnectionPtr)> FinishedConnHandler;
+	typedef boost::function<void (boost::function<void ()> const&)> SendGateFn;
+	ChunkedStream(net::TCPConnectionPtr tcp_conn, MsgSerializerPtr msg, FinishedConnHandler handler, SendGateFn const& gate);
+public:
+	enum { CHUNK_SIZE = 16384 };
+	/// seconds to wait for a chunk to be sent before the response is abandoned
+	enum { SEND_TIMEOUT = 60 };
+	/** @param msg response with status line and headers set, it must support chunks
+	 * @param handler function called after the response has been sent
+	 * @param gate if set, nothing is sent until it calls the function passed to it, if it drops
+	 *        the function the response is dropped too
+	 */
+	static ChunkedStreamPtr create(net::TCPConnectionPtr tcp_conn, MsgSerializerPtr msg, FinishedConnHandler handler
+		, SendGateFn const& gate = SendGateFn());
+	/// appends data to the body, blocks while the previous chunk is being sent
+	void write(u8unit_t const* data, size_t length);
+	/// true if headers and at least one chunk have been passed to the connection
+	bool started(void) const { return m_started; }
+	/** sends the rest of the body with the final chunk, or closes the connection if the body
+	 * could not be generated completely
+	 * @param complete false if the body writer failed
+	 */
+	void finish(bool complete);
+	/// body collected so far, only valid if not started()
+	u8vector_t& body(void) { return m_filling; }
+private:
+	/// passes the filled buffer to the IO thread, false if the connection failed
+	bool flush(bool is_final);
+	/// sends the filled buffer as a chunk, assumes that the lock has already been acquired and releases it
+	void send(bool is_final, boost::mutex::scoped_lock& lock);
+	/// called through the gate from the IO thread when the response may be sent
+	void handleTurn(void);
+	/// waits for the chunk being sent, false on timeout or send failure
+	bool wait_sent(boost::mutex::scoped_lock& lock);
+	/// called from the IO thread after a non-final chunk has been sent
+	bool handleChunkSent(bool sent);
+	/// called from the IO thread when the connection is done with the response
+	void handleFinished(net::TCPConnectionPtr tcp_conn);
+	/// called from the IO thread after the first chunk was sent, closes the connection after incomplete body
+	void handleAbandoned(void);
+	net::TCPConnectionPtr     m_tcp_conn;
+	MsgSerializerPtr          m_msg;
+	MsgWriterPtr              m_writer;
+	FinishedConnHandler       m_finished;
+	SendGateFn                m_gate;
+	u8vector_t                m_filling;///< filled by write()
+	u8vector_t                m_sending;///< referenced by m_msg until the chunk is sent
+	bool                      m_started;
+	bool                      m_turn;///< chunks may be sent, always with no gate
+	bool                      m_final;///< body is complete, waits for the turn
+	boost::mutex              m_mutex;
+	boost::condition_variable m_sent_cond;
+	bool                      m_busy;///< chunk is being sent
+	bool                      m_failed;///< sending failed or was abandoned, nothing more is sent
+	bool                      m_writer_finishes;///< writer will call the finish handler
+};
+
+}
+}
+
+#endif // CHUNKED_STREAM_H
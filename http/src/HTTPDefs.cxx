@@ -26,6 +26,7 @@ std::string const HTTPDefs::HEADER_WWW_AUTHENTICATE("WWW-Authenticate");
 std::string const HTTPDefs::HEADER_ETAG("Etag");
 std::string const HTTPDefs::HEADER_IF_MATCH("If-Match");
 std::string const HTTPDefs::HEADER_IF_NONE_MATCH("If-None-Match");
+std::string const HTTPDefs::HEADER_RETRY_AFTER("Retry-After");
 
 // common HTTP request methods
 std::string const HTTPDefs::REQUEST_METHOD_HEAD("HEAD");
@@ -47,6 +48,7 @@ std::string const HTTPDefs::RESPONSE_MESSAGE_NOT_MODIFIED("Not Modified");
 std::string const HTTPDefs::RESPONSE_MESSAGE_BAD_REQUEST("Bad Request");
 std::string const HTTPDefs::RESPONSE_MESSAGE_SERVER_ERROR("Server Error");
 std::string const HTTPDefs::RESPONSE_MESSAGE_NOT_IMPLEMENTED("Not Implemented");
+std::string const HTTPDefs::RESPONSE_MESSAGE_SERVICE_UNAVAILABLE("Service Unavailable");
 std::string const HTTPDefs::RESPONSE_MESSAGE_CONTINUE("Continue");
 
 // common HTTP response codes
@@ -62,6 +64,7 @@ const unsigned int	HTTPDefs::RESPONSE_CODE_NOT_MODIFIED = 304;
 const unsigned int	HTTPDefs::RESPONSE_CODE_BAD_REQUEST = 400;
 const unsigned int	HTTPDefs::RESPONSE_CODE_SERVER_ERROR = 500;
 const unsigned int	HTTPDefs::RESPONSE_CODE_NOT_IMPLEMENTED = 501;
+const unsigned int	HTTPDefs::RESPONSE_CODE_SERVICE_UNAVAILABLE = 503;
 const unsigned int	HTTPDefs::RESPONSE_CODE_CONTINUE = 100;
 
 // static member functions
@@ -341,17 +344,6 @@ void HeadersMultimap::set(std::string const& name, std::string const& value)
     }
 }
 
-void HeadersMultimap::serialize(std::vector<boost::asio::const_buffer>& buffer) const
-{
-    // append HTTP headers
-    for (nocasemap_t::const_iterator i(m_map.begin()); i != m_map.end(); ++i) {
-        buffer.push_back(boost::asio::buffer(i->first));
-        buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_COLON_AND_SPACE));
-        buffer.push_back(boost::asio::buffer(i->second));
-        buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
-    }
-}
-
 void HeadersMultimap::dump(void) const
 {
     for (nocasemap_t::const_iterator i(m_map.begin()); i != m_map.end(); ++i) {
@@ -0,0 +1,64 @@
+#ifndef SCARLET_HTTP_HEADER_SCAN_H
+#define SCARLET_HTTP_HEADER_SCAN_H
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCARLET_HTTP_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace scarlet {
+namespace http {
+namespace scan {
+
+#if defined(SCARLET_HTTP_SCAN_SSE2)
+/// index of lowest set bit, mask must not be zero
+inline unsigned int lowest_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/// scalar reference of find_char
+inline char const* find_char_scalar(char const* begin, char const* end, char c)
+{
+    for( ; begin != end; ++begin) {
+        if(*begin == c) return begin;
+    }
+    return end;
+}
+
+/** Finds first occurence of c in [begin, end), with SSE2 compares 16 bytes per step.
+ * http/test/HeaderScanTest.cxx checks it against find_char_scalar.
+ * @return pointer to found char or end if not found
+ */
+inline char const* find_char(char const* begin, char const* end, char c)
+{
+#if defined(SCARLET_HTTP_SCAN_SSE2)
+    __m128i const needle(_mm_set1_epi8(c));
+    char const* p(begin);
+    for( ; end - p >= 16; p += 16) {
+        __m128i const block(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)));
+        unsigned int const mask(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+        if(mask) return p + lowest_bit(mask);
+    }
+    return find_char_scalar(p, end, c);
+#else
+    return find_char_scalar(begin, end, c);
+#endif
+}
+
+}
+}
+}
+
+#endif // SCARLET_HTTP_HEADER_SCAN_H
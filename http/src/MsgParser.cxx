@@ -1,22 +1,25 @@
 #include "scarlet/http/MsgParser.h"
+#include "HeaderScan.h"
 #include "bmu/Logger.h"
-#include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/case_conv.hpp> //to_lower_copy
+#include <boost/algorithm/string/predicate.hpp> //iequals
 #include <boost/lexical_cast.hpp>
 #include <iostream>
+#include <cstdlib>
+#include <cerrno>
 
 namespace scarlet {
 namespace http {
 
 bool MsgHeadersParser::is_chunked(void) const
 {
-    std::string const& line(get_field(HTTPDefs::HEADER_TRANSFER_ENCODING));
+    std::string const line(get_field(HTTPDefs::HEADER_TRANSFER_ENCODING));
     return !line.empty() && boost::algorithm::to_lower_copy(line).find("chunked") != std::string::npos;
 }
 
 int MsgHeadersParser::get_content_length(void) const
 {
-    std::string const& value(get_field(HTTPDefs::HEADER_CONTENT_LENGTH));
+    std::string const value(get_field(HTTPDefs::HEADER_CONTENT_LENGTH));
     if(value.empty()) return -1;
     try {
         return boost::lexical_cast<int>(value);
@@ -28,24 +31,48 @@ int MsgHeadersParser::get_content_length(void) const
 
 RequestLine const* MsgHeadersParser::get_request_line(void) const
 {
-    if(m_headers.empty()) return 0;
+    if(m_start_line.empty()) return 0;
     if(!m_rqline)
-        m_rqline = boost::shared_ptr<RequestLine>(new RequestLine(m_headers[0]));
+        m_rqline = boost::shared_ptr<RequestLine>(new RequestLine(m_start_line.to_string()));
     return m_rqline.get();
 }
 
 
 StatusLine const* MsgHeadersParser::get_status_line(void) const
 {
-    if(m_headers.empty()) return 0;
+    if(m_start_line.empty()) return 0;
     if(!m_stline)
-        m_stline = boost::shared_ptr<StatusLine>(new StatusLine(m_headers[0]));
+        m_stline = boost::shared_ptr<StatusLine>(new StatusLine(m_start_line.to_string()));
     return m_stline.get();
 }
 
+std::string MsgHeadersParser::get_field(boost::string_ref name) const
+{
+    std::string value;
+    bool found(false);
+    for(size_t i(0); i<m_fields.size(); ++i) {
+        if(!boost::algorithm::iequals(m_fields[i].name, name)) continue;
+        if(found) value.push_back(',');
+        value.append(m_fields[i].value.begin(), m_fields[i].value.end());
+        found = true;
+    }
+    return value;
+}
+
+HeadersMultimap const& MsgHeadersParser::get_headers(void) const
+{
+    if(!m_map_built) {
+        for(size_t i(0); i<m_fields.size(); ++i)
+            m_headers_map.add(m_fields[i].name.to_string(), m_fields[i].value.to_string());
+        m_headers_map.normalize();
+        m_map_built = true;
+    }
+    return m_headers_map;
+}
+
 bool MsgHeadersParser::checkKeepAlive(bool is_request) const
 {
-    if(m_headers.empty()) return false;
+    if(m_start_line.empty()) return false;
     std::string conn(get_field(HTTPDefs::HEADER_CONNECTION));
     unsigned short vmajor(0);
     unsigned short vminor(0);
@@ -71,54 +98,68 @@ bool MsgHeadersParser::checkKeepAlive(bool is_request) const
 size_t MsgHeadersParser::parse(const char* data, size_t length)
 {
 	if(!data || !length) return 0;
+    if(m_finished) {
+        std::wclog << "It should never be executed " << __FUNCTION__ << " for finished headers" << std::endl;
+        return 0;
+    }
     size_t j(0);
-    for( ; j<length; ++j) {
-        char const octet(data[j]);
-        switch(m_state) {
-        case WANTED_START:
-            m_state = WANTED_CR;
-            if(!is_white(octet) || m_headers.empty()) m_headers.push_back(std::string());//pocetak novog headera
-            break;
-        case WANTED_CR:
-            if(octet == 0x0d) m_state = WANTED_LF;
-            break;
-        case WANTED_LF:
-            if(octet == 0x0a) {
-                m_state = WANTED_START; // line continued or start of new line expected
-            } else {
-                m_state = WANTED_CR; // cancel lf
-            }
-            break;
-        case WANTED_NOTHING:
-            std::wclog << "It should never be executed " << __FUNCTION__ << " for state WANTED_NOTHING" << std::endl;
-            return 0;
+    if(m_raw.empty()) {//empty lines before start line are ignored
+        while(j<length && (data[j] == 0x0d || data[j] == 0x0a)) ++j;
+        if(j == length) return length;
+    }
+    char const* const end(data + length);
+    for(char const* lf(scan::find_char(data + j, end, 0x0a)); lf != end; lf = scan::find_char(lf + 1, end, 0x0a)) {
+        //empty line is CRLFCRLF, its begin can be in previous read
+        size_t const k(lf - data);
+        char tail[3];
+        for(size_t n(1); n<=3; ++n) {
+            if(k >= j + n) tail[n-1] = data[k-n];
+            else if(m_raw.size() >= j + n - k) tail[n-1] = m_raw[m_raw.size() - (j + n - k)];
+            else tail[n-1] = 0;
         }
-        m_headers.back().push_back(octet);
-        if(m_headers.back() == HTTPDefs::STRING_CRLF) {
-            m_headers.pop_back();
-            m_state = WANTED_NOTHING;//end of message header
-            for(size_t k(1); k< m_headers.size(); ++k) {
-                std::string const& line(m_headers[k]);
-                //DBGMSGAT("Puting to map line'" << line << "'");
-                size_t const colon(line.find(':'));
-                if(colon == std::string::npos) {
-                    m_headers_map.add(line, std::string());
-                    //DBGMSGAT("As field='" << line << "' and empty value");
-                } else {
-                    std::string value(line.substr(colon+1));
-                    boost::algorithm::trim_if(value, &MsgHeadersParser::is_white_or_crlf);
-                    m_headers_map.add(line.substr(0, colon), value);
-                    //DBGMSGAT("As field='" << line.substr(0, colon) << "' value='" << value << "'");
-                }
-            }
-            //DBGMSGAT("Finished headers parsing, normalizing");
-            m_headers_map.normalize();
-            //DBGMSGAT("Normalized headers map");
-            break;
+        if(tail[0] == 0x0d && tail[1] == 0x0a && tail[2] == 0x0d) {
+            m_raw.append(data + j, lf + 1);
+            m_raw.resize(m_raw.size() - 4);
+            split_lines();
+            m_finished = true;
+            return k + 1;
         }
     }
+    m_raw.append(data + j, end);
     DBGMSGAT("Finished header parsing cycle");
-    return (j<length) ? j+1 : length;
+    return length;
+}
+
+void MsgHeadersParser::split_lines(void)
+{
+    char const* const end(m_raw.data() + m_raw.size());
+    char const* line(m_raw.data());
+    while(line < end) {
+        //line ends with CRLF, single LF is part of line
+        char const* eol(scan::find_char(line, end, 0x0a));
+        while(eol != end && *(eol - 1) != 0x0d)
+            eol = scan::find_char(eol + 1, end, 0x0a);
+        char const* const next(eol == end ? end : eol + 1);
+        if(eol != end) --eol;//CR
+        if(line == m_raw.data()) {
+            m_start_line = boost::string_ref(line, eol - line);
+        } else if(is_white(*line) && !m_fields.empty()) {//folded line continues previous field
+            field_t& field(m_fields.back());
+            while(eol > field.value.data() && is_white_or_crlf(*(eol - 1))) --eol;
+            field.value = boost::string_ref(field.value.data(), eol - field.value.data());
+        } else {
+            char const* const colon(scan::find_char(line, eol, ':'));
+            field_t field;
+            field.name = boost::string_ref(line, colon - line);
+            char const* vbegin(colon == eol ? eol : colon + 1);
+            while(vbegin < eol && is_white(*vbegin)) ++vbegin;
+            char const* vend(eol);
+            while(vend > vbegin && is_white(*(vend - 1))) --vend;
+            field.value = boost::string_ref(vbegin, vend - vbegin);
+            m_fields.push_back(field);
+        }
+        line = next;
+    }
 }
 
 size_t MsgChunksParser::parse(char const* data, size_t const length)
@@ -142,7 +183,7 @@ size_t MsgChunksParser::parse(char const* data, size_t const length)
                 m_state = CHUNK_SIZE_WANTED_LF;
                 break;
             }
-            if(!is_hex(octet)) {//FAIL
+            if(!is_hex(octet) || m_tmp.size() >= 2 * sizeof(size_t)) {//FAIL, chunk-size can't fit in size_t
                 m_state = CHUNK_FINISHED;
                 return 0;
             }
@@ -158,45 +199,39 @@ size_t MsgChunksParser::parse(char const* data, size_t const length)
                 return (m_tmp.size() > 1) ? 0 : i+1;
             }
             m_state = CHUNK_DATA_WANTED_START;
-            try {
-                m_remaining = boost::lexical_cast<size_t>(m_tmp);
-            } catch (std::bad_cast& /*ex*/) {
-                std::wclog << "Failed cast chunk length to value: '" << m_tmp << "'" << std::endl;
-            }
+            errno = 0;
+            m_remaining = std::strtoul(m_tmp.c_str(), 0, 16);//chunk-size is hex
             m_tmp.clear();
-            if(m_body.size() + m_remaining > m_max_body_size) {//FAIL
+            if(!m_remaining || errno == ERANGE || m_remaining > m_max_body_size - m_body.size()) {//FAIL
                 m_state = CHUNK_FINISHED;
                 return 0;
             }
+            if(m_body.size() + m_remaining > m_body.capacity())//geometric growth, few reallocations for many chunks
+                m_body.reserve(std::min(std::max(m_body.size() + m_remaining, 2 * m_body.capacity()), m_max_body_size));
             break;
-        case CHUNK_DATA_WANTED_START:
-            m_state = CHUNK_DATA_WANTED_CR;
-            m_body.push_back(octet);
+        case CHUNK_DATA_WANTED_START: {
+            //copy as much of chunk data as available in one step
+            size_t const n(std::min(m_remaining, length - i));
+            m_body.insert(m_body.end(), data + i, data + i + n);
+            m_remaining -= n;
+            i += n - 1;
+            if(!m_remaining)
+                m_state = CHUNK_DATA_WANTED_CR;
             break;
+        }
         case CHUNK_DATA_WANTED_CR:
-            if(octet == 0x0d) {
-                m_state = CHUNK_DATA_WANTED_LF;
-            } else {
-                if(!m_remaining) {
-                    m_state = CHUNK_FINISHED;
-                    return 0;
-                }
-                --m_remaining;
-                m_body.push_back(octet);
+            if(octet != 0x0d) {//FAIL
+                m_state = CHUNK_FINISHED;
+                return 0;
             }
+            m_state = CHUNK_DATA_WANTED_LF;
             break;
         case CHUNK_DATA_WANTED_LF:
-            if(octet == 0x0a) {
-                m_state = CHUNK_SIZE_WANTED_START;
-            } else {
-                if(!m_remaining) {
-                    m_state = CHUNK_FINISHED;
-                    return 0;
-                }
-                --m_remaining;
-                m_body.push_back(octet);
-                m_state = CHUNK_DATA_WANTED_CR;//cancel LF
+            if(octet != 0x0a) {//FAIL
+                m_state = CHUNK_FINISHED;
+                return 0;
             }
+            m_state = CHUNK_SIZE_WANTED_START;
             break;
         case CHUNK_FINISHED:
             std::wclog << "It should never be executed " << __FUNCTION__ << " for state CHUNK_FINISHED" << std::endl;
@@ -265,15 +300,11 @@ size_t MsgParser::parse(char const* data, size_t const length)
                 } else if(body_more_bytes <= 0) {
                     DBGMSGAT("Not chunked body and no specified length, can continue only if it's response");
                     if(m_is_request) {
-                        if(consumed < remaining) {
-                            std::wclog << "Invalid request - must be chunked or length specified" << std::endl;
-                            m_state = FAILED;
-                            return 0;
-                        } else {
-                            m_state = FINISHED;
-                            m_body.clear();
-                            DBGMSGAT("Assuming message without body because it's end of bufer");
-                        }
+                        // request without length and not chunked has no body (RFC 7230 3.3.3),
+                        // bytes after its headers belong to the next pipelined request
+                        m_state = FINISHED;
+                        m_body.clear();
+                        DBGMSGAT("Request without body");
                     } else {
                         m_state = WANTED_BODY;
                         m_body_parser.reset(-1);
@@ -293,7 +324,6 @@ size_t MsgParser::parse(char const* data, size_t const length)
             consumed = m_chunked_parser.parse(ptr, remaining);
             if(m_chunked_parser.is_finished()) {
                 m_state = FINISHED;
-                m_chunked_parser.swap_body(m_body);
                 DBGMSGAT("Finished chunked body");
             }
             break;
@@ -301,7 +331,6 @@ size_t MsgParser::parse(char const* data, size_t const length)
             consumed = m_body_parser.parse(ptr, remaining);
             if(m_body_parser.is_finished()) {
                 m_state = FINISHED;
-                m_body_parser.swap_body(m_body);
                 DBGMSGAT("Finished ordinary body");
             }
             break;
@@ -387,7 +416,6 @@ void MsgParser::set_finished(void)
     if(m_state == WANTED_BODY) {
         m_state = FINISHED;
         m_body_parser.set_finished();
-        m_body_parser.swap_body(m_body);
         DBGMSGAT("Done.");
     } else if(m_state != FINISHED) {
         m_state = FAILED;
@@ -2,6 +2,7 @@
 #include "bmu/Logger.h"
 #include <boost/asio/placeholders.hpp>
 #include <iostream>
+#include <cassert>
 
 namespace scarlet {
 namespace http {
@@ -14,6 +15,8 @@ MsgReader::~MsgReader()
 void MsgReader::receive(void)
 {
 	bool const bPipelined = m_tcp_conn->getPipelined();
+	assert(bPipelined || !m_buffered_only);
+	m_idle = m_tcp_conn->getKeepAlive() && !bPipelined;
     m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE);	// default to close the connection
 	if (bPipelined) {
         DBGMSGAT("Loading saved read position on pipelined http connection");
@@ -30,10 +33,12 @@ void MsgReader::receive(void)
 
 void MsgReader::consumeBytes(const boost::system::error_code& read_error, std::size_t bytes_read)
 {
-	// cancel read timer if operation didn't time-out
-	DBGMSGAT("Canceling timer");
-	m_timer.cancel();
+	// cancel read timeout if operation didn't time-out
+	DBGMSGAT("Canceling timeout");
+	m_tcp_conn->cancelDeadline();
+	m_idle = false;
 	if (read_error) { // a read error occured
+        m_tcp_conn->releaseReadBuffer();
         m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE);// forcing the client to establish a new one
         if(m_http_msg->is_unacceptable_eof()) {
 			DBGMSGAT(" READ ERROR unacceptable_eof");
@@ -51,9 +56,10 @@ void MsgReader::consumeBytes(const boost::system::error_code& read_error, std::s
             finishedReading();// this is just a message with unknown content length
         }
 	} else {
+        m_tcp_conn->setCleanClose(false); // request in progress until its response is sent
         DBGMSGAT("Read " << bytes_read << " bytes from HTTP " << ((m_msg_type == READ_AS_REQUEST) ? "request" : "response"));
         // set pointers for new HTTP header data to be consumed
-        parse(m_tcp_conn->getReadBuffer().data(), bytes_read);
+        parse(m_tcp_conn->getReadBuffer(), bytes_read);
 	}
 }
 
@@ -89,6 +95,10 @@ void MsgReader::parse(char const* read_ptr, std::size_t bytes_read)
             DBGMSGAT("Closing connection");
 			m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE);
 		}
+		// unless pipelined bytes are saved in it, read buffer goes back to the pool while response is
+		// processed and connection waits for the next request
+		if (!m_tcp_conn->getPipelined())
+			m_tcp_conn->releaseReadBuffer();
 		DBGMSGAT("Calling HTTP message handler");
 		// we have finished parsing the HTTP message
 		finishedReading();
@@ -96,34 +106,31 @@ void MsgReader::parse(char const* read_ptr, std::size_t bytes_read)
 		DBGMSGAT("Failed HTTP message parsing");
 		// the message is invalid or an error occured
 		m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE);	// make sure it will get closed
+		m_tcp_conn->releaseReadBuffer();
 		//m_http_msg->setIsValid(false);
 		DBGMSGAT("Calling HTTP message handler on failed message");
 		finishedReading();
+	} else if (m_buffered_only) {
+		DBGMSGAT("Pipelined HTTP message is incomplete, leaving it in the read buffer");
+		// saved read position is unchanged, the message is parsed again from its start by the
+		// reader created when the connection may read again
+		m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_PIPELINED);
+		m_finished_conn(m_tcp_conn);
 	} else {
         DBGMSGAT("Not yet finished HTTP message parsing, need more bytes");
 		readBytesWithTimeout();// not yet finished parsing the message -> read more data
 	}
 }
 
-void MsgReader::timerCallback(const boost::system::error_code& ec)
-{
-	auto error_value = ec.value();
-	if (boost::asio::error::operation_aborted != error_value) { // not canceled
-		DBGMSGAT("Closing timed-out connection");
-		if (m_tcp_conn->is_open())
-			m_tcp_conn->close();
-	} else {
-		DBGMSGAT("Conection completly handled and timer was canceled.");
-	}
-}
-
 void MsgReader::readBytesWithTimeout(void)
 {
     DBGMSGAT("Async reading");
-	if(m_read_timeout > 0) {
-        m_timer.expires_from_now(boost::posix_time::seconds(m_read_timeout));
-        m_timer.async_wait(boost::bind(&MsgReader::timerCallback, shared_from_this(), _1));
-        DBGMSGAT("Setting up timer at " << m_read_timeout << " seconds");
+	// timing wheel of the IO service closes timed-out connection, read then completes with an error
+	boost::uint32_t const timeout(m_idle ? m_idle_timeout
+		: m_http_msg->is_reading_body() ? m_body_timeout : m_header_timeout);
+	if(timeout > 0) {
+        m_tcp_conn->setDeadline(timeout);
+        DBGMSGAT("Setting up timeout at " << timeout << " seconds");
 	}
     m_tcp_conn->async_read_some(
         boost::bind(
@@ -25,21 +25,6 @@ bool MsgSerializer::does_support_chunks(void) const
     return vmajor>1 || (vmajor == 1 && vminor >= 1);
 }
 
-void MsgSerializer::header(std::vector<boost::asio::const_buffer>& buffer) const
-{
-    assert((m_rqline && !m_stline) || (!m_rqline && m_stline));
-    // add first line
-    if(m_rqline) {
-        m_text_cache.push_back(m_rqline->string());
-    } else if(m_stline) {
-        m_text_cache.push_back(m_stline->string());
-    }
-    buffer.push_back(boost::asio::buffer(m_text_cache.back()));
-    buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
-    m_headers.serialize(buffer);// append HTTP headers
-    buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
-}
-
 void MsgSerializer::append_nocopy(const std::string& data)
 {
     if(data.empty()) return;
@@ -54,34 +39,46 @@ void MsgSerializer::append_nocopy(char const* data, size_t length)
     m_content_length += length;
 }
 
-void MsgSerializer::body(std::vector<boost::asio::const_buffer>& buffer) const
+void MsgSerializer::serialize(std::vector<boost::asio::const_buffer>& buffer, bool with_header, bool as_chunk, bool final_chunk) const
 {
-    if(m_content_length == 0) return;
-    buffer.insert(buffer.end(), m_content_buffers.begin(), m_content_buffers.end());
-}
-
-void MsgSerializer::chunk(std::vector<boost::asio::const_buffer>& buffer) const
-{
-    if(m_content_length == 0) return;
-    char cast_buf[35];
-    snprintf(cast_buf, _countof(cast_buf), "%lx", static_cast<long>(m_content_length));//chunk length in hex
-    m_text_cache.push_back(cast_buf);
-    buffer.push_back(boost::asio::buffer(m_text_cache.back()));
-    buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
+    bool const inline_body(m_content_length <= INLINE_BODY_SIZE);
+    m_out.clear();
+    if(with_header) {
+        assert((m_rqline && !m_stline) || (!m_rqline && m_stline));
+        if(m_first_line_text) {
+            m_out.append(m_first_line_text->data(), m_first_line_text->size());
+        } else {
+            std::string const line(m_rqline ? m_rqline->string() : m_stline->string());
+            m_out.append(line.data(), line.size());
+            m_out.append("\r\n", 2);
+        }
+        m_headers.serialize(m_out);
+        m_out.append("\r\n", 2);
+    }
+    if(as_chunk && m_content_length > 0) {
+        char cast_buf[35];
+        int const n(snprintf(cast_buf, _countof(cast_buf), "%lx\r\n", static_cast<long>(m_content_length)));//chunk length in hex
+        m_out.append(cast_buf, n);
+    }
+    if(inline_body) {
+        for(size_t i(0); i < m_content_buffers.size(); ++i) {
+            m_out.append(boost::asio::buffer_cast<char const*>(m_content_buffers[i])
+                , boost::asio::buffer_size(m_content_buffers[i]));
+        }
+    }
+    size_t const head_size(m_out.size());
+    if(as_chunk) {
+        if(m_content_length > 0) m_out.append("\r\n", 2);
+        if(final_chunk) m_out.append("0\r\n\r\n", 5);//zero-length chunk and empty trailer
+    }
+    // buffers are taken only after m_out is complete, appending may move it
+    if(inline_body) {
+        if(!m_out.empty()) buffer.push_back(boost::asio::buffer(m_out.data(), m_out.size()));
+        return;
+    }
+    if(head_size > 0) buffer.push_back(boost::asio::buffer(m_out.data(), head_size));
     buffer.insert(buffer.end(), m_content_buffers.begin(), m_content_buffers.end());
-    buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
-}
-
-void MsgSerializer::final_chunk(std::vector<boost::asio::const_buffer>& buffer) const
-{
-    assert(m_content_length == 0);
-    assert(m_content_buffers.size() == 0);
-    m_text_cache.push_back("0");
-    //zero-length chunk
-    buffer.push_back(boost::asio::buffer(m_text_cache.back()));
-    buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
-    //empty content chunk
-    buffer.push_back(boost::asio::buffer(HTTPDefs::STRING_CRLF));
+    if(m_out.size() > head_size) buffer.push_back(boost::asio::buffer(m_out.data() + head_size, m_out.size() - head_size));
 }
 
 }
@@ -17,8 +17,10 @@ void MsgWriter::handleWrite(const boost::system::error_code& write_error, std::s
 	m_tcp_conn->setSendingState(false);
     char const* const msgtype_str(m_is_request ? "request" : "response");
     if (write_error) { // encountered error sending response
-        if(!m_is_request)
+        if(!m_is_request) {
             m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE); // make sure it will get closed
+            m_tcp_conn->setCleanClose(false);
+        }
 		WARNCLOG("Unable to send HTTP " << msgtype_str << " (" << write_error.message() << ')');
 	} else { // message sent OK
         if (m_sending_chunks) {
@@ -33,7 +35,17 @@ void MsgWriter::handleWrite(const boost::system::error_code& write_error, std::s
 #endif
         }
     }
-    //if (m_finished) m_finished();
+    if (!write_error && !m_is_request && m_sent_final)
+        m_tcp_conn->setCleanClose(true); // response complete, its SSL session may be resumed
+    if (m_sending_chunks && !m_sent_final) {
+        // poruka nije kompletna, konekcija se zavrsava tek nakon zadnjeg chunka
+        bool const more(m_chunk_sent ? m_chunk_sent(!write_error) : !write_error);
+        if (more) return;
+        if (!write_error) {
+            m_tcp_conn->setLifecycle(net::TCPConnection::LIFECYCLE_CLOSE); // incomplete message
+            WARNCLOG("HTTP " << msgtype_str << " abandoned before the final chunk");
+        }
+    }
     m_finished(m_tcp_conn);
 }
 
@@ -53,6 +65,9 @@ void MsgWriter::prepare_message(bool try_chunked)
         }
     } else {
         assert(!m_is_request);
+        // without it kept alive client would read the body until the connection closes
+        static std::string const zero_length("0");
+        m_msg->set_header(HTTPDefs::HEADER_CONTENT_LENGTH, zero_length);
     }
 }
 
@@ -68,19 +83,14 @@ bool MsgWriter::send_async_more(bool try_chunked, bool send_final_chunk)
 #endif
     // prepare the write buffers to be sent
     std::vector<boost::asio::const_buffer> buffer;
-	if (!m_sent_headers) {// check if the HTTP headers have been sent yet
+    bool const with_header(!m_sent_headers);// check if the HTTP headers have been sent yet
+	if (with_header) {
 		prepare_message(try_chunked);
-		m_msg->header(buffer);
 		m_sent_headers = true;// only send the headers once
 	}
-    if(m_sending_chunks) {
-        m_msg->chunk(buffer);
-    } else {
-        m_msg->body(buffer);
-    }
-	// prepare a zero-byte (final) chunk
-	if (send_final_chunk && m_sending_chunks)
-        m_msg->final_chunk(buffer);
+	// headers, chunk framing and small body go out as one buffer, a zero-byte (final) chunk included
+    m_msg->serialize(buffer, with_header, m_sending_chunks, send_final_chunk && m_sending_chunks);
+    m_sent_final = !m_sending_chunks || send_final_chunk;
 	m_tcp_conn->setSendingState(true); // make sure not closed
     // send data in the write buffers
     m_tcp_conn->async_write(buffer, boost::bind(
@@ -0,0 +1,103 @@
+#include "scarlet/http/Pipeline.h"
+#include "bmu/Logger.h"
+
+namespace scarlet {
+namespace http {
+
+Pipeline::Pipeline(net::TCPConnectionPtr tcp_conn, FinishedConnHandler handler)
+	: m_tcp_conn(tcp_conn)
+	, m_finished(handler)
+	, m_mutex()
+	, m_slots()
+	, m_turn(0)
+	, m_sending(false)
+	, m_aborted(false)
+	, m_after(net::TCPConnection::LIFECYCLE_CLOSE)
+{
+	m_slots.reserve(MAX_REQUESTS);
+}
+
+PipelinePtr Pipeline::create(net::TCPConnectionPtr tcp_conn, FinishedConnHandler handler)
+{
+	return PipelinePtr(new Pipeline(tcp_conn, handler));
+}
+
+void Pipeline::add(MsgParserPtr http_request, bool keep_alive)
+{
+	slot_t const slot = { http_request, keep_alive, false, SendFn() };
+	m_slots.push_back(slot);
+}
+
+Pipeline::SendFn Pipeline::takeTurn(void)
+{
+	slot_t& slot(m_slots[m_turn]);
+	// Connection header of the response follows its own request, not the last one parsed
+	m_tcp_conn->setLifecycle(slot.keep_alive ? net::TCPConnection::LIFECYCLE_KEEPALIVE : net::TCPConnection::LIFECYCLE_CLOSE);
+	m_sending = true;
+	SendFn send;
+	send.swap(slot.send);
+	return send;
+}
+
+void Pipeline::whenTurn(size_t ticket, SendFn const& send)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (m_aborted || m_slots[ticket].done) return; // dropped, or abandoned before its turn
+	m_slots[ticket].send = send;
+	if (ticket != m_turn || m_sending) {
+		DBGMSGAT("Pipelined response " << ticket << " waits for response " << m_turn);
+		return;
+	}
+	SendFn const turn(takeTurn());
+	lock.unlock();
+	turn(); // writer may finish the response immediately, which locks again
+}
+
+void Pipeline::abort(void)
+{
+	m_aborted = true;
+	for (size_t i = m_turn; i < m_slots.size(); ++i) {
+		m_slots[i].send.clear(); // releases the response and its in-flight request
+		m_slots[i].request.reset();
+	}
+}
+
+void Pipeline::finished(size_t ticket, net::TCPConnectionPtr tcp_conn)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	slot_t& slot(m_slots[ticket]);
+	// connection state belongs to the response only during its turn, response finished before
+	// its turn was never sent and the client can't skip it
+	bool const in_turn(ticket == m_turn && m_sending);
+	slot.done = true;
+	slot.send.clear();
+	slot.request.reset();
+	if (in_turn)
+		m_sending = false;
+	if (m_aborted) {
+		// connection is closed after the response which was being sent when it aborted
+		if (!in_turn) return;
+	} else if (!in_turn || !tcp_conn->getKeepAlive()) {
+		// failed write, abandoned stream or the request closing the connection
+		DBGMSGAT("Pipelined response " << ticket << " failed, dropping later responses");
+		abort();
+		if (m_sending) return; // response of m_turn finishes the connection
+	} else {
+		while (m_turn < m_slots.size() && m_slots[m_turn].done)
+			++m_turn;
+	}
+	if (m_aborted || m_turn == m_slots.size()) {
+		DBGMSGAT((m_aborted ? "Aborted" : "Finished") << " pipeline after " << m_turn << " responses");
+		tcp_conn->setLifecycle(m_aborted ? net::TCPConnection::LIFECYCLE_CLOSE : m_after);
+		lock.unlock();
+		m_finished(tcp_conn);
+		return;
+	}
+	if (m_sending || !m_slots[m_turn].send) return;
+	SendFn const turn(takeTurn());
+	lock.unlock();
+	turn();
+}
+
+}
+}
@@ -4,6 +4,7 @@
 #include <scarlet/http/MsgReader.h>
 #include <scarlet/http/MsgParser.h>
 #include <scarlet/http/MsgWriter.h>
+#include "ChunkedStream.h"
 #include <boost/make_shared.hpp>
 #include <boost/bind.hpp>
 #include <boost/uuid/uuid.hpp> //boost version >= 1.42
@@ -28,20 +29,42 @@ void split_at_semicolon(std::vector<std::string>& out, std::string const& fields
 namespace http
 {
 
+static void append_body(u8vector_t& body, u8unit_t const* data, size_t length)
+{
+	body.append(data, data + length);
+}
+
+/** request stops counting against the in-flight limit once its response has been sent, or when
+ * the last copy of the handler is dropped without being called
+ */
+static void end_request(FinishedConnectionFn const& finishHandler, net::InFlightRequestPtr const& in_flight, net::TCPConnectionPtr tcp_conn)
+{
+	in_flight->end();
+	finishHandler(tcp_conn);
+}
+
+static void set_unavailable(httpresponse_t& response)
+{
+	static std::string const retry_after(std::to_string(int(RequestHandler::RETRY_AFTER)));
+	response.code = HTTP_ERROR_UNAVAILABLE;
+	response.extra_hdrs[HTTPDefs::HEADER_RETRY_AFTER] = retry_after;
+}
+
 /** creates a new HTTPServer object
 * @param scheduler the WorkScheduler that will be used to manage worker threads
 * @param endpoint TCP endpoint used to listen for new connections (see ASIO docs)
 */
-RequestHandler::RequestHandler(SvcHandlerPtr svc_handler)
+RequestHandler::RequestHandler(SvcHandlerPtr svc_handler, net::WorkerPoolPtr workers)
 	: svc_handler(svc_handler)
+	, workers(workers)
 	, auth(boost::make_shared<ResourceAuth>())
 	, m_max_content_length(HTTPDefs::DEFAULT_MAX_BODY_SIZE)
 {
 }
 
-RequestHandlerPtr RequestHandler::create(SvcHandlerPtr svc_handler)
+RequestHandlerPtr RequestHandler::create(SvcHandlerPtr svc_handler, net::WorkerPoolPtr workers)
 {
-	return RequestHandlerPtr(new RequestHandler(svc_handler));
+	return RequestHandlerPtr(new RequestHandler(svc_handler, workers));
 }
 
 std::string status_message(scarlet::http::response_code_e code)
@@ -65,43 +88,45 @@ std::string status_message(scarlet::http::response_code_e code)
 		return "Precondition Failed - Failed If-Match, If-None-Match or their combination";
 	case HTTP_FAIL_MIME: // = 415,//Unsupported Media Type
 		return "Unsupported Media Type by XCAP";
+	case HTTP_ERROR_UNAVAILABLE: // = 503, //Service Unavailable
+		return HTTPDefs::RESPONSE_MESSAGE_SERVICE_UNAVAILABLE;
 	case HTTP_ERROR_INTERNAL: // = 500, //Internal Server Error
 		;
 	}
 	return HTTPDefs::RESPONSE_MESSAGE_SERVER_ERROR;
 }
 
+/// @return status line with CRLF formatted once per code, null if HTTP version is not 1.0 or 1.1
+static std::string const* status_line_text(unsigned short ver_major, unsigned short ver_minor, scarlet::http::response_code_e code)
+{
+	static struct status_lines_t {
+		std::map<unsigned int, std::string> lines[2];//HTTP/1.0, HTTP/1.1
+		status_lines_t(void)
+		{
+			static response_code_e const codes[] = {
+				HTTP_OK, HTTP_OK_CREATED, HTTP_FAIL_BAD_REQUEST, HTTP_FAIL_AUTHORIZATION, HTTP_FAIL_NOT_FOUND
+				, HTTP_FAIL_NOT_ALLOWED, HTTP_FAIL_CONSTRAINTS, HTTP_FAIL_IF_PERFORM, HTTP_FAIL_MIME
+				, HTTP_ERROR_INTERNAL, HTTP_ERROR_UNAVAILABLE
+			};
+			for (size_t v = 0; v < 2; ++v) {
+				for (size_t i = 0; i < _countof(codes); ++i)
+					lines[v][codes[i]] = StatusLine(1, v, codes[i], status_message(codes[i])).string() + HTTPDefs::STRING_CRLF;
+			}
+		}
+	} const table;
+	if (ver_major != 1 || ver_minor > 1) return 0;
+	std::map<unsigned int, std::string>::const_iterator const it(table.lines[ver_minor].find(code));
+	return (it != table.lines[ver_minor].end()) ? &it->second : 0;
+}
+
 //request->get_major(), request->get_minor()
-void RequestHandler::sendResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler
+void RequestHandler::sendResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, SendGateFn gate
 	, boost::shared_ptr<httpresponse_t> response, std::string const& challenge_domain)
 {
 	DBGMSGAT("Sending response ... ");
 	std::wclog << "Response body = " << bmu::utf8_string(response->body).c_str() << std::endl;
 	try {
-		MsgSerializerPtr http_response(new MsgSerializer);
-		http_response->set_first_line(scarlet::http::StatusLine(
-			ver_major
-			, ver_minor
-			, response->code
-			, status_message(response->code)
-			));
-		if (response->code == scarlet::http::HTTP_FAIL_AUTHORIZATION) {
-			std::string const nonce_str(boost::uuids::to_string(boost::uuids::random_generator()()));
-			auth->add_sent_nonce(nonce_str);//used for future request authentication
-			std::string digest_challenge("Digest qop=\"auth\", realm=\"");
-			digest_challenge.append(challenge_domain)
-				.append("\", nonce=\"")
-				.append(nonce_str)
-				.append("\"");
-			//algorithm defaults to MD5
-			http_response->set_header(scarlet::http::HTTPDefs::HEADER_WWW_AUTHENTICATE, digest_challenge);
-		}
-		if (!response->mime.empty()) http_response->set_header(scarlet::http::HTTPDefs::HEADER_CONTENT_TYPE, response->mime);
-		if (!response->etag.empty()) http_response->set_header(scarlet::http::HTTPDefs::HEADER_ETAG, response->etag);
-		for (std::map<std::string, std::string>::const_iterator it(response->extra_hdrs.begin());
-		it != response->extra_hdrs.end(); ++it) {
-			http_response->set_header(it->first, it->second);
-		}
+		MsgSerializerPtr http_response(prepareResponse(ver_major, ver_minor, tcp_conn, response, challenge_domain));
 		if (!response->body.empty()) {
 			if ((response->code&(-2)) != scarlet::http::HTTP_OK) {
 				http_response->set_header(scarlet::http::HTTPDefs::HEADER_CONTENT_TYPE, "application/xcap-error+xml");
@@ -124,7 +149,11 @@ void RequestHandler::sendResponse(unsigned short ver_major, unsigned short ver_m
 				, finishHandler//boost::bind(&http::TCPConnection::finish, tcp_conn)
 				)
 			);
-		if (!writer->send_async()) { // non-blocking call
+		if (gate) {
+			DBGMSGAT("Response waits for its turn");
+			gate(boost::bind(&MsgWriter::send_async, writer));
+		}
+		else if (!writer->send_async()) { // non-blocking call
 			DBGMSGAT("Failed sending response: lost TCP connection");
 		}
 		else {
@@ -138,6 +167,37 @@ void RequestHandler::sendResponse(unsigned short ver_major, unsigned short ver_m
 	}
 }
 
+MsgSerializerPtr RequestHandler::prepareResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn
+	, boost::shared_ptr<httpresponse_t> response, std::string const& challenge_domain)
+{
+	MsgSerializerPtr http_response(net::arena_shared(tcp_conn->getArena(), new(*tcp_conn->getArena()) MsgSerializer(tcp_conn->getArena())));
+	std::string const* const line_text(status_line_text(ver_major, ver_minor, response->code));
+	http_response->set_first_line(scarlet::http::StatusLine(
+		ver_major
+		, ver_minor
+		, response->code
+		, line_text ? std::string() : status_message(response->code)
+		), line_text);
+	if (response->code == scarlet::http::HTTP_FAIL_AUTHORIZATION) {
+		std::string const nonce_str(boost::uuids::to_string(boost::uuids::random_generator()()));
+		auth->add_sent_nonce(nonce_str);//used for future request authentication
+		std::string digest_challenge("Digest qop=\"auth\", realm=\"");
+		digest_challenge.append(challenge_domain)
+			.append("\", nonce=\"")
+			.append(nonce_str)
+			.append("\"");
+		//algorithm defaults to MD5
+		http_response->set_header(scarlet::http::HTTPDefs::HEADER_WWW_AUTHENTICATE, digest_challenge);
+	}
+	if (!response->mime.empty()) http_response->set_header(scarlet::http::HTTPDefs::HEADER_CONTENT_TYPE, response->mime);
+	if (!response->etag.empty()) http_response->set_header(scarlet::http::HTTPDefs::HEADER_ETAG, response->etag);
+	for (std::map<std::string, std::string>::const_iterator it(response->extra_hdrs.begin());
+	it != response->extra_hdrs.end(); ++it) {
+		http_response->set_header(it->first, it->second);
+	}
+	return http_response;
+}
+
 void RequestHandler::exceptions_handler(boost::shared_ptr<scarlet::http::httpresponse_t> response)
 {
 	try {
@@ -203,12 +263,62 @@ bool RequestHandler::formatRequest(MsgParserPtr http_request, boost::shared_ptr<
 	return true;
 }
 
-void RequestHandler::handleRequest(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, MsgParserPtr http_request)
+void RequestHandler::handleRequest(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, MsgParserPtr http_request
+	, SendGateFn const& gate)
 {
-	boost::shared_ptr<httpresponse_t> response(boost::make_shared<httpresponse_t>());
+	boost::shared_ptr<httpresponse_t> response(boost::allocate_shared<httpresponse_t>(
+		net::ArenaAllocator<httpresponse_t>(tcp_conn->getArena())));
 	boost::shared_ptr<httprequest_t> fmt_request(svc_handler->createFormattedRequestObject());
 
 	DBGMSGAT("Handling received HTTP request");
+	net::InFlightRequestPtr const in_flight(tcp_conn->beginRequest());
+	if (!in_flight) {
+		DBGMSGAT("Too many requests in flight, rejecting request");
+		set_unavailable(*response);
+		sendResponse(http_request->get_major(), http_request->get_minor(), tcp_conn, finishHandler, gate, response, fmt_request->domain);
+		return;
+	}
+	FinishedConnectionFn const finished(boost::bind(&end_request, finishHandler, in_flight, _1));
+	if (!workers) {
+		processRequest(tcp_conn, finished, gate, http_request, fmt_request, response);
+		return;
+	}
+	// storage and XML processing would block IO thread and all connections on it
+	if (!workers->post(boost::bind(&RequestHandler::processRequest, shared_from_this()
+		, tcp_conn, finished, gate, http_request, fmt_request, response))) {
+		DBGMSGAT("Storage workers are busy, rejecting request");
+		set_unavailable(*response);
+		sendResponse(http_request->get_major(), http_request->get_minor(), tcp_conn, finished, gate, response, fmt_request->domain);
+	}
+}
+
+void RequestHandler::streamResponse(unsigned short ver_major, unsigned short ver_minor, net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, SendGateFn gate
+	, boost::shared_ptr<httpresponse_t> response, std::string const& challenge_domain, BodyWriterFn const& body_writer)
+{
+	ChunkedStreamPtr stream(ChunkedStream::create(tcp_conn
+		, prepareResponse(ver_major, ver_minor, tcp_conn, response, challenge_domain), finishHandler, gate));
+	bool const complete(body_writer(boost::bind(&ChunkedStream::write, stream, _1, _2)));
+	if (stream->started()) {
+		DBGMSGAT("Finishing chunked response");
+		stream->finish(complete);
+		return;
+	}
+	// tijelo je stalo u jedan buffer, salje se kao obican odziv
+	response->body.swap(stream->body());
+	if (!complete) {
+		DBGMSGAT("Failed writing response body");
+		response->code = scarlet::http::HTTP_ERROR_INTERNAL;
+		response->body.clear();
+		response->etag.clear();
+		response->mime.clear();
+	}
+	tcp_conn->getIOService().post(boost::bind(&RequestHandler::sendResponse, shared_from_this()
+		, ver_major, ver_minor, tcp_conn, finishHandler, gate, response, challenge_domain));
+}
+
+void RequestHandler::processRequest(net::TCPConnectionPtr tcp_conn, FinishedConnectionFn finishHandler, SendGateFn gate, MsgParserPtr http_request
+	, boost::shared_ptr<httprequest_t> fmt_request, boost::shared_ptr<httpresponse_t> response)
+{
 	if (!http_request->is_finished()) {//if(!request->isValid()) {
 									   // the request is invalid or an error occured
 		DBGMSGAT("Received incomplete HTTP request");
@@ -232,7 +342,30 @@ void RequestHandler::handleRequest(net::TCPConnectionPtr tcp_conn, FinishedConne
 	}
 	// try to handle the request
 	svc_handler->handleResource(fmt_request, response); // obrada XCAP zahtjeva i formiranje responsa (sa odgovorom ili sa greskom)
-	sendResponse(http_request->get_major(), http_request->get_minor(), tcp_conn, finishHandler, response, fmt_request->domain); // rtask->finish(); // slanje HTTP responsa
+	BodyWriterFn body_writer;
+	body_writer.swap(response->body_writer); // drzi DOM, mora se izvrsiti i osloboditi u ovom threadu
+	if (body_writer && response->code == scarlet::http::HTTP_OK) {
+		if (workers && (http_request->get_major() > 1 || (http_request->get_major() == 1 && http_request->get_minor() >= 1))) {
+			streamResponse(http_request->get_major(), http_request->get_minor(), tcp_conn, finishHandler, gate, response, fmt_request->domain, body_writer);
+			return;
+		}
+		response->body.clear();
+		if (!body_writer(boost::bind(&append_body, boost::ref(response->body), _1, _2))) {
+			DBGMSGAT("Failed writing response body");
+			response->code = scarlet::http::HTTP_ERROR_INTERNAL;
+			response->body.clear();
+			response->etag.clear();
+			response->mime.clear();
+		}
+	}
+	body_writer.clear();
+	if (!workers) {
+		sendResponse(http_request->get_major(), http_request->get_minor(), tcp_conn, finishHandler, gate, response, fmt_request->domain); // rtask->finish(); // slanje HTTP responsa
+		return;
+	}
+	// slanje HTTP responsa iz IO threada konekcije
+	tcp_conn->getIOService().post(boost::bind(&RequestHandler::sendResponse, shared_from_this()
+		, http_request->get_major(), http_request->get_minor(), tcp_conn, finishHandler, gate, response, fmt_request->domain));
 }
 
 }
@@ -6,6 +6,7 @@
 #include "bmu/Logger.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/token_iterator.hpp>
+#include <boost/bind.hpp>
 
 namespace scarlet {
 namespace http {
@@ -24,13 +25,11 @@ ResourceAuth::auth_status_t ResourceAuth::handleBasicAuthentication(
         return AUTH_FAIL;
     }
 
-    {   boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-        UserCredentialsCache::iterator user_cache_ptr(m_user_cache.find(credentials+'@'+domain));
-        if (user_cache_ptr!=m_user_cache.end()) {
+    {   std::string cached_username;
+        if (m_user_cache.find(credentials+'@'+domain, cached_username, time_now)) {
             DBGMSGAT("Found user in cache of authenticated users");
             // we found the credentials in our cache..., we can approve authorization now!
-            http_request->set_username(user_cache_ptr->second.second);
-            user_cache_ptr->second.first = time_now;
+            http_request->set_username(cached_username);
             return AUTH_OK;
         }
     }
@@ -81,10 +80,7 @@ ResourceAuth::auth_status_t ResourceAuth::handleBasicAuthentication(
     DBGMSGAT("User credentials supplied in HTTP request looks OK");
 
     // add user to the cache
-    {
-        boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-        m_user_cache.insert(std::make_pair(credentials + '@' + domain, std::make_pair(time_now, username)));
-    }
+    m_user_cache.insert(credentials + '@' + domain, username, time_now);
     // add user credentials to the request object
     http_request->set_username(username);
 
@@ -95,8 +91,46 @@ ResourceAuth::auth_status_t ResourceAuth::handleBasicAuthentication(
 
 void ResourceAuth::add_sent_nonce(std::string const& nonce)
 {
-    boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-    sent_nonce_time[nonce] = boost::posix_time::second_clock::universal_time();
+    m_nonce_cache.insert(nonce, true, boost::posix_time::second_clock::universal_time());
+}
+
+void ResourceAuth::startExpiry(boost::asio::io_service& io_service)
+{
+    boost::mutex::scoped_lock lock(m_timer_mutex);
+    m_stopped = false;
+    m_cleanup_timer.reset(new boost::asio::deadline_timer(io_service));
+    m_cleanup_timer->expires_from_now(boost::posix_time::seconds(long(CLEANUP_INTERVAL)));
+    m_cleanup_timer->async_wait(boost::bind(&ResourceAuth::expire, boost::weak_ptr<ResourceAuth>(shared_from_this()), _1));
+}
+
+void ResourceAuth::stopExpiry(void)
+{
+    {   boost::mutex::scoped_lock lock(m_timer_mutex);
+        m_stopped = true;
+        if (m_cleanup_timer) m_cleanup_timer->cancel();
+    }
+    ShardedCache<std::string>::stats_t const us(m_user_cache.stats());
+    ShardedCache<std::string>::stats_t const ss(m_secret_cache.stats());
+    ShardedCache<bool>::stats_t const ns(m_nonce_cache.stats());
+    LOGMSG("Authentication cache users: " << us.entries << " hits: " << us.hits << " misses: " << us.misses
+        << " evictions: " << us.evictions << ", digest users: " << ss.entries << " hits: " << ss.hits
+        << " misses: " << ss.misses << " evictions: " << ss.evictions << ", nonces: " << ns.entries << " hits: " << ns.hits
+        << " misses: " << ns.misses << " evictions: " << ns.evictions);
+}
+
+void ResourceAuth::expire(boost::weak_ptr<ResourceAuth> weak_self, boost::system::error_code const& ec)
+{
+    if (ec == boost::asio::error::operation_aborted) return;
+    boost::shared_ptr<ResourceAuth> self(weak_self.lock());
+    if (!self) return;
+    boost::posix_time::ptime const time_now(boost::posix_time::second_clock::universal_time());
+    self->m_user_cache.expire(time_now);
+    self->m_secret_cache.expire(time_now);
+    self->m_nonce_cache.expire(time_now);
+    boost::mutex::scoped_lock lock(self->m_timer_mutex);
+    if (self->m_stopped) return; //stopExpiry ran after this handler was queued
+    self->m_cleanup_timer->expires_from_now(boost::posix_time::seconds(long(CLEANUP_INTERVAL)));
+    self->m_cleanup_timer->async_wait(boost::bind(&ResourceAuth::expire, weak_self, _1));
 }
 
 
@@ -149,19 +183,6 @@ ResourceAuth::auth_status_t ResourceAuth::handleDigestAuthentication(
 		return AUTH_BAD;
 	}
 
-    {
-        boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-        //CHECK: This is not same as for Basic Authentication caching but i think it is consistent
-        UserCredentialsCache::iterator user_cache_ptr(m_user_cache.find(params.get_username()+'@'+domain));
-        if(user_cache_ptr!=m_user_cache.end()) {
-            DBGMSGAT("Found user in cache of authenticated users");
-            // we found the credentials in our cache..., we can approve authorization now!
-            http_request->set_username(user_cache_ptr->second.second);
-            user_cache_ptr->second.first = time_now;
-            return AUTH_OK;
-        }
-    }
-
 /* The authenticating server must assure that the resource designated by the "uri" directive is the
 same as the resource specified in the Request-Line; if they are not, the server SHOULD return a 400
 Bad Request error. (Since this may be a symptom of an attack, server implementers may want to
@@ -182,20 +203,22 @@ that calculated by the client.
     }
 
     {   //is nonce expired
-        std::map<std::string, boost::posix_time::ptime>::const_iterator itn(sent_nonce_time.find(params.get_nonce()));
-
-        if(itn == sent_nonce_time.end()
-           || time_now > itn->second + boost::posix_time::seconds(NONCE_EXPIRATION)) {
+        bool sent(false);
+        if(!m_nonce_cache.find(params.get_nonce(), sent, time_now)) {
             DBGMSGAT("Bad Digest credentials, received nonce already expired or unknown");
             return AUTH_FAIL;
         }
     }
 
-    // match username/password
+    // match username/password, only stored password is cached, response is checked for every request
 	std::string const usernameAtDomain(params.get_username() + '@' + domain);
     std::string stored_pass;
+    bool const cached(m_secret_cache.find(usernameAtDomain, stored_pass, time_now));
+    if (cached) {
+        DBGMSGAT("Found stored password in cache of authenticated users");
+    }
     //if(storage->user(stored_pass, params.get_username()+'@'+domain) != 0) {
-	if (!resolveUser(boost::ref(stored_pass), boost::cref(usernameAtDomain))) {
+	else if (!resolveUser(boost::ref(stored_pass), boost::cref(usernameAtDomain))) {
 		DBGMSGAT("Error in database");
         return AUTH_FAIL;
     }
@@ -213,11 +236,9 @@ that calculated by the client.
 
     DBGMSGAT("User credentials supplied in HTTP request looks OK");
 
-    // add user to the cache
-    {
-        boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-        m_user_cache.insert(std::make_pair(params.get_username() + '@' + domain, std::make_pair(time_now, params.get_username())));
-    }
+    // add stored password to the cache
+    if (!cached)
+        m_secret_cache.insert(usernameAtDomain, stored_pass, time_now);
 
     // add user credentials to the request object
     http_request->set_username(params.get_username());
@@ -231,29 +252,6 @@ that calculated by the client.
 ResourceAuth::auth_status_t ResourceAuth::handleAuthentication(ResolveUserFn resolveUser, http::MsgParserPtr http_request, std::string const& domain)
 {
 	boost::posix_time::ptime time_now(boost::posix_time::second_clock::universal_time());
-	if (time_now > m_cache_cleanup_time + boost::posix_time::seconds(CACHE_EXPIRATION)) {
-		// expire cache
-		boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-		UserCredentialsCache::iterator i;
-		UserCredentialsCache::iterator next=m_user_cache.begin();
-		while (next!=m_user_cache.end()) {
-			i=next;
-			++next;
-			if (time_now > i->second.first + boost::posix_time::seconds(CACHE_EXPIRATION))
-				m_user_cache.erase(i);// expire old record now
-		}
-
-		std::map<std::string, boost::posix_time::ptime>::iterator ittmp;
-		std::map<std::string, boost::posix_time::ptime>::iterator it(sent_nonce_time.begin());
-		while (it!=sent_nonce_time.end()) {
-			ittmp=it;
-			++it;
-			if(time_now > ittmp->second + boost::posix_time::seconds(NONCE_EXPIRATION))
-                sent_nonce_time.erase(ittmp);
-		}
-
-		m_cache_cleanup_time = time_now;
-	}
 
 	// if we are here, we need to check if access authorized...
 	std::string authorization(http_request->get_header(http::HTTPDefs::HEADER_AUTHORIZATION));
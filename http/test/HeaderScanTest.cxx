@@ -0,0 +1,61 @@
+/** Checks scan::find_char against scan::find_char_scalar at every alignment of the input, for
+ * lengths below and above the 16 byte SSE2 step, with the searched char at every position and
+ * missing. Standalone, build from the repository root with:
+ *   c++ -O2 -Ihttp/src http/test/HeaderScanTest.cxx -o HeaderScanTest
+ * @return 0 if all results match
+ */
+#include "HeaderScan.h"
+#include <iostream>
+#include <cstring>
+
+using scarlet::http::scan::find_char;
+using scarlet::http::scan::find_char_scalar;
+
+namespace {
+
+enum { MAX_ALIGN = 16, MAX_LENGTH = 80 };
+
+size_t check(char* buffer, size_t align, size_t length, char c)
+{
+    char const* const begin(buffer + align);
+    char const* const end(begin + length);
+    char const* const expected(find_char_scalar(begin, end, c));
+    char const* const found(find_char(begin, end, c));
+    if(found == expected) return 0;
+    std::cerr << "find_char(" << int(static_cast<unsigned char>(c)) << ") align "
+        << align << " length " << length << ": at " << (found - begin) << ", expected " << (expected - begin) << std::endl;
+    return 1;
+}
+
+}
+
+int main(void)
+{
+    char buffer[MAX_ALIGN + MAX_LENGTH + 16];
+    char const needles[] = { '\r', '\n', ':', '\x80' };
+    size_t failed(0), checked(0);
+    for(size_t align(0); align < MAX_ALIGN; ++align) {
+        for(size_t length(0); length <= MAX_LENGTH; ++length) {
+            for(size_t n(0); n < sizeof(needles); ++n) {
+                char const c(needles[n]);
+                // missing, but present right before begin and after end
+                std::memset(buffer, 'a', sizeof(buffer));
+                if(align) buffer[align - 1] = c;
+                buffer[align + length] = c;
+                failed += check(buffer, align, length, c);
+                ++checked;
+                for(size_t at(0); at < length; ++at) {
+                    // alone, and followed by another occurence
+                    std::memset(buffer, 'a', sizeof(buffer));
+                    buffer[align + at] = c;
+                    failed += check(buffer, align, length, c);
+                    buffer[align + length - 1] = c;
+                    failed += check(buffer, align, length, c);
+                    checked += 2;
+                }
+            }
+        }
+    }
+    std::cout << checked << " checks, " << failed << " failed" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <new>
+
+namespace scarlet {
+namespace net {
+
+class Arena;
+typedef boost::shared_ptr<Arena> ArenaPtr;///<Arena pointer
+
+/** Arena: per-connection memory for request/response lifecycle objects.
+ * Memory is taken from fixed size blocks by moving an offset. Each block counts its live
+ * allocations and goes back to a process wide free list as soon as the last one is freed, so
+ * an idle keep-alive connection holds no block and a busy one reuses pooled blocks without
+ * calling malloc. First block is taken on first allocation. Allocations over half of a block
+ * go to the heap.
+ */
+class Arena {
+	Arena(Arena const&) = delete;
+	void operator=(Arena const&) = delete;
+	struct block_t {
+		size_t used;///< offset of free space in data
+		size_t live;///< allocations not yet freed
+	};
+	/// precedes every allocation, null block means heap allocation
+	union header_t {
+		block_t*    block;
+		std::max_align_t align;
+	};
+	enum { MAX_POOLED_BLOCKS = 256 };///< empty blocks kept in process wide free list
+	/// block_t rounded up to keep allocations aligned
+	enum { BLOCK_PREFIX = (sizeof(block_t) + sizeof(header_t) - 1) / sizeof(header_t) * sizeof(header_t) };
+	block_t* take_block(void);
+	void release_block(block_t* b);
+	boost::mutex          m_mutex;
+	size_t const          m_block_size;
+	block_t*              m_current;///< null until first allocation and while arena is idle
+	explicit Arena(size_t block_size);
+public:
+	enum { DEFAULT_BLOCK_SIZE = 16384 };
+	~Arena();
+	static ArenaPtr create(size_t block_size = DEFAULT_BLOCK_SIZE)
+	{
+		return ArenaPtr(new Arena(block_size));
+	}
+	/// @return memory aligned for any type, throws std::bad_alloc
+	void* allocate(size_t n);
+	/// frees memory returned by allocate
+	void deallocate(void* p);
+};
+
+/// standard allocator on top of Arena, uses heap if arena is null
+template<class T>
+class ArenaAllocator {
+	template<class U> friend class ArenaAllocator;
+	ArenaPtr m_arena;
+public:
+	typedef T              value_type;
+	typedef T*             pointer;
+	typedef T const*       const_pointer;
+	typedef T&             reference;
+	typedef T const&       const_reference;
+	typedef std::size_t    size_type;
+	typedef std::ptrdiff_t difference_type;
+	template<class U> struct rebind { typedef ArenaAllocator<U> other; };
+
+	ArenaAllocator(void) : m_arena() { }
+	explicit ArenaAllocator(ArenaPtr const& arena) : m_arena(arena) { }
+	template<class U> ArenaAllocator(ArenaAllocator<U> const& other) : m_arena(other.m_arena) { }
+
+	pointer allocate(size_type n, void const* = 0)
+	{
+		void* const p(m_arena ? m_arena->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+		return static_cast<pointer>(p);
+	}
+	void deallocate(pointer p, size_type)
+	{
+		if(m_arena) m_arena->deallocate(p);
+		else ::operator delete(p);
+	}
+	void construct(pointer p, T const& v) { new(p) T(v); }
+	void destroy(pointer p) { p->~T(); }
+	size_type max_size(void) const { return size_type(-1) / sizeof(T); }
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+	template<class U> bool operator==(ArenaAllocator<U> const& other) const { return m_arena == other.m_arena; }
+	template<class U> bool operator!=(ArenaAllocator<U> const& other) const { return m_arena != other.m_arena; }
+};
+
+/// deleter for objects constructed with operator new(size_t, Arena&)
+template<class T>
+struct ArenaDeleter {
+	ArenaPtr arena;
+	explicit ArenaDeleter(ArenaPtr const& arena) : arena(arena) { }
+	void operator()(T* p) const
+	{
+		p->~T();
+		arena->deallocate(p);
+	}
+};
+
+/** takes ownership of p = new(*arena) T(...), shared_ptr control block is also taken from arena
+ * which is kept alive until the object is destroyed
+ */
+template<class T>
+boost::shared_ptr<T> arena_shared(ArenaPtr const& arena, T* p)
+{
+	return boost::shared_ptr<T>(p, ArenaDeleter<T>(arena), ArenaAllocator<T>(arena));
+}
+
+}
+}
+
+/// placement new into Arena, the matching delete is called if constructor throws
+inline void* operator new(std::size_t n, scarlet::net::Arena& arena) { return arena.allocate(n); }
+inline void operator delete(void* p, scarlet::net::Arena& arena) { arena.deallocate(p); }
+
+#endif // ARENA_H
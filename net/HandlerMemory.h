@@ -0,0 +1,93 @@
+#ifndef HANDLER_MEMORY_H
+#define HANDLER_MEMORY_H
+
+#include <boost/type_traits/aligned_storage.hpp>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace scarlet {
+namespace net {
+
+/** HandlerMemory: memory for the completion handler of one chain of asynchronous operations,
+ * like reads of a connection. Asio frees handler memory before it calls the handler, so the
+ * next operation started from the handler gets the same block again. If the block is in use or
+ * too small operator new is used, as asio would do without it.
+ */
+class HandlerMemory {
+	HandlerMemory(HandlerMemory const&) = delete;
+	void operator=(HandlerMemory const&) = delete;
+public:
+	enum { SIZE = 512 };
+	HandlerMemory(void) : m_storage(), m_in_use(false) { }
+	void* allocate(std::size_t size)
+	{
+		if (!m_in_use && size <= SIZE) {
+			m_in_use = true;
+			return m_storage.address();
+		}
+		return ::operator new(size);
+	}
+	void deallocate(void* pointer)
+	{
+		if (pointer == m_storage.address())
+			m_in_use = false;
+		else
+			::operator delete(pointer);
+	}
+private:
+	boost::aligned_storage<SIZE>::type m_storage;
+	bool                               m_in_use;
+};
+
+/// HandlerAllocator: allocator of handler memory for asio which looks up associated allocator
+template <typename T>
+class HandlerAllocator {
+	template <typename U> friend class HandlerAllocator;
+	HandlerMemory& m_memory;
+public:
+	typedef T value_type;
+	explicit HandlerAllocator(HandlerMemory& memory) : m_memory(memory) { }
+	template <typename U>
+	HandlerAllocator(HandlerAllocator<U> const& other) : m_memory(other.m_memory) { }
+	T* allocate(std::size_t n) const { return static_cast<T*>(m_memory.allocate(sizeof(T) * n)); }
+	void deallocate(T* pointer, std::size_t /*n*/) const { m_memory.deallocate(pointer); }
+	template <typename U>
+	bool operator==(HandlerAllocator<U> const& other) const { return &m_memory == &other.m_memory; }
+	template <typename U>
+	bool operator!=(HandlerAllocator<U> const& other) const { return &m_memory != &other.m_memory; }
+};
+
+/// AllocHandler: wraps a completion handler so asio allocates its operation in HandlerMemory
+template <typename Handler>
+class AllocHandler {
+public:
+	typedef HandlerAllocator<void> allocator_type;
+	AllocHandler(HandlerMemory& memory, Handler const& handler) : m_memory(memory), m_handler(handler) { }
+	allocator_type get_allocator(void) const { return allocator_type(m_memory); }
+	template <typename... Args>
+	void operator()(Args&&... args) { m_handler(std::forward<Args>(args)...); }
+	/// allocation hooks of asio versions without associated allocators
+	friend void* asio_handler_allocate(std::size_t size, AllocHandler<Handler>* this_handler)
+	{
+		return this_handler->m_memory.allocate(size);
+	}
+	friend void asio_handler_deallocate(void* pointer, std::size_t /*size*/, AllocHandler<Handler>* this_handler)
+	{
+		this_handler->m_memory.deallocate(pointer);
+	}
+private:
+	HandlerMemory& m_memory;
+	Handler        m_handler;
+};
+
+template <typename Handler>
+inline AllocHandler<Handler> makeAllocHandler(HandlerMemory& memory, Handler const& handler)
+{
+	return AllocHandler<Handler>(memory, handler);
+}
+
+}
+}
+
+#endif // HANDLER_MEMORY_H
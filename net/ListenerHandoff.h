@@ -0,0 +1,40 @@
+#ifndef LISTENER_HANDOFF_H
+#define LISTENER_HANDOFF_H
+
+#include <boost/asio/ip/tcp.hpp>
+#include <vector>
+
+namespace scarlet {
+namespace net {
+
+/** ListenerHandoff: passes bound listening sockets to a new process for restart without refusing
+ * connections. Running process starts its own executable again connected to it by a Unix socket
+ * named in environment, sends listening sockets over it (SCM_RIGHTS) and waits until the new
+ * process listens on them. Both processes accept until the old one closes its acceptors and
+ * drains its connections. Supported only on POSIX systems.
+ */
+class ListenerHandoff {
+public:
+	typedef boost::asio::ip::tcp::acceptor::native_handle_type Socket;
+	typedef std::vector<Socket> Sockets;
+	/// at most that many sockets are passed
+	enum { MAX_SOCKETS = 64 };
+	/// seconds the new process may take to start listening
+	enum { READY_TIMEOUT = 60 };
+	/** starts argv again in a new process and passes it sockets
+	 * @return true when the new process listens, false if it failed to start or was killed
+	 *         after READY_TIMEOUT, this process should then keep accepting
+	 */
+	static bool spawn(char* const argv[], Sockets const& sockets);
+	/// @return Unix socket from the process which started this one, -1 if started normally
+	static int inherited(void);
+	/// receives sockets passed by spawn(), empty on error
+	static Sockets receive(int channel);
+	/// tells the process which passed sockets that they are listening and closes channel
+	static void ready(int channel);
+};
+
+}
+}
+
+#endif // LISTENER_HANDOFF_H
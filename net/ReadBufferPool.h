@@ -0,0 +1,34 @@
+#ifndef READ_BUFFER_POOL_H
+#define READ_BUFFER_POOL_H
+
+#include <cstddef>
+
+namespace scarlet {
+namespace net {
+
+/** ReadBufferPool: read buffers of TCPConnection::READ_BUFFER_SIZE bytes kept in a free list per
+ * thread, so borrowing and returning a buffer takes no lock. Connection borrows a buffer only
+ * while it reads or keeps pipelined bytes, idle keep-alive connections hold none. Buffer may be
+ * returned in another thread than it was borrowed in, it then moves to that thread's free list.
+ */
+class ReadBufferPool {
+public:
+	enum { BUFFER_SIZE = 8192 };
+	/// free buffers kept per thread, more returned buffers are freed
+	enum { MAX_FREE_PER_THREAD = 64 };
+	struct stats_t {
+		size_t in_use;///< buffers borrowed by connections
+		size_t peak_in_use;
+		size_t allocated;///< buffers in use and in free lists
+	};
+	/// @return buffer of BUFFER_SIZE bytes, throws std::bad_alloc
+	static char* acquire(void);
+	/// returns buffer from acquire() to the pool of the calling thread
+	static void release(char* buffer);
+	static stats_t stats(void);
+};
+
+}
+}
+
+#endif // READ_BUFFER_POOL_H
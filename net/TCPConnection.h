@@ -2,10 +2,13 @@
 #define TCP_CONNECTION_H
 
 #include <boost/noncopyable.hpp>
-#include <boost/array.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <scarlet/net/Arena.h>
+#include <scarlet/net/TimingWheel.h>
+#include <scarlet/net/ReadBufferPool.h>
+#include <scarlet/net/HandlerMemory.h>
 #include <bmu/Logger.h>
 
 namespace scarlet {
@@ -17,6 +20,21 @@ typedef boost::shared_ptr<IOSvcScheduler> IOSvcSchedulerPtr;///<IOSvcScheduler p
 class TCPConnection;
 typedef boost::shared_ptr<TCPConnection> TCPConnectionPtr;///<TCPConnection pointer
 
+/** InFlightRequest: request counted against the in-flight limit of the server from
+ * TCPConnection::beginRequest() until end() or destruction, so a response which is never sent
+ * doesn't hold its slot forever.
+ */
+class InFlightRequest : private boost::noncopyable {
+public:
+	explicit InFlightRequest(IOSvcSchedulerPtr const& scheduler) : m_scheduler(scheduler) { }
+	~InFlightRequest() { end(); }
+	/// stops counting the request, later calls do nothing
+	void end(void);
+private:
+	IOSvcSchedulerPtr m_scheduler;///< null once ended
+};
+typedef boost::shared_ptr<InFlightRequest> InFlightRequestPtr;///<InFlightRequest pointer
+
 /// TCPConnection: represents a single tcp connection
 class TCPConnection : private boost::noncopyable {
 public:
@@ -26,20 +44,25 @@ public:
 		LIFECYCLE_KEEPALIVE,
 		LIFECYCLE_PIPELINED,
 	};
-	enum { READ_BUFFER_SIZE = 8192 };///< size of the read buffer
-    typedef boost::array<char, READ_BUFFER_SIZE>	ReadBuffer;///< I/O read buffer
+	enum { READ_BUFFER_SIZE = ReadBufferPool::BUFFER_SIZE };///< size of the read buffer
 	typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> SSLSocket;///< SSL socket connection
 	typedef boost::asio::ssl::context						       SSLContext;///< SSL configuration context
 private:
 	/// data type for a read position bookmark
 	typedef std::pair<const char*, std::size_t> ReadPosition;
 	IOSvcSchedulerPtr m_scheduler;
+	HandlerMemory     m_read_memory;///< handlers of accept, handshake and reads, declared before the socket using it
+	HandlerMemory     m_write_memory;///< handlers of writes, a write may be pending together with a read
 	SSLSocket         m_ssl_socket;///< SSL connection socket
 	bool              m_ssl_flag;///< true if the connection is encrypted using SSL
-	ReadBuffer        m_read_buffer;///< buffer used for reading data from the TCP connection
+	char*             m_read_buffer;///< borrowed from ReadBufferPool while reading, null while idle
+	char              m_ssl_first;///< first decrypted byte read by idle SSL connection
 	ReadPosition      m_read_position;///< saved read position bookmark
 	LifecycleType     m_lifecycle;///< lifecycle state for the connection
 	bool              m_sending;///< is the connection currently used for sending data
+	bool              m_clean;///< last response was sent and no request is being read, SSL session may be resumed
+	ArenaPtr          m_arena;///< memory for objects of requests on this connection
+	TimingWheel::Entry m_deadline;///< closes the connection, in the timing wheel of m_scheduler
 	TCPConnection(IOSvcSchedulerPtr scheduler, const bool ssl_flag);
 public:
 	~TCPConnection();
@@ -60,7 +83,7 @@ public:
 	template <typename AcceptHandler>
 	void async_accept(boost::asio::ip::tcp::acceptor& tcp_acceptor, AcceptHandler handler)
 	{
-		tcp_acceptor.async_accept(m_ssl_socket.lowest_layer(), handler);
+		tcp_acceptor.async_accept(m_ssl_socket.lowest_layer(), makeAllocHandler(m_read_memory, handler));
 	}
 	/** asynchronously performs server-side SSL handshake for a new connection
 	 * @param handler called after the ssl handshake has completed
@@ -69,40 +92,75 @@ public:
 	template <typename SSLHandshakeHandler>
 	void async_handshake_server(SSLHandshakeHandler handler)
 	{
-		m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::server, handler);
+		m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::server, makeAllocHandler(m_read_memory, handler));
 	}
-	/** asynchronously reads some data into the connection's read buffer
+	/** asynchronously reads some data into the connection's read buffer, borrows the buffer if
+	 * the connection has none. Plain connection without a buffer first waits until the socket is
+	 * readable, so a connection idle between requests holds no buffer. SSL connection without a
+	 * buffer waits for one decrypted byte instead, data may be waiting inside the SSL stream while
+	 * the socket is not readable, the rest of the decrypted record is then read into borrowed buffer.
+	 * Handler memory of the connection is reused by every read.
 	 * @param handler called after the read operation has completed
 	 * @see boost::asio::basic_stream_socket::async_read_some()
 	 */
 	template <typename ReadHandler>
 	void async_read_some(ReadHandler handler) {
-		if(m_ssl_flag)
-			m_ssl_socket.async_read_some(boost::asio::buffer(m_read_buffer), handler);
-		else
-			m_ssl_socket.next_layer().async_read_some(boost::asio::buffer(m_read_buffer), handler);
+		if(m_ssl_flag && m_read_buffer) {
+			m_ssl_socket.async_read_some(boost::asio::buffer(m_read_buffer, READ_BUFFER_SIZE)
+				, makeAllocHandler(m_read_memory, handler));
+		} else if(m_ssl_flag) {
+			m_ssl_socket.async_read_some(boost::asio::buffer(&m_ssl_first, 1)
+				, makeAllocHandler(m_read_memory, [this, handler](boost::system::error_code const& ec, std::size_t bytes_read) mutable {
+					if (ec || !bytes_read) {
+						handler(ec, 0);
+						return;
+					}
+					handler(ec, readPending());
+				}));
+		} else if (m_read_buffer) {
+			m_ssl_socket.next_layer().async_read_some(boost::asio::buffer(m_read_buffer, READ_BUFFER_SIZE)
+				, makeAllocHandler(m_read_memory, handler));
+		} else {
+			m_ssl_socket.next_layer().async_read_some(boost::asio::null_buffers()
+				, makeAllocHandler(m_read_memory, [this, handler](boost::system::error_code const& ec, std::size_t) mutable {
+					if (ec) {
+						handler(ec, 0);
+						return;
+					}
+					boost::system::error_code read_ec;
+					std::size_t const bytes_read(readReady(read_ec));
+					if (read_ec == boost::asio::error::would_block)
+						async_read_some(handler); // spurious readiness, wait again without buffer
+					else
+						handler(read_ec, bytes_read);
+				}));
+		}
 	}
 	/** asynchronously writes data to the connection
 	 * @param buffers one or more buffers containing the data to be written
-	 * @param handler called after the data has been written
+	 * @param handler called after the data has been written, its memory is reused by every write
 	 * @see boost::asio::async_write()
 	 */
 	template <typename ConstBufferSequence, typename WriteHandler>
 	void async_write(const ConstBufferSequence& buffers, WriteHandler handler)
 	{
 		if (m_ssl_flag)
-			boost::asio::async_write(m_ssl_socket, buffers, handler);
+			boost::asio::async_write(m_ssl_socket, buffers, makeAllocHandler(m_write_memory, handler));
 		else
-			boost::asio::async_write(m_ssl_socket.next_layer(), buffers, handler);
+			boost::asio::async_write(m_ssl_socket.next_layer(), buffers, makeAllocHandler(m_write_memory, handler));
 	}
 	void setLifecycle(LifecycleType t) { m_lifecycle = t; }
 	LifecycleType getLifecycle(void) const { return m_lifecycle; }
 	void setSendingState(bool sending) { m_sending = sending; }
+	/// true after a response was completely sent, false while a request is read or after an error
+	void setCleanClose(bool clean) { m_clean = clean; }
 	bool getKeepAlive(void) const { return m_lifecycle != LIFECYCLE_CLOSE; }
 	bool getPipelined(void) const { return m_lifecycle == LIFECYCLE_PIPELINED; }
 	bool getSendingState(void) const { return m_sending; }
-	/// returns the buffer used for reading data from the TCP connection
-	ReadBuffer& getReadBuffer(void) { return m_read_buffer; }
+	/// returns the buffer used for reading data from the TCP connection, null if none is borrowed
+	char const* getReadBuffer(void) const { return m_read_buffer; }
+	/// returns the read buffer to the pool, only when no read is pending and no pipelined bytes are saved
+	void releaseReadBuffer(void);
 	/** @param read_ptr points to the next character to be consumed in the read_buffer
 	 * @param remaining bytes from read_ptr to the end of the read_buffer (last byte + 1)
 	 */
@@ -121,6 +179,9 @@ public:
 	/// closes the tcp socket and cancels any pending asynchronous operations
 	void close(void) { 
 		DBGMSGAT(" closing this connection is_open() = " << is_open());
+		// without close_notify OpenSSL drops the session from the cache as if the connection failed,
+		// which is kept for aborted, timed-out and failed connections
+		if(m_ssl_flag && m_clean) SSL_set_shutdown(m_ssl_socket.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
 		if(is_open()) m_ssl_socket.lowest_layer().close(); 
 	}
 	/// returns an ASIO endpoint for the client connection
@@ -133,9 +194,29 @@ public:
 		return boost::asio::ip::tcp::endpoint();
 	}
 	boost::asio::ip::address getRemoteIp(void) const { return getRemoteEndpoint().address(); }
+	/// returns true if the SSL handshake resumed a cached session or a session ticket
+	bool getSSLSessionReused(void) { return m_ssl_flag && SSL_session_reused(m_ssl_socket.native_handle()) != 0; }
 	unsigned short getRemotePort(void) const { return getRemoteEndpoint().port(); }
+	/** closes the connection if not canceled or set again within seconds, pending operations
+	 * then complete with operation_aborted
+	 * @param seconds 0 cancels the deadline
+	 */
+	void setDeadline(boost::uint32_t seconds);
+	void cancelDeadline(void);
+	/** counts a request against the in-flight limit of the server
+	 * @return null if the limit is reached, otherwise the request counts until it is ended or destroyed
+	 */
+	InFlightRequestPtr beginRequest(void);
 	boost::asio::io_service& getIOService(void) { return m_ssl_socket.lowest_layer().get_io_service(); }
 	IOSvcSchedulerPtr getScheduler(void) const { return m_scheduler; }
+	/// memory for request/response objects, recycled when they are destroyed
+	ArenaPtr const& getArena(void) const { return m_arena; }
+private:
+	void borrowReadBuffer(void) { if (!m_read_buffer) m_read_buffer = ReadBufferPool::acquire(); }
+	/// reads from readable plain socket into borrowed buffer without blocking
+	std::size_t readReady(boost::system::error_code& ec);
+	/// moves m_ssl_first and the rest of decrypted SSL record into borrowed buffer, doesn't touch the socket
+	std::size_t readPending(void);
 };
 
 }
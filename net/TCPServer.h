@@ -2,15 +2,17 @@
 #define TCP_SERVER_H
 
 #include <scarlet/net/TCPConnection.h>
+#include <scarlet/net/ListenerHandoff.h>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
-#include <set>
 
 namespace scarlet {
 namespace net {
 
 class IOSvcSchedulerGroup;
 typedef boost::shared_ptr<IOSvcSchedulerGroup> IOSvcSchedulerGroupPtr;///<IOSvcSchedulerGroup pointer
+class TLSSessionCache;
+typedef boost::shared_ptr<TLSSessionCache> TLSSessionCachePtr;///<TLSSessionCache pointer
 
 /// TCPServer: a multi-threaded, asynchronous TCP server
 class TCPServer : private boost::noncopyable {
@@ -29,6 +31,12 @@ public:
 	 * @param pem_key_file name of the file containing a PEM-encoded private key
 	 */
 	void setSSLKeyFile(const std::string& pem_key_file);
+	/** enables resumption of SSL sessions shared by all IO services, must be called before start()
+	 * @param max_sessions sessions cached by the server, 0 leaves only session tickets
+	 * @param lifetime seconds a session can be resumed, ticket keys are replaced as often,
+	 *        0 disables resumption
+	 */
+	void setSSLSessions(size_t max_sessions, long lifetime);
 	/// returns tcp endpoint that the server listens for connections on
 	inline const boost::asio::ip::tcp::endpoint& getEndpoint(void) const { return m_endpoint; }
 	/// returns true if the server uses SSL to encrypt connections
@@ -37,12 +45,31 @@ public:
 	inline void setSSLFlag(bool b = true) { m_ssl_flag = b; }
 	/// returns true if the server is listening for connections
 	inline bool isListening(void) const { return m_is_listening; }
+	/** sets limits of the whole server, counted across all IO services, 0 is unlimited.
+	 * Must be called before start().
+	 * @param max_connections accepted connections, accepts pause when it is reached, accept already
+	 *        pending on other IO services may still add one connection each
+	 * @param max_per_ip accepted connections from one client address, more are closed at once
+	 * @param max_requests requests in flight, more are rejected
+	 */
+	void setLimits(size_t max_connections, size_t max_per_ip, size_t max_requests);
+	/** listens on sockets already bound by a previous process instead of binding new ones, IO
+	 * services beyond their count bind their own, sockets beyond the count of IO services get
+	 * additional listeners on the IO services in turn, so connections queued in them are still
+	 * accepted. Endpoint of the adopted sockets replaces the configured one, with a warning if
+	 * they differ. Must be called before start().
+	 */
+	void adoptListeningSockets(ListenerHandoff::Sockets const& sockets) { m_adopted = sockets; }
+	/// returns listening sockets of all IO services including adopted additional ones, to be passed to a new process
+	ListenerHandoff::Sockets getListeningSockets(void);
 protected:
 	/** protected constructor so that only derived objects may be created
-	 * @param scheduler the WorkScheduler that will be used to manage worker threads
 	 * @param endpoint TCP endpoint used to listen for new connections (see ASIO docs)
+	 * @param concurency number of IO services, each with its own acceptor
+	 * @param count_of_worker_threads number of threads running each IO service
+	 * @param pin_threads if true threads of each IO service are pinned to one CPU
 	 */
-	TCPServer(boost::asio::ip::tcp::endpoint const& endpoint, size_t concurency, size_t count_of_worker_threads);
+	TCPServer(boost::asio::ip::tcp::endpoint const& endpoint, size_t concurency, size_t count_of_worker_threads, bool pin_threads = false);
 	/** handles a new TCP connection; derived classes SHOULD override this
 	 * since the default behavior does nothing
 	 * @param tcp_conn the new TCP connection to handle
@@ -55,42 +82,45 @@ protected:
 	virtual void beforeStarting(void) {}
 	/// called after the TCP server has stopped listing for new connections
 	virtual void afterStopping(void) {}
+	/// returns IO service of the first scheduler, for server wide timers
+	boost::asio::io_service& getIOService(void);
 protected:
 	/// This will be called by TCPConnection::finish() after a server has
 	/// finished handling a connection.  If the keep_alive flag is true,
 	/// it will call handleConnection(); otherwise, it will close the
-	/// connection and remove it from the server's management pool
+	/// connection and remove it from its scheduler's registry
 	void finishConnection(TCPConnectionPtr tcp_conn);
 private:
 	/// handles a request to stop the server
 	void handleStopRequest(void);
-	/// listens for a new connection
-	void listen(IOSvcSchedulerPtr scheduler);
+	/// listens for a new connection on the listener of the scheduler's registry
+	void listen(IOSvcSchedulerPtr scheduler, size_t listener);
 	/** handles new connections (checks if there was an accept error)
 	 * @param tcp_conn the new TCP connection (if no error occurred)
+	 * @param listener index of the listener in the scheduler's registry which accepted it
 	 * @param accept_error true if an error occurred while accepting connections
 	 */
-	void handleAccept(TCPConnectionPtr tcp_conn, boost::system::error_code const& accept_error);
+	void handleAccept(TCPConnectionPtr tcp_conn, size_t listener, boost::system::error_code const& accept_error);
 	/** handles new connections following an SSL handshake (checks for errors)
 	 * @param tcp_conn the new TCP connection (if no error occurred)
 	 * @param handshake_error true if an error occurred during the SSL handshake
 	 */
 	void handleSSLHandshake(TCPConnectionPtr tcp_conn, boost::system::error_code const& handshake_error);
     /// prunes orphaned connections that did not close cleanly
-    /// and returns the remaining number of connections in the pool
+    /// and returns the remaining number of connections of all schedulers
     std::size_t pruneConnections(void);
-	/// data type for a pool of TCP connections
-	typedef std::set<TCPConnectionPtr>		ConnectionPool;
+	/// resumable SSL sessions, referenced by SSL contexts so it is destroyed after them
+	TLSSessionCachePtr                      m_tls_sessions;
 	/// reference to the active WorkScheduler object used to manage worker threads
 	IOSvcSchedulerGroupPtr                  m_asio_scheduler_group;
 	/// condition triggered when the server has stopped listening for connections
 	boost::condition						m_server_has_stopped;
-	/// condition triggered when the connection pool is empty
+	/// condition triggered when a connection is closed while stopping
 	boost::condition						m_no_more_connections;
-	/// pool of active connections associated with this server
-	ConnectionPool							m_conn_pool;
 	/// tcp endpoint used to listen for new connections
 	boost::asio::ip::tcp::endpoint			m_endpoint;
+	/// listening sockets from a previous process, used by start()
+	ListenerHandoff::Sockets				m_adopted;
 	/// true if the server uses SSL to encrypt connections
 	bool									m_ssl_flag;
 	/// set to true when the server is listening for new connections
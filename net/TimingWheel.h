@@ -0,0 +1,69 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+#include <cassert>
+
+namespace scarlet {
+namespace net {
+
+/** TimingWheel: hashed timing wheel for timeouts of all connections on one IO service. A single
+ * deadline_timer ticks TICKS_PER_SECOND times per second, each tick visits one slot of the wheel
+ * and fires entries whose rounds have run out. Entries are linked into slots in place, so
+ * scheduling, rescheduling and canceling are O(1) and never allocate, unlike an asio timer per
+ * read which inserts into and removes from the timer queue every time.
+ * Timeouts fire up to one tick late, never early.
+ */
+class TimingWheel {
+	TimingWheel(TimingWheel const&) = delete;
+	void operator=(TimingWheel const&) = delete;
+public:
+	enum { SLOTS = 256 };
+	enum { TICKS_PER_SECOND = 4 };
+	/** Entry: timeout embedded in its owner. Owner must cancel it before being destroyed, the
+	 * expire function is called from an IO thread with the wheel locked, so it must not block
+	 * and must not use the wheel.
+	 */
+	class Entry {
+		Entry(Entry const&) = delete;
+		void operator=(Entry const&) = delete;
+		friend class TimingWheel;
+		Entry*                   m_prev;///< null if not scheduled
+		Entry*                   m_next;
+		boost::uint32_t          m_rounds;///< full turns of the wheel left before expiry
+		boost::function<void()>  m_expire;
+	public:
+		explicit Entry(boost::function<void()> const& expire = boost::function<void()>()) : m_prev(0), m_next(0), m_rounds(0), m_expire(expire) { }
+		~Entry() { assert(!m_prev); }
+	};
+	TimingWheel(boost::asio::io_service& io_service);
+	~TimingWheel();
+	/// starts ticking, expires nothing until started
+	void start(void);
+	/// stops ticking, scheduled entries stay linked until canceled
+	void stop(void);
+	/// (re)schedules entry to expire after seconds, 0 cancels it
+	void schedule(Entry& entry, boost::uint32_t seconds);
+	/// cancels entry if it is scheduled
+	void cancel(Entry& entry);
+private:
+	void armTick(void);
+	void handleTick(boost::system::error_code const& ec);
+	/// assumes that the wheel lock has already been acquired
+	static void unlink(Entry& entry);
+	boost::mutex                m_mutex;
+	Entry                       m_slots[SLOTS];///< list heads, circular lists
+	size_t                      m_current;///< slot visited by the last tick
+	bool                        m_ticking;
+	boost::asio::deadline_timer m_timer;
+	boost::posix_time::ptime    m_next_tick;///< absolute so ticks don't drift
+};
+
+}
+}
+
+#endif // TIMING_WHEEL_H
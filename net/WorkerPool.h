@@ -0,0 +1,59 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace scarlet {
+namespace net {
+
+/// WorkerPool: bounded pool of threads for blocking work (storage, XML processing) which must not run in IO threads
+class WorkerPool {
+	WorkerPool(WorkerPool const&) = delete;
+	void operator=(WorkerPool const&) = delete;
+public:
+	/// default maximum number of jobs waiting or running in the pool
+	enum { DEFAULT_MAX_PENDING = 1024 };
+	/** constructs a new WorkerPool
+	 * @param num_threads number of worker threads
+	 * @param max_pending jobs over this count are refused by post()
+	 */
+	WorkerPool(size_t num_threads, size_t max_pending = DEFAULT_MAX_PENDING);
+	/// virtual destructor
+	virtual ~WorkerPool();
+
+	/// starts the worker threads
+	void start(void);
+	/// stops the worker threads, jobs still waiting in the queue are dropped
+	void stop(void);
+
+	/** schedules job to be executed by one of the worker threads
+	 * @return false if the pool is full or not running, job is then not scheduled
+	 */
+	bool post(boost::function<void(void)> const& job);
+
+	/// returns number of jobs waiting or running in the pool
+	size_t pending(void) const;
+private:
+	/// executes one job and releases its place in the queue
+	void execute(boost::function<void(void)> const& job);
+	/// processes jobs passed to the asio service & handles uncaught exceptions
+	void processWork(void);
+	mutable boost::mutex             m_mutex; ///< mutex to make class thread-safe
+	std::vector<boost::shared_ptr<boost::thread> > m_thread_pool; ///< worker threads
+	boost::asio::io_service          m_service; ///< job queue
+	boost::shared_ptr<boost::asio::io_service::work> m_work;
+	size_t const                     m_max_pending;
+	size_t                           m_pending;
+};
+
+typedef boost::shared_ptr<WorkerPool> WorkerPoolPtr;
+
+}
+}
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,114 @@
+#include "scarlet/net/Arena.h"
+#include <cstdlib>
+#include <vector>
+
+namespace scarlet {
+namespace net {
+
+namespace {
+/// empty blocks of DEFAULT_BLOCK_SIZE shared by arenas of all connections
+struct BlockPool {
+	boost::mutex       mutex;
+	std::vector<void*> free;
+	~BlockPool()
+	{
+		for (size_t i = 0; i < free.size(); ++i)
+			std::free(free[i]);
+	}
+};
+
+BlockPool& block_pool(void)
+{
+	static BlockPool pool;
+	return pool;
+}
+}
+
+Arena::Arena(size_t block_size)
+	: m_mutex()
+	, m_block_size(block_size)
+	, m_current(0)
+{ }
+
+Arena::~Arena()
+{
+	// live allocations keep arena alive, so only an empty current block can be left
+	if (m_current)
+		release_block(m_current);
+}
+
+Arena::block_t* Arena::take_block(void)
+{
+	block_t* b(0);
+	if (m_block_size == DEFAULT_BLOCK_SIZE) {
+		BlockPool& pool(block_pool());
+		boost::mutex::scoped_lock lock(pool.mutex);
+		if (!pool.free.empty()) {
+			b = static_cast<block_t*>(pool.free.back());
+			pool.free.pop_back();
+		}
+	}
+	if (!b) {
+		b = static_cast<block_t*>(std::malloc(BLOCK_PREFIX + m_block_size));
+		if (!b) throw std::bad_alloc();
+	}
+	b->used = 0;
+	b->live = 0;
+	return b;
+}
+
+void Arena::release_block(block_t* b)
+{
+	if (m_block_size == DEFAULT_BLOCK_SIZE) {
+		BlockPool& pool(block_pool());
+		boost::mutex::scoped_lock lock(pool.mutex);
+		if (pool.free.size() < MAX_POOLED_BLOCKS) {
+			if (pool.free.capacity() == 0)
+				pool.free.reserve(MAX_POOLED_BLOCKS);
+			pool.free.push_back(b);
+			return;
+		}
+	}
+	std::free(b);
+}
+
+void* Arena::allocate(size_t n)
+{
+	size_t const total((sizeof(header_t) + n + sizeof(header_t) - 1) / sizeof(header_t) * sizeof(header_t));
+	if (total > m_block_size / 2) {
+		header_t* const h(static_cast<header_t*>(std::malloc(total)));
+		if (!h) throw std::bad_alloc();
+		h->block = 0;
+		return h + 1;
+	}
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (!m_current || m_current->used + total > m_block_size) {
+		// full block stays with its live allocations, it is released when they are freed
+		m_current = take_block();
+	}
+	header_t* const h(reinterpret_cast<header_t*>(reinterpret_cast<char*>(m_current) + BLOCK_PREFIX + m_current->used));
+	h->block = m_current;
+	m_current->used += total;
+	++m_current->live;
+	return h + 1;
+}
+
+void Arena::deallocate(void* p)
+{
+	if (!p) return;
+	header_t* const h(static_cast<header_t*>(p) - 1);
+	block_t* const b(h->block);
+	if (!b) {
+		std::free(h);
+		return;
+	}
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (--b->live) return;
+	// request is done with this block, idle connection keeps none
+	if (b == m_current)
+		m_current = 0;
+	release_block(b);
+}
+
+}
+}
@@ -0,0 +1,277 @@
+#include "ConnectionRegistry.h"
+#include <boost/bind.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/make_shared.hpp>
+
+namespace scarlet {
+namespace net {
+
+ConnectionLimits::ConnectionLimits(void)
+	: m_connections(0)
+	, m_requests(0)
+	, m_max_connections(0)
+	, m_max_per_ip(0)
+	, m_max_requests(0)
+	, m_resume()
+{
+}
+
+void ConnectionLimits::set(size_t max_connections, size_t max_per_ip, size_t max_requests)
+{
+	m_max_connections = max_connections;
+	m_max_per_ip = max_per_ip;
+	m_max_requests = max_requests;
+}
+
+ConnectionLimits::shard_t& ConnectionLimits::shard(boost::asio::ip::address const& ip)
+{
+	size_t h(0);
+	if (ip.is_v4()) {
+		h = ip.to_v4().to_ulong();
+	} else {
+		boost::asio::ip::address_v6::bytes_type const bytes(ip.to_v6().to_bytes());
+		for (size_t i(0); i < bytes.size(); ++i)
+			h = h * 31 + bytes[i];
+	}
+	return m_shards[h % SHARDS];
+}
+
+bool ConnectionLimits::admit(boost::asio::ip::address const& ip)
+{
+	shard_t& s(shard(ip));
+	boost::mutex::scoped_lock shard_lock(s.mutex);
+	std::map<boost::asio::ip::address, size_t>::iterator const ip_it(s.per_ip.find(ip));
+	if (m_max_per_ip > 0 && ip_it != s.per_ip.end() && ip_it->second >= m_max_per_ip)
+		return false;
+	if (ip_it == s.per_ip.end())
+		s.per_ip.insert(std::make_pair(ip, size_t(1)));
+	else
+		++ip_it->second;
+	++m_connections;
+	return true;
+}
+
+void ConnectionLimits::release(boost::asio::ip::address const& ip)
+{
+	{
+		shard_t& s(shard(ip));
+		boost::mutex::scoped_lock shard_lock(s.mutex);
+		std::map<boost::asio::ip::address, size_t>::iterator const ip_it(s.per_ip.find(ip));
+		if (--ip_it->second == 0) s.per_ip.erase(ip_it);
+	}
+	// exactly one release reaches the mark, accept may be paused on any IO service
+	size_t const n(--m_connections);
+	if (m_max_connections > 0 && n == m_max_connections * LOW_WATER_PERCENT / 100) {
+		for (size_t i(0); i < m_resume.size(); ++i)
+			m_resume[i]();
+	}
+}
+
+bool ConnectionLimits::beginRequest(void)
+{
+	size_t const n(++m_requests);
+	if (m_max_requests == 0 || n <= m_max_requests) return true;
+	--m_requests;
+	return false;
+}
+
+ConnectionRegistry::ConnectionRegistry(boost::asio::io_service& io_service, boost::asio::ip::tcp::acceptor& acceptor
+	, ConnectionLimitsPtr const& limits)
+	: m_mutex()
+	, m_io_service(io_service)
+	, m_acceptors(1, &acceptor)
+	, m_added()
+	, m_limits(limits)
+	, m_connections()
+	, m_accepted()
+	, m_admitted(0)
+	, m_paused(1)
+	, m_accept_pauses(0)
+	, m_refused(0)
+	, m_rejected(0)
+	, m_open(false)
+	, m_sweeping(false)
+	, m_sweep_timer(io_service)
+{
+	m_limits->onResume(boost::bind(&ConnectionRegistry::handleLowWater, this));
+}
+
+boost::asio::ip::tcp::acceptor& ConnectionRegistry::addAcceptor(void)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	m_added.push_back(boost::make_shared<boost::asio::ip::tcp::acceptor>(m_io_service));
+	m_acceptors.push_back(m_added.back().get());
+	m_paused.resize(m_acceptors.size());
+	return *m_acceptors.back();
+}
+
+size_t ConnectionRegistry::listeners(void) const
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	return m_acceptors.size();
+}
+
+void ConnectionRegistry::open(AcceptHandler const& handler)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	m_accepted = handler;
+	m_open = true;
+}
+
+void ConnectionRegistry::close(void)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	m_open = false;
+	for (size_t i(0); i < m_paused.size(); ++i) {
+		if (m_paused[i])
+			m_connections.erase(m_paused[i]);
+	}
+	// under lock because accept() may be just starting async_accept on them
+	boost::system::error_code ec;
+	for (size_t i(0); i < m_acceptors.size(); ++i)
+		m_acceptors[i]->close(ec);
+	// a restarted server binds only the acceptor of the IO service
+	m_acceptors.resize(1);
+	m_paused.assign(1, TCPConnectionPtr());
+}
+
+bool ConnectionRegistry::accept(TCPConnectionPtr const& tcp_conn, size_t listener)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	if (!m_open || listener >= m_acceptors.size()) return false;
+	m_connections.insert(ConnectionSet::value_type(tcp_conn, boost::asio::ip::address()));
+	if (m_limits->full()) {
+		// backlog of the listening socket holds new clients until connections drop
+		WARNCLOG("Too many connections (" << m_limits->connections() << "), pausing accept");
+		++m_accept_pauses;
+		m_paused[listener] = tcp_conn;
+		return true;
+	}
+	startAccept(tcp_conn, listener);
+	return true;
+}
+
+void ConnectionRegistry::startAccept(TCPConnectionPtr const& tcp_conn, size_t listener)
+{
+	tcp_conn->async_accept(*m_acceptors[listener]
+		, boost::bind(&ConnectionRegistry::handleAccept, this, tcp_conn, listener, boost::asio::placeholders::error));
+}
+
+bool ConnectionRegistry::admit(TCPConnectionPtr const& tcp_conn)
+{
+	boost::asio::ip::address const ip(tcp_conn->getRemoteIp());
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	ConnectionSet::iterator const it(m_connections.find(tcp_conn));
+	if (it == m_connections.end()) return false; // pruned meanwhile
+	if (!m_limits->admit(ip)) {
+		++m_refused;
+		return false;
+	}
+	++m_admitted;
+	it->second = ip;
+	return true;
+}
+
+ConnectionRegistry::ConnectionSet::iterator ConnectionRegistry::erase(ConnectionSet::iterator it)
+{
+	if (!it->second.is_unspecified()) {
+		--m_admitted;
+		m_limits->release(it->second);
+	}
+	return m_connections.erase(it);
+}
+
+void ConnectionRegistry::resumeAccept(void)
+{
+	if (!m_limits->lowWater()) return;
+	for (size_t i(0); i < m_paused.size(); ++i) {
+		if (!m_paused[i]) continue;
+		DBGMSGAT("Resuming accept at " << m_limits->connections() << " connections");
+		startAccept(m_paused[i], i);
+		m_paused[i].reset();
+	}
+}
+
+void ConnectionRegistry::handleLowWater(void)
+{
+	// may be called with a lock of another registry, so only posts
+	m_io_service.post(boost::bind(&ConnectionRegistry::handleResume, this));
+}
+
+void ConnectionRegistry::handleResume(void)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	resumeAccept();
+}
+
+void ConnectionRegistry::remove(TCPConnectionPtr const& tcp_conn)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	ConnectionSet::iterator const it(m_connections.find(tcp_conn));
+	if (it == m_connections.end()) return;
+	erase(it);
+	resumeAccept();
+}
+
+bool ConnectionRegistry::beginRequest(void)
+{
+	if (m_limits->beginRequest()) return true;
+	++m_rejected;
+	return false;
+}
+
+ConnectionRegistry::stats_t ConnectionRegistry::stats(void) const
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	stats_t const st = { m_admitted, m_limits->requests(), m_accept_pauses, m_refused, m_rejected };
+	return st;
+}
+
+size_t ConnectionRegistry::prune(void)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	for (ConnectionSet::iterator it(m_connections.begin()); it != m_connections.end(); ) {
+		if (it->first.unique()) {
+			WARNCLOG("Closing orphaned connection");
+			it->first->close();
+			it = erase(it);
+		} else {
+			++it;
+		}
+	}
+	resumeAccept();
+	return m_connections.size();
+}
+
+void ConnectionRegistry::startSweep(void)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	m_sweeping = true;
+	armSweep();
+}
+
+void ConnectionRegistry::stopSweep(void)
+{
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	m_sweeping = false;
+	boost::system::error_code ec;
+	m_sweep_timer.cancel(ec);
+}
+
+void ConnectionRegistry::armSweep(void)
+{
+	// assumes that a registry lock has already been acquired
+	m_sweep_timer.expires_from_now(boost::posix_time::seconds(long(SWEEP_INTERVAL)));
+	m_sweep_timer.async_wait(boost::bind(&ConnectionRegistry::handleSweep, this, boost::asio::placeholders::error));
+}
+
+void ConnectionRegistry::handleSweep(boost::system::error_code const& ec)
+{
+	if (ec) return; // canceled
+	prune();
+	boost::mutex::scoped_lock registry_lock(m_mutex);
+	if (m_sweeping) armSweep();
+}
+
+}
+}
@@ -0,0 +1,168 @@
+#ifndef CONNECTION_REGISTRY_H
+#define CONNECTION_REGISTRY_H
+
+#include <scarlet/net/TCPConnection.h>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <map>
+#include <vector>
+
+namespace scarlet {
+namespace net {
+
+class ConnectionLimits;
+typedef boost::shared_ptr<ConnectionLimits> ConnectionLimitsPtr;///<ConnectionLimits pointer
+
+/** ConnectionLimits: counts of the whole server shared by registries of all IO services, SO_REUSEPORT
+ * spreads connections of one client among them. Connections per client address are counted in
+ * SHARDS maps each with its own lock, all connections and requests in flight in atomic counters.
+ * Registry which paused accept is resumed through its callback when connections drop to
+ * LOW_WATER_PERCENT of the limit.
+ */
+class ConnectionLimits {
+	ConnectionLimits(ConnectionLimits const&) = delete;
+	void operator=(ConnectionLimits const&) = delete;
+	ConnectionLimits(void);
+public:
+	enum { SHARDS = 16 };
+	/// paused accepts resume when accepted connections drop to this percentage of the limit
+	enum { LOW_WATER_PERCENT = 90 };
+	typedef boost::function<void ()> ResumeFn;
+	static ConnectionLimitsPtr create(void) { return ConnectionLimitsPtr(new ConnectionLimits()); }
+	/** sets limits of the server, 0 is unlimited
+	 * @param max_connections accepted connections
+	 * @param max_per_ip accepted connections from one client address
+	 * @param max_requests requests in flight on all connections
+	 */
+	void set(size_t max_connections, size_t max_per_ip, size_t max_requests);
+	/// adds function called when connections drop to the low-water mark, must be set before connections are accepted
+	void onResume(ResumeFn const& resume) { m_resume.push_back(resume); }
+	/// true if accept should wait
+	bool full(void) const { return m_max_connections > 0 && m_connections >= m_max_connections; }
+	/// true if paused accept may continue
+	bool lowWater(void) const { return m_connections <= m_max_connections * LOW_WATER_PERCENT / 100; }
+	/// @return false if there are too many connections from ip, otherwise release() must follow
+	bool admit(boost::asio::ip::address const& ip);
+	void release(boost::asio::ip::address const& ip);
+	/// @return false if there are too many requests in flight, otherwise endRequest() must follow
+	bool beginRequest(void);
+	void endRequest(void) { --m_requests; }
+	size_t connections(void) const { return m_connections; }
+	size_t requests(void) const { return m_requests; }
+private:
+	struct shard_t {
+		boost::mutex                                mutex;
+		std::map<boost::asio::ip::address, size_t> per_ip;
+	};
+	shard_t& shard(boost::asio::ip::address const& ip);
+	shard_t                         m_shards[SHARDS];
+	boost::atomic<size_t>           m_connections;
+	boost::atomic<size_t>           m_requests;
+	size_t                          m_max_connections;
+	size_t                          m_max_per_ip;
+	size_t                          m_max_requests;
+	std::vector<ResumeFn>           m_resume;
+};
+
+/** ConnectionRegistry: connections of one IO service and the acceptors creating them. Each
+ * IOSvcScheduler has its own registry so accepting and closing connections on different IO
+ * services never wait on each other, with one thread per service the lock is not contended.
+ * Connections which nobody else references (no pending operation) are orphans, they are closed
+ * by a periodic sweep.
+ * Registry also admits connections and requests against server wide ConnectionLimits: when
+ * accepted connections reach the limit the next accept of this service waits until they drop to
+ * the low-water mark, connections over the limit per client address are closed right after
+ * accept, requests over the limit of in-flight requests should be rejected by the caller.
+ */
+class ConnectionRegistry {
+	ConnectionRegistry(ConnectionRegistry const&) = delete;
+	void operator=(ConnectionRegistry const&) = delete;
+public:
+	/// called for every connection accepted by the registry, with the index of its listener
+	typedef boost::function<void (TCPConnectionPtr const&, size_t, boost::system::error_code const&)> AcceptHandler;
+	/// seconds between sweeps of orphaned connections
+	enum { SWEEP_INTERVAL = 30 };
+	struct stats_t {
+		size_t          connections;///< accepted on this IO service and not yet removed
+		size_t          requests;///< in flight on the whole server
+		boost::uint64_t accept_pauses;
+		boost::uint64_t refused;///< closed because of the limit per client address
+		boost::uint64_t rejected;///< requests over the in-flight limit
+	};
+	ConnectionRegistry(boost::asio::io_service& io_service, boost::asio::ip::tcp::acceptor& acceptor, ConnectionLimitsPtr const& limits);
+	/** adds listener for another socket listening on the same IO service (handed off by a
+	 * process which had more IO services), must be called before open()
+	 * @return acceptor to assign the socket to
+	 */
+	boost::asio::ip::tcp::acceptor& addAcceptor(void);
+	/// number of listeners, the first one is the acceptor of the IO service
+	size_t listeners(void) const;
+	boost::asio::ip::tcp::acceptor& getAcceptor(size_t listener) { return *m_acceptors.at(listener); }
+	/// allows accept(), acceptors must be already listening
+	void open(AcceptHandler const& handler);
+	/// closes the acceptors and drops added ones, pending accepts complete with error and accept() fails
+	void close(void);
+	/** registers tcp_conn and starts accepting a new connection from the listener into it, or as
+	 * soon as accepted connections drop below the low-water mark if there are too many
+	 * @return false if the registry is closed
+	 */
+	bool accept(TCPConnectionPtr const& tcp_conn, size_t listener);
+	/** counts just accepted tcp_conn against the limits
+	 * @return false if there are too many connections from its address, it should be closed
+	 */
+	bool admit(TCPConnectionPtr const& tcp_conn);
+	/// unregisters a closed connection
+	void remove(TCPConnectionPtr const& tcp_conn);
+	/// @return false if there are too many requests in flight, otherwise endRequest() must follow
+	bool beginRequest(void);
+	void endRequest(void) { m_limits->endRequest(); }
+	stats_t stats(void) const;
+	/** closes and unregisters orphaned connections
+	 * @return number of remaining connections
+	 */
+	size_t prune(void);
+	/// starts periodic prune() on the IO service
+	void startSweep(void);
+	void stopSweep(void);
+private:
+	void armSweep(void);
+	void handleSweep(boost::system::error_code const& ec);
+	/// accept operation lives in handler memory of tcp_conn, nothing is allocated per accept
+	void startAccept(TCPConnectionPtr const& tcp_conn, size_t listener);
+	void handleAccept(TCPConnectionPtr const& tcp_conn, size_t listener, boost::system::error_code const& ec)
+	{ m_accepted(tcp_conn, listener, ec); }
+	/// client address of admitted connection, unspecified if not admitted
+	typedef boost::unordered_map<TCPConnectionPtr, boost::asio::ip::address> ConnectionSet;
+	/// releases limits held by the connection, assumes that the lock has already been acquired
+	ConnectionSet::iterator erase(ConnectionSet::iterator it);
+	/// starts paused accept if connections dropped enough, assumes that the lock has already been acquired
+	void resumeAccept(void);
+	/// called by ConnectionLimits from any thread, resumes on own IO service
+	void handleLowWater(void);
+	void handleResume(void);
+	mutable boost::mutex            m_mutex;
+	boost::asio::io_service&        m_io_service;
+	std::vector<boost::asio::ip::tcp::acceptor*> m_acceptors;
+	/// added acceptors stay alive until destruction, aborted accepts may still complete on them
+	std::vector<boost::shared_ptr<boost::asio::ip::tcp::acceptor> > m_added;
+	ConnectionLimitsPtr             m_limits;
+	ConnectionSet                   m_connections;
+	AcceptHandler                   m_accepted;
+	size_t                          m_admitted;
+	std::vector<TCPConnectionPtr>   m_paused;///< per listener, waits to accept while there are too many connections
+	boost::uint64_t                 m_accept_pauses;
+	boost::uint64_t                 m_refused;
+	boost::atomic<boost::uint64_t>  m_rejected;
+	bool                            m_open;
+	bool                            m_sweeping;
+	boost::asio::deadline_timer     m_sweep_timer;
+};
+
+}
+}
+
+#endif // CONNECTION_REGISTRY_H
@@ -1,15 +1,40 @@
 #include "IOSvcScheduler.h"
 #include <boost/make_shared.hpp>
+#if defined(_MSC_VER) || defined(WIN32)
+#   include <windows.h>
+#elif defined(__linux__)
+#   include <pthread.h>
+#   include <sched.h>
+#endif
 
 namespace scarlet {
 namespace net {
 
-IOSvcScheduler::IOSvcScheduler(const boost::uint32_t num_threads)
-	: m_thread_pool(num_threads)
-	, m_service()
+/// @return false if pinning is not supported or failed
+static bool pin_current_thread(int cpu)
+{
+#if defined(_MSC_VER) || defined(WIN32)
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+IOSvcScheduler::IOSvcScheduler(ConnectionLimitsPtr const& limits, const boost::uint32_t num_threads, int cpu)
+	: m_thread_pool(num_threads > 0 ? num_threads : 1)
+	, m_service(num_threads > 0 ? num_threads : 1) // concurrency hint, lets asio optimize single thread service
 	, m_work()
 	, m_acceptor(m_service)
+	, m_connections(m_service, m_acceptor, limits)
+	, m_timeouts(m_service)
 	, m_ssl_context(m_service, boost::asio::ssl::context::sslv23)
+	, m_cpu(cpu)
 {
 }
 
@@ -20,6 +45,8 @@ IOSvcScheduler::~IOSvcScheduler()
 
 void IOSvcScheduler::processServiceWork(void) {
 	LOGMSG(" Entered service worker loop");
+	if (m_cpu >= 0 && !pin_current_thread(m_cpu))
+		WARNCLOG("Unable to pin service thread to CPU " << m_cpu);
 	try {
 		m_service.run();
 	}
@@ -46,6 +73,7 @@ void IOSvcScheduler::start(void)
 			auto fnJob = boost::bind(&IOSvcScheduler::processServiceWork, this);
 			m_thread_pool[n] = boost::make_shared<boost::thread>(fnJob);
 		}
+		m_timeouts.start();
 	}
 }
 
@@ -54,6 +82,7 @@ void IOSvcScheduler::stop(void)
 	LOGMSG("Shutting down thread scheduler");
 	boost::mutex::scoped_lock scheduler_lock(m_mutex);
 	if (m_work) {
+		m_timeouts.stop();
 		m_service.stop();
 		// wait until all threads in the pool have stopped, but skip current
 		boost::thread current_thread;
@@ -70,13 +99,15 @@ void IOSvcScheduler::stop(void)
 }
 
 
-IOSvcSchedulerGroup::IOSvcSchedulerGroup(boost::uint32_t nservices, boost::uint32_t num_threads)
-	: /*m_nservices(nservices), m_next_service(nservices),*/ m_schedulers(), m_is_running(false)
+IOSvcSchedulerGroup::IOSvcSchedulerGroup(boost::uint32_t nservices, boost::uint32_t num_threads, bool pin_threads)
+	: /*m_nservices(nservices), m_next_service(nservices),*/ m_schedulers(), m_is_running(false), m_limits(ConnectionLimits::create())
 {
 	DBGMSGAT("");
+	unsigned const ncpus(std::max(1u, boost::thread::hardware_concurrency()));
 	// make sure there are enough services initialized
 	while (m_schedulers.size() < nservices) {
-		m_schedulers.push_back(boost::make_shared<IOSvcScheduler>(num_threads));
+		int const cpu(pin_threads ? int(m_schedulers.size() % ncpus) : -1);
+		m_schedulers.push_back(boost::make_shared<IOSvcScheduler>(m_limits, num_threads, cpu));
 	}
 }
 
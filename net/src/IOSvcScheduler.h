@@ -1,6 +1,8 @@
 #ifndef IO_SVC_SCHEDULER_H
 #define IO_SVC_SCHEDULER_H
 
+#include "ConnectionRegistry.h"
+#include <scarlet/net/TimingWheel.h>
 #include <bmu/Logger.h>
 //#include <bmu/WorkScheduler.h>
 #include <boost/asio/io_service.hpp>
@@ -20,8 +22,12 @@ class IOSvcScheduler /*: public bmu::WorkScheduler*/ {
 public:
 	/// default number of worker threads in the thread pool
 	enum { DEFAULT_NUM_THREADS = 8 };
-	/// constructs a new IOSvcScheduler
-	IOSvcScheduler(const boost::uint32_t num_threads = DEFAULT_NUM_THREADS);
+	/** constructs a new IOSvcScheduler
+	 * @param limits shared by connections of all IO services of the server
+	 * @param num_threads number of threads running the IO service
+	 * @param cpu if not negative all threads are pinned to this CPU
+	 */
+	IOSvcScheduler(ConnectionLimitsPtr const& limits, const boost::uint32_t num_threads = DEFAULT_NUM_THREADS, int cpu = -1);
 	/// virtual destructor
 	virtual ~IOSvcScheduler();
 
@@ -31,6 +37,12 @@ public:
 	/// returns an acceptor on this I/O service
 	boost::asio::ip::tcp::acceptor& getAcceptor(void) { return m_acceptor; }
 
+	/// returns connections accepted on this I/O service
+	ConnectionRegistry& getConnections(void) { return m_connections; }
+
+	/// returns read and idle timeouts of connections on this I/O service
+	TimingWheel& getTimeouts(void) { return m_timeouts; }
+
 	/// returns an context used for SSL configuration on this I/O service
 	boost::asio::ssl::context& getSSLContext(void) { return m_ssl_context; }
 
@@ -46,17 +58,26 @@ private:
 	boost::asio::io_service			m_service; ///< service used to manage async I/O events
 	boost::shared_ptr<boost::asio::io_service::work> m_work;
 	boost::asio::ip::tcp::acceptor  m_acceptor; ///< manages async TCP connections
+	ConnectionRegistry              m_connections; ///< connections accepted by m_acceptor
+	TimingWheel                     m_timeouts; ///< timeouts of connections in m_connections
 	boost::asio::ssl::context       m_ssl_context; ///> context used for SSL configuration
+	int const                       m_cpu; ///< CPU running the threads, negative if not pinned
 	//boost::asio::deadline_timer		m_timer;/// timer used to periodically check for shutdown
 };
 
 typedef boost::shared_ptr<IOSvcScheduler> IOSvcSchedulerPtr;
 
-/// IOSvcSchedulerGroup: uses a single IO service for each thread
+/** IOSvcSchedulerGroup: group of IO services each with its own threads and acceptor. With one
+ * pinned thread per service connection is handled on the same CPU from accept to close.
+ */
 class IOSvcSchedulerGroup {
 public:
-	/// constructs a new IOSvcSchedulerGroup
-	IOSvcSchedulerGroup(boost::uint32_t nservices, boost::uint32_t num_threads = IOSvcScheduler::DEFAULT_NUM_THREADS);
+	/** constructs a new IOSvcSchedulerGroup
+	 * @param nservices number of IO services
+	 * @param num_threads number of threads running each IO service
+	 * @param pin_threads if true threads of n-th service are pinned to CPU n (modulo CPU count)
+	 */
+	IOSvcSchedulerGroup(boost::uint32_t nservices, boost::uint32_t num_threads = IOSvcScheduler::DEFAULT_NUM_THREADS, bool pin_threads = false);
 	/// destructor
 	~IOSvcSchedulerGroup();
 	boost::uint32_t count(void) const 
@@ -73,6 +94,8 @@ public:
 		assert(n < m_schedulers.size());
 		return m_schedulers[n];
 	}
+	/// returns connection limits shared by all services
+	ConnectionLimits& getLimits(void) { return *m_limits; }
 	//	/**
 	//	 * schedules work to be performed by one of the pooled threads
 	//	 *
@@ -86,6 +109,8 @@ private:
 	boost::mutex					m_mutex;
 	/// true if the scheduler group is running
 	bool							m_is_running;
+	/// connection limits of the whole server
+	ConnectionLimitsPtr             m_limits;
 	/// typedef for a pool of single service schedulers
 	typedef std::vector<IOSvcSchedulerPtr>	scheduler_group;
 	/// pool of single service schedulers used to perform work
@@ -0,0 +1,173 @@
+#include "scarlet/net/ListenerHandoff.h"
+#include <bmu/Logger.h>
+#ifndef _WIN32
+#   include <sys/types.h>
+#   include <sys/socket.h>
+#   include <sys/wait.h>
+#   include <poll.h>
+#   include <unistd.h>
+#   include <signal.h>
+#   include <cerrno>
+#   include <cstdlib>
+#   include <cstring>
+#   include <string>
+extern char** environ;
+#endif
+
+namespace scarlet {
+namespace net {
+
+#ifndef _WIN32
+namespace {
+
+char const HANDOFF_ENV[] = "SCARLET_HANDOFF_FD";
+char const READY = 'R';
+
+bool send_sockets(int channel, ListenerHandoff::Sockets const& sockets)
+{
+	char count(char(sockets.size()));
+	iovec iov = { &count, 1 };
+	std::vector<char> control(CMSG_SPACE(sizeof(int) * sockets.size()));
+	msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &control[0];
+	msg.msg_controllen = control.size();
+	cmsghdr* const cmsg(CMSG_FIRSTHDR(&msg));
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+	std::memcpy(CMSG_DATA(cmsg), &sockets[0], sizeof(int) * sockets.size());
+	ssize_t sent;
+	do sent = ::sendmsg(channel, &msg, 0); while (sent < 0 && errno == EINTR);
+	return sent == 1;
+}
+
+bool wait_ready(int channel)
+{
+	pollfd pfd = { channel, POLLIN, 0 };
+	int ready;
+	do ready = ::poll(&pfd, 1, ListenerHandoff::READY_TIMEOUT * 1000); while (ready < 0 && errno == EINTR);
+	char reply(0);
+	return ready == 1 && ::recv(channel, &reply, 1, 0) == 1 && reply == READY;
+}
+
+}
+#endif
+
+bool ListenerHandoff::spawn(char* const argv[], Sockets const& sockets)
+{
+#ifdef _WIN32
+	(void)argv; (void)sockets;
+	LOGMSG(" Error " << "Listening sockets can not be passed to a new process on this system");
+	return false;
+#else
+	if (sockets.empty() || sockets.size() > MAX_SOCKETS) {
+		LOGMSG(" Error " << "Unable to pass " << sockets.size() << " listening sockets to a new process");
+		return false;
+	}
+	int channel[2];
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, channel) != 0) {
+		LOGMSG(" Error " << "Unable to create socket pair for the new process: " << std::strerror(errno));
+		return false;
+	}
+	// new process gets environment of this one with the channel, prepared before fork because
+	// child of a multithreaded process may call only async-signal-safe functions until exec
+	std::string const variable(std::string(HANDOFF_ENV) + '=' + std::to_string(channel[1]));
+	std::vector<char*> env;
+	for (char** e(environ); *e; ++e) {
+		if (std::strncmp(*e, HANDOFF_ENV, sizeof(HANDOFF_ENV) - 1) != 0 || (*e)[sizeof(HANDOFF_ENV) - 1] != '=')
+			env.push_back(*e);
+	}
+	env.push_back(const_cast<char*>(variable.c_str()));
+	env.push_back(0);
+	long const max_fd(::sysconf(_SC_OPEN_MAX) > 0 ? ::sysconf(_SC_OPEN_MAX) : 1024);
+
+	pid_t const pid(::fork());
+	if (pid < 0) {
+		LOGMSG(" Error " << "Unable to start new process: " << std::strerror(errno));
+		::close(channel[0]);
+		::close(channel[1]);
+		return false;
+	}
+	if (pid == 0) {
+		// connections of this process must not stay open in the new one
+		for (int fd(3); fd < max_fd; ++fd) {
+			if (fd != channel[1]) ::close(fd);
+		}
+		environ = &env[0];
+		::execvp(argv[0], argv); // by path, not /proc/self/exe which is the replaced executable
+		::_exit(127);
+	}
+	::close(channel[1]);
+	bool const listening(send_sockets(channel[0], sockets) && wait_ready(channel[0]));
+	::close(channel[0]);
+	if (!listening) {
+		LOGMSG(" Error " << "New process " << pid << " did not start listening, killing it");
+		::kill(pid, SIGKILL);
+		::waitpid(pid, 0, 0);
+	}
+	return listening;
+#endif
+}
+
+int ListenerHandoff::inherited(void)
+{
+#ifdef _WIN32
+	return -1;
+#else
+	char const* const value(std::getenv(HANDOFF_ENV));
+	if (!value) return -1;
+	int const channel(std::atoi(value));
+	::unsetenv(HANDOFF_ENV);
+	return channel > 2 ? channel : -1;
+#endif
+}
+
+ListenerHandoff::Sockets ListenerHandoff::receive(int channel)
+{
+	Sockets sockets;
+#ifndef _WIN32
+	char count(0);
+	iovec iov = { &count, 1 };
+	std::vector<char> control(CMSG_SPACE(sizeof(int) * MAX_SOCKETS));
+	msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &control[0];
+	msg.msg_controllen = control.size();
+	ssize_t received;
+	do received = ::recvmsg(channel, &msg, 0); while (received < 0 && errno == EINTR);
+	if (received != 1) {
+		LOGMSG(" Error " << "Unable to receive listening sockets from the previous process");
+		return sockets;
+	}
+	for (cmsghdr* cmsg(CMSG_FIRSTHDR(&msg)); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			int const* const fds(reinterpret_cast<int const*>(CMSG_DATA(cmsg)));
+			sockets.insert(sockets.end(), fds, fds + (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		}
+	}
+	if (sockets.size() != size_t(count))
+		WARNCLOG("Received " << sockets.size() << " of " << int(count) << " listening sockets");
+#else
+	(void)channel;
+#endif
+	return sockets;
+}
+
+void ListenerHandoff::ready(int channel)
+{
+#ifndef _WIN32
+	if (::send(channel, &READY, 1, 0) != 1)
+		WARNCLOG("Unable to notify the previous process, it kills this one after timeout");
+	::close(channel);
+#else
+	(void)channel;
+#endif
+}
+
+}
+}
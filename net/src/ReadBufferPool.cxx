@@ -0,0 +1,74 @@
+#include "scarlet/net/ReadBufferPool.h"
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
+#include <vector>
+#include <new>
+
+namespace scarlet {
+namespace net {
+
+namespace {
+
+boost::atomic<size_t> in_use(0);
+boost::atomic<size_t> peak_in_use(0);
+boost::atomic<size_t> allocated(0);
+
+/// free list of one thread, buffers are freed when the thread exits
+struct free_list_t {
+	std::vector<char*> buffers;
+	free_list_t(void) { buffers.reserve(ReadBufferPool::MAX_FREE_PER_THREAD); }
+	~free_list_t()
+	{
+		for (size_t i = 0; i < buffers.size(); ++i)
+			delete[] buffers[i];
+		allocated -= buffers.size();
+	}
+};
+
+free_list_t& thread_free_list(void)
+{
+	static boost::thread_specific_ptr<free_list_t> _free;
+	if (!_free.get()) _free.reset(new free_list_t());
+	return *_free;
+}
+
+}
+
+char* ReadBufferPool::acquire(void)
+{
+	free_list_t& fl(thread_free_list());
+	char* buffer(0);
+	if (fl.buffers.empty()) {
+		buffer = new char[BUFFER_SIZE];
+		++allocated;
+	} else {
+		buffer = fl.buffers.back();
+		fl.buffers.pop_back();
+	}
+	size_t const n(++in_use);
+	for (size_t peak(peak_in_use); n > peak && !peak_in_use.compare_exchange_weak(peak, n); )
+		;
+	return buffer;
+}
+
+void ReadBufferPool::release(char* buffer)
+{
+	if (!buffer) return;
+	--in_use;
+	free_list_t& fl(thread_free_list());
+	if (fl.buffers.size() < MAX_FREE_PER_THREAD) {
+		fl.buffers.push_back(buffer);
+	} else {
+		delete[] buffer;
+		--allocated;
+	}
+}
+
+ReadBufferPool::stats_t ReadBufferPool::stats(void)
+{
+	stats_t const st = { in_use, peak_in_use, allocated };
+	return st;
+}
+
+}
+}
@@ -1,22 +1,91 @@
 #include "scarlet/net/TCPConnection.h"
 #include "IOSvcScheduler.h"
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <algorithm>
 
 namespace scarlet {
 namespace net {
 
 TCPConnection::TCPConnection(IOSvcSchedulerPtr scheduler, const bool ssl_flag)
 	: m_scheduler(scheduler)
+	, m_read_memory()
+	, m_write_memory()
 	, m_ssl_socket(scheduler->getIOService(), scheduler->getSSLContext())
 	, m_ssl_flag(ssl_flag)
+	, m_read_buffer(0)
+	, m_ssl_first(0)
 	, m_read_position(0, 0)
 	, m_lifecycle(LIFECYCLE_CLOSE)
 	, m_sending(false)
+	, m_clean(false)
+	, m_arena(Arena::create())
+	, m_deadline(boost::bind(&TCPConnection::close, this))
 { }
 
 TCPConnection::~TCPConnection()
 {
 	DBGMSGAT(" ~~~~~~~~~~~~~");
+	cancelDeadline();
 	close();
+	ReadBufferPool::release(m_read_buffer);
+}
+
+void TCPConnection::releaseReadBuffer(void)
+{
+	ReadBufferPool::release(m_read_buffer);
+	m_read_buffer = 0;
+	m_read_position = ReadPosition(0, 0);
+}
+
+std::size_t TCPConnection::readReady(boost::system::error_code& ec)
+{
+	boost::asio::ip::tcp::socket& socket(m_ssl_socket.next_layer());
+	// left non-blocking for the life of the socket: this read is its only synchronous I/O, async
+	// operations retry on would_block regardless of the flag, close() doesn't linger
+	if (!socket.non_blocking()) {
+		socket.non_blocking(true, ec);
+		if (ec) return 0;
+	}
+	borrowReadBuffer();
+	std::size_t const bytes_read(socket.read_some(boost::asio::buffer(m_read_buffer, READ_BUFFER_SIZE), ec));
+	if (ec == boost::asio::error::would_block) releaseReadBuffer();
+	return bytes_read;
+}
+
+std::size_t TCPConnection::readPending(void)
+{
+	borrowReadBuffer();
+	m_read_buffer[0] = m_ssl_first;
+	std::size_t const pending(std::min<std::size_t>(::SSL_pending(m_ssl_socket.native_handle()), READ_BUFFER_SIZE - 1));
+	if (!pending) return 1;
+	// SSL_read is satisfied from the already decrypted record
+	boost::system::error_code ec;
+	return 1 + m_ssl_socket.read_some(boost::asio::buffer(m_read_buffer + 1, pending), ec);
+}
+
+void TCPConnection::setDeadline(boost::uint32_t seconds)
+{
+	m_scheduler->getTimeouts().schedule(m_deadline, seconds);
+}
+
+void TCPConnection::cancelDeadline(void)
+{
+	m_scheduler->getTimeouts().cancel(m_deadline);
+}
+
+InFlightRequestPtr TCPConnection::beginRequest(void)
+{
+	if (!m_scheduler->getConnections().beginRequest()) return InFlightRequestPtr();
+	return boost::allocate_shared<InFlightRequest>(ArenaAllocator<InFlightRequest>(m_arena), m_scheduler);
+}
+
+void InFlightRequest::end(void)
+{
+	if (!m_scheduler) return;
+	IOSvcSchedulerPtr scheduler;
+	scheduler.swap(m_scheduler);
+	scheduler->getConnections().endRequest();
 }
 
 }
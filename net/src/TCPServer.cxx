@@ -1,5 +1,6 @@
 #include "scarlet/net/TCPServer.h"
 #include "IOSvcScheduler.h"
+#include "TLSSessionCache.h"
 #include <boost/bind.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/make_shared.hpp>
@@ -26,6 +27,10 @@ using boost::asio::ip::tcp;
 namespace scarlet {
 namespace net {
 
+#if !defined(_MSC_VER) && defined(SO_REUSEPORT)
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
 #ifndef _MSC_VER
 /// AdminPermissions: obtains administrative rights for the process
 class AdminPermissions {
@@ -65,9 +70,11 @@ class AdminPermissions { };
 
 // TCPServer member functions
 
-TCPServer::TCPServer(const tcp::endpoint& endpoint, size_t concurency, size_t count_of_worker_threads)
-	: m_asio_scheduler_group(boost::make_shared<IOSvcSchedulerGroup>(concurency, count_of_worker_threads))
+TCPServer::TCPServer(const tcp::endpoint& endpoint, size_t concurency, size_t count_of_worker_threads, bool pin_threads)
+	: m_tls_sessions()
+	, m_asio_scheduler_group(boost::make_shared<IOSvcSchedulerGroup>(concurency, count_of_worker_threads, pin_threads))
 	, m_endpoint(endpoint)
+	, m_adopted()
 	, m_ssl_flag(false)
 	, m_is_listening(false)
 { }
@@ -89,11 +96,24 @@ void TCPServer::start(void)
 		try {
 			for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
 				auto& tcp_acceptor = m_asio_scheduler_group->getScheduler(i)->getAcceptor();
+				if (i < m_adopted.size()) {
+					// already bound and listening, previous process may still accept on it
+					tcp_acceptor.assign(m_endpoint.protocol(), m_adopted[i]);
+					tcp::endpoint const adopted(tcp_acceptor.local_endpoint());
+					if (adopted != m_endpoint && (m_endpoint.port() != 0 || adopted.address() != m_endpoint.address()))
+						WARNCLOG("Adopted listening socket on " << adopted.address().to_string() << ':' << adopted.port()
+							<< " instead of configured " << m_endpoint.address().to_string() << ':' << m_endpoint.port());
+					m_endpoint = adopted;
+					continue;
+				}
 				tcp_acceptor.open(m_endpoint.protocol());
 				// allow the acceptor to reuse the address (i.e. SO_REUSEADDR)
 				// ...except when running not on Windows - see http://msdn.microsoft.com/en-us/library/ms740621%28VS.85%29.aspx
 #ifdef _MSC_VER
 				tcp_acceptor.set_option(tcp::acceptor::reuse_address(true));
+#elif defined(SO_REUSEPORT)
+				// every IO service binds its own acceptor to the endpoint, kernel balances accepts among them
+				tcp_acceptor.set_option(reuse_port(true));
 #endif
 				tcp_acceptor.set_option(boost::asio::socket_base::keep_alive(true));
 				tcp_acceptor.bind(m_endpoint);
@@ -103,20 +123,32 @@ void TCPServer::start(void)
 				}
 				tcp_acceptor.listen(); // put acceptor in listen state
 			}
+			// previous process had more IO services, their queued connections are accepted here
+			for (size_t i(m_asio_scheduler_group->count()); i < m_adopted.size(); ++i) {
+				auto scheduler = m_asio_scheduler_group->getScheduler(i % m_asio_scheduler_group->count());
+				scheduler->getConnections().addAcceptor().assign(m_endpoint.protocol(), m_adopted[i]);
+			}
 		} 
 		catch (std::exception& e) {
 			LOGMSG(" Error " << "Unable to bind to port " << m_endpoint.port() << ": " << e.what());
 			throw;
 		}
+		if (!m_adopted.empty())
+			LOGMSG("Adopted " << m_adopted.size() << " listening sockets on port " << m_endpoint.port());
+		m_adopted.clear();
 
 		m_is_listening = true;
 
-		// unlock the mutex since listen() requires its own lock
 		server_lock.unlock();
 		for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
 			auto scheduler = m_asio_scheduler_group->getScheduler(i);
-			listen(scheduler);
+			scheduler->getConnections().open(boost::bind(&TCPServer::handleAccept, this, _1, _2, _3));
+			scheduler->getConnections().startSweep();
+			for (size_t l(0), n(scheduler->getConnections().listeners()); l < n; ++l)
+				listen(scheduler, l);
 		}
+		if (m_tls_sessions)
+			m_tls_sessions->startRotation(getIOService());
 		// notify the thread scheduler that we need it now
 		for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
 			m_asio_scheduler_group->getScheduler(i)->start(); // this executes asio.run() in scheduled threads
@@ -133,20 +165,34 @@ void TCPServer::stop(bool wait_until_finished)
 		LOGMSG("Shutting down server on port " << m_endpoint.port());
 		m_is_listening = false;
 		for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
-			auto& tcp_acceptor = m_asio_scheduler_group->getScheduler(i)->getAcceptor();
+			auto& connections = m_asio_scheduler_group->getScheduler(i)->getConnections();
+			connections.stopSweep();
 			// this terminates any connections waiting to be accepted
-			tcp_acceptor.close();
+			connections.close();
 		}
+		if (m_tls_sessions)
+			m_tls_sessions->stopRotation();
 		if (!wait_until_finished) {
 			// wait for all pending connections to complete
 			// try to prune connections that didn't finish cleanly
-			while (0 != pruneConnections()) { // if no more left, then we can stop waiting
-				int csize = m_conn_pool.size();
+			for (std::size_t csize; 0 != (csize = pruneConnections()); ) { // if no more left, then we can stop waiting
 				LOGMSG("Waiting for open connections to finish size =" << csize);
 				// sleep for up to a quarter second to give open connections a chance to finish
 				m_no_more_connections.timed_wait(server_lock, boost::posix_time::milliseconds(250));
 			}
 		}
+		ReadBufferPool::stats_t const rb(ReadBufferPool::stats());
+		LOGMSG("Read buffers in use: " << rb.in_use << " peak: " << rb.peak_in_use << " allocated: " << rb.allocated);
+		for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
+			ConnectionRegistry::stats_t const cs(m_asio_scheduler_group->getScheduler(i)->getConnections().stats());
+			LOGMSG("IO service " << i << " accept pauses: " << cs.accept_pauses << " refused connections: " << cs.refused
+				<< " rejected requests: " << cs.rejected);
+		}
+		if (m_tls_sessions) {
+			TLSSessionCache::stats_t const ts(m_tls_sessions->stats());
+			LOGMSG("SSL handshakes full: " << ts.full << " resumed: " << ts.resumed << " failed: " << ts.failed
+				<< ", cached sessions: " << ts.sessions << " evicted: " << ts.evicted << " ticket key rotations: " << ts.rotations);
+		}
 		// notify the thread scheduler that we no longer need it
 		for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
 			m_asio_scheduler_group->getScheduler(i)->stop();
@@ -157,6 +203,11 @@ void TCPServer::stop(bool wait_until_finished)
 	}
 }
 
+boost::asio::io_service& TCPServer::getIOService(void)
+{
+	return m_asio_scheduler_group->getScheduler(0)->getIOService();
+}
+
 void TCPServer::join(void)
 {
 	boost::mutex::scoped_lock server_lock(m_mutex);
@@ -180,44 +231,75 @@ void TCPServer::setSSLKeyFile(const std::string& pem_key_file)
 	}
 }
 
-void TCPServer::listen(IOSvcSchedulerPtr scheduler)
+ListenerHandoff::Sockets TCPServer::getListeningSockets(void)
 {
-	// Single acceptor is used to wait for connections on one IO service at time.
+	boost::mutex::scoped_lock server_lock(m_mutex);
+	ListenerHandoff::Sockets sockets;
+	for (size_t i(0); m_is_listening && i < m_asio_scheduler_group->count(); ++i)
+		sockets.push_back(m_asio_scheduler_group->getScheduler(i)->getAcceptor().native_handle());
+	// adopted sockets beyond the count of IO services are passed on after the own ones
+	for (size_t i(0); m_is_listening && i < m_asio_scheduler_group->count(); ++i) {
+		ConnectionRegistry& connections(m_asio_scheduler_group->getScheduler(i)->getConnections());
+		for (size_t l(1), n(connections.listeners()); l < n; ++l)
+			sockets.push_back(connections.getAcceptor(l).native_handle());
+	}
+	return sockets;
+}
+
+void TCPServer::setSSLSessions(size_t max_sessions, long lifetime)
+{
+	if (lifetime <= 0) {
+		m_tls_sessions.reset();
+		for (size_t i(0); i < m_asio_scheduler_group->count(); ++i) {
+			SSL_CTX* const ctx(m_asio_scheduler_group->getScheduler(i)->getSSLContext().native_handle());
+			SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+			SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+			SSL_CTX_set_num_tickets(ctx, 0); // TLS 1.3 would still send tickets of uncached sessions
+#endif
+		}
+		return;
+	}
+	// one cache and one ticket key for all contexts, client reconnects to any IO service
+	m_tls_sessions = TLSSessionCache::create(max_sessions, lifetime);
+	for (size_t i(0); i < m_asio_scheduler_group->count(); ++i)
+		m_tls_sessions->attach(m_asio_scheduler_group->getScheduler(i)->getSSLContext());
+}
+
+void TCPServer::setLimits(size_t max_connections, size_t max_per_ip, size_t max_requests)
+{
+	// SO_REUSEPORT spreads connections of a client among IO services, counts are kept for the whole server
+	m_asio_scheduler_group->getLimits().set(max_connections, max_per_ip, max_requests);
+}
+
+void TCPServer::listen(IOSvcSchedulerPtr scheduler, size_t listener)
+{
+	// Single acceptor (per listener) is used to wait for connections on one IO service at time.
 	// On one acceptor connection can be accepted (handleAccept) from any of threads scheduled on this IO service
 		
 	//1. handleAccept se poziva za svaku novu prihvacenu konekciju
 	//2. handleAccept se poziva iz jedne od niti koje izvrsavaju io_service::run i to iz one niti u kojoj
 	// se u sklopu io_service::run obradi dati dogadjaj prihvatanja konekcije
 
-	// lock mutex for thread safety
-	boost::mutex::scoped_lock server_lock(m_mutex);
 	if (m_is_listening) {
-		// prune connections that finished uncleanly
-		pruneConnections();
-	
 		// create a new TCP connection object
 		TCPConnectionPtr new_conn(
 			TCPConnection::create(scheduler, m_ssl_flag)
 		);
 
-		// keep track of the object in the server's connection pool
-		m_conn_pool.insert(new_conn);
-
-		// use the object to accept a new connection
-		new_conn->async_accept(
-			scheduler->getAcceptor()
-			, boost::bind(&TCPServer::handleAccept, this, new_conn, boost::asio::placeholders::error)
-		);
+		// keep track of the object in the scheduler's registry and use it to accept a new connection,
+		// fails only if the server is being stopped
+		scheduler->getConnections().accept(new_conn, listener);
 	}
 }
 
-void TCPServer::handleAccept(TCPConnectionPtr tcp_conn, boost::system::error_code const& accept_error)
+void TCPServer::handleAccept(TCPConnectionPtr tcp_conn, size_t listener, boost::system::error_code const& accept_error)
 {
 	if (accept_error) {
 		// an error occured while trying to a accept a new connection
 		// this happens when the server is being shut down
 		if (m_is_listening) {
-			listen(tcp_conn->getScheduler());	// schedule acceptance of another connection
+			listen(tcp_conn->getScheduler(), listener);	// schedule acceptance of another connection
 			WARNCLOG("Accept error on port " << m_endpoint.port() << ": " << accept_error.message());
 		}
 		finishConnection(tcp_conn);
@@ -225,11 +307,20 @@ void TCPServer::handleAccept(TCPConnectionPtr tcp_conn, boost::system::error_cod
 		// got a new TCP connection
 		DBGMSGAT("New" << (m_ssl_flag/*tcp_conn->getSSLFlag()*/ ? " SSL " : " ")
 					   << "connection on port " << m_endpoint.port());
+		// counted before the next accept, which pauses if this one reached the limit
+		if (!tcp_conn->getScheduler()->getConnections().admit(tcp_conn)) {
+			DBGMSGAT("Too many connections from " << tcp_conn->getRemoteIp().to_string());
+			if (m_is_listening)
+				listen(tcp_conn->getScheduler(), listener);
+			tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);
+			finishConnection(tcp_conn);
+			return;
+		}
 
 		// schedule the acceptance of another new connection
 		// (this returns immediately since it schedules it as an event)
 		if (m_is_listening) 
-			listen(tcp_conn->getScheduler());
+			listen(tcp_conn->getScheduler(), listener);
 
 		// handle the new connection
 		if(m_ssl_flag) { //if (tcp_conn->getSSLFlag()) {
@@ -247,17 +338,20 @@ void TCPServer::handleSSLHandshake(TCPConnectionPtr tcp_conn, const boost::syste
 	if (handshake_error) {
 		// an error occured while trying to establish the SSL connection
 		WARNCLOG("SSL handshake failed on port " << m_endpoint.port() << " (" << handshake_error.message() << ')');
+		if (m_tls_sessions)
+			m_tls_sessions->handshakeFailed();
 		finishConnection(tcp_conn);
 	} else {
 		// handle the new connection
 		DBGMSGAT("SSL handshake succeeded on port " << m_endpoint.port());
+		if (m_tls_sessions)
+			m_tls_sessions->handshake(tcp_conn->getSSLSessionReused());
 		handleConnection(tcp_conn); // ne blokira - samo scheduluje HTTP reader da se poziva kad stigne TCP paket
 	}
 }
 
 void TCPServer::finishConnection(TCPConnectionPtr tcp_conn)
 {
-	boost::mutex::scoped_lock server_lock(m_mutex);
 	DBGMSGAT(" with sending state = " << tcp_conn->getSendingState());
 	if (!tcp_conn->getSendingState()) {
 		if (m_is_listening && tcp_conn->getKeepAlive()) {
@@ -265,12 +359,13 @@ void TCPServer::finishConnection(TCPConnectionPtr tcp_conn)
 			handleConnection(tcp_conn); // ne blokira - samo scheduluje HTTP reader da se poziva kad stigne TCP paket
 		} else {
 			DBGMSGAT("Closing connection on port " << m_endpoint.port());
-			// remove the connection from the server's management pool
+			// remove the connection from the scheduler's registry
 			tcp_conn->close();
-			m_conn_pool.erase(tcp_conn);
+			tcp_conn->getScheduler()->getConnections().remove(tcp_conn);
 
-			// trigger the no more connections condition if we're waiting to stop
-			if (!m_is_listening && m_conn_pool.empty())
+			// wake up stop() waiting for connections to finish, without the server lock because
+			// stop() holds it while joining IO threads, a missed wakeup only delays the next prune
+			if (!m_is_listening)
 				m_no_more_connections.notify_all();
 		}
 	}
@@ -278,22 +373,11 @@ void TCPServer::finishConnection(TCPConnectionPtr tcp_conn)
 
 std::size_t TCPServer::pruneConnections(void)
 {
-	// assumes that a server lock has already been acquired
-	ConnectionPool::iterator conn_itr = m_conn_pool.begin();
-	while (conn_itr != m_conn_pool.end()) {
-		if (conn_itr->unique()) {
-			WARNCLOG("Closing orphaned connection on port " << m_endpoint.port());
-			ConnectionPool::iterator erase_itr = conn_itr;
-			++conn_itr;
-			(*erase_itr)->close();
-			m_conn_pool.erase(erase_itr);
-		} else {
-			++conn_itr;
-		}
-	}
-
+	std::size_t remaining(0);
+	for (size_t i(0); i < m_asio_scheduler_group->count(); ++i)
+		remaining += m_asio_scheduler_group->getScheduler(i)->getConnections().prune();
 	// return the number of connections remaining
-	return m_conn_pool.size();
+	return remaining;
 }
 
 
@@ -0,0 +1,253 @@
+#include "TLSSessionCache.h"
+#include <bmu/Logger.h>
+#include <boost/bind.hpp>
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#   include <openssl/core_names.h>
+#   include <openssl/params.h>
+#endif
+#include <stdexcept>
+#include <cstring>
+
+namespace scarlet {
+namespace net {
+
+namespace {
+
+int context_index(void)
+{
+	static int const index(SSL_CTX_get_ex_new_index(0, 0, 0, 0, 0));
+	return index;
+}
+
+bool random_key(unsigned char* key, size_t size)
+{
+	return RAND_bytes(key, int(size)) == 1;
+}
+
+}
+
+TLSSessionCache::TLSSessionCache(size_t max_sessions, long lifetime)
+	: m_max_sessions(max_sessions)
+	, m_lifetime(lifetime)
+	, m_mutex()
+	, m_sessions()
+	, m_order()
+	, m_rotation_timer()
+	, m_full(0)
+	, m_resumed(0)
+	, m_failed(0)
+	, m_evicted(0)
+	, m_rotations(0)
+{
+	// previous key is random too, until the first rotation it decrypts nothing
+	for (size_t i(0); i < 2; ++i) {
+		ticket_key_t& key(m_keys[i]);
+		if (!random_key(key.name, sizeof(key.name)) || !random_key(key.aes, sizeof(key.aes))
+			|| !random_key(key.hmac, sizeof(key.hmac)))
+			throw std::runtime_error("Unable to generate TLS session ticket key");
+	}
+	m_sessions.reserve(max_sessions);
+}
+
+TLSSessionCachePtr TLSSessionCache::create(size_t max_sessions, long lifetime)
+{
+	return TLSSessionCachePtr(new TLSSessionCache(max_sessions, lifetime));
+}
+
+void TLSSessionCache::attach(boost::asio::ssl::context& ssl_context)
+{
+	SSL_CTX* const ctx(ssl_context.native_handle());
+	SSL_CTX_set_ex_data(ctx, context_index(), this);
+	// sessions are resumed only in contexts with the same id context, all of them use this one
+	static unsigned char const id_context[] = "scarlet";
+	SSL_CTX_set_session_id_context(ctx, id_context, sizeof(id_context) - 1);
+	SSL_CTX_set_timeout(ctx, m_lifetime);
+	if (m_max_sessions > 0) {
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+		SSL_CTX_sess_set_new_cb(ctx, &TLSSessionCache::newSession);
+		SSL_CTX_sess_set_get_cb(ctx, &TLSSessionCache::getSession);
+		SSL_CTX_sess_set_remove_cb(ctx, &TLSSessionCache::removeSession);
+	} else {
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &TLSSessionCache::ticketKey);
+#else
+	SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TLSSessionCache::ticketKey);
+#endif
+}
+
+void TLSSessionCache::startRotation(boost::asio::io_service& io_service)
+{
+	m_rotation_timer.reset(new boost::asio::deadline_timer(io_service));
+	armRotation();
+}
+
+void TLSSessionCache::stopRotation(void)
+{
+	if (m_rotation_timer) m_rotation_timer->cancel();
+}
+
+void TLSSessionCache::armRotation(void)
+{
+	m_rotation_timer->expires_from_now(boost::posix_time::seconds(m_lifetime));
+	m_rotation_timer->async_wait(boost::bind(&TLSSessionCache::rotate, boost::weak_ptr<TLSSessionCache>(shared_from_this()), _1));
+}
+
+void TLSSessionCache::rotate(boost::weak_ptr<TLSSessionCache> weak_self, boost::system::error_code const& ec)
+{
+	if (ec == boost::asio::error::operation_aborted) return;
+	TLSSessionCachePtr self(weak_self.lock());
+	if (!self) return;
+	self->rotateKeys();
+	self->armRotation();
+}
+
+void TLSSessionCache::rotateKeys(void)
+{
+	ticket_key_t key;
+	if (!random_key(key.name, sizeof(key.name)) || !random_key(key.aes, sizeof(key.aes))
+		|| !random_key(key.hmac, sizeof(key.hmac))) {
+		WARNCLOG("Unable to generate TLS session ticket key, the current one is used for another period");
+		return;
+	}
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_keys[1] = m_keys[0];
+	m_keys[0] = key;
+	++m_rotations;
+}
+
+TLSSessionCache::stats_t TLSSessionCache::stats(void) const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	stats_t const st = { m_sessions.size(), m_full, m_resumed, m_failed, m_evicted, m_rotations };
+	return st;
+}
+
+TLSSessionCache* TLSSessionCache::fromContext(SSL_CTX* ctx)
+{
+	return static_cast<TLSSessionCache*>(SSL_CTX_get_ex_data(ctx, context_index()));
+}
+
+int TLSSessionCache::newSession(SSL* ssl, SSL_SESSION* session)
+{
+	TLSSessionCache* const self(fromContext(SSL_get_SSL_CTX(ssl)));
+#ifdef TLS1_3_VERSION
+	// TLS 1.3 session is resumed from its ticket, it is never looked up by id
+	if (SSL_version(ssl) == TLS1_3_VERSION && (SSL_get_options(ssl) & SSL_OP_NO_TICKET) == 0) return 0;
+#endif
+	unsigned int id_length(0);
+	unsigned char const* const id(SSL_SESSION_get_id(session, &id_length));
+	int const der_length(i2d_SSL_SESSION(session, 0));
+	if (!self || id_length == 0 || der_length <= 0) return 0;
+	std::string der(size_t(der_length), '\0');
+	unsigned char* der_ptr(reinterpret_cast<unsigned char*>(&der[0]));
+	i2d_SSL_SESSION(session, &der_ptr);
+	std::string const key(reinterpret_cast<char const*>(id), id_length);
+
+	boost::mutex::scoped_lock lock(self->m_mutex);
+	std::pair<SessionMap::iterator, bool> const inserted(self->m_sessions.insert(SessionMap::value_type(key, std::string())));
+	inserted.first->second.swap(der);
+	if (!inserted.second) return 0;
+	self->m_order.push_back(key);
+	while (self->m_sessions.size() > self->m_max_sessions && !self->m_order.empty()) {
+		if (self->m_sessions.erase(self->m_order.front()) > 0)
+			++self->m_evicted;
+		self->m_order.pop_front();
+	}
+	// ids of removed sessions are left in the order, drop them before it grows past the cache
+	if (self->m_order.size() > 2 * self->m_max_sessions) {
+		std::deque<std::string> order;
+		for (size_t i(0); i < self->m_order.size(); ++i) {
+			if (self->m_sessions.count(self->m_order[i]) > 0)
+				order.push_back(self->m_order[i]);
+		}
+		self->m_order.swap(order);
+	}
+	return 0; // session is not referenced by the cache
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+SSL_SESSION* TLSSessionCache::getSession(SSL* ssl, unsigned char* id, int id_length, int* copy)
+#else
+SSL_SESSION* TLSSessionCache::getSession(SSL* ssl, const unsigned char* id, int id_length, int* copy)
+#endif
+{
+	*copy = 0; // caller owns the returned session
+	TLSSessionCache* const self(fromContext(SSL_get_SSL_CTX(ssl)));
+	if (!self || id_length <= 0) return 0;
+	std::string der;
+	{
+		boost::mutex::scoped_lock lock(self->m_mutex);
+		SessionMap::const_iterator const it(self->m_sessions.find(std::string(reinterpret_cast<char const*>(id), size_t(id_length))));
+		if (it == self->m_sessions.end()) return 0;
+		der = it->second;
+	}
+	// OpenSSL checks whether the decoded session has expired
+	unsigned char const* der_ptr(reinterpret_cast<unsigned char const*>(der.data()));
+	return d2i_SSL_SESSION(0, &der_ptr, long(der.size()));
+}
+
+void TLSSessionCache::removeSession(SSL_CTX* ctx, SSL_SESSION* session)
+{
+	TLSSessionCache* const self(fromContext(ctx));
+	unsigned int id_length(0);
+	unsigned char const* const id(SSL_SESSION_get_id(session, &id_length));
+	if (!self || id_length == 0) return;
+	boost::mutex::scoped_lock lock(self->m_mutex);
+	self->m_sessions.erase(std::string(reinterpret_cast<char const*>(id), id_length));
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int TLSSessionCache::ticketKey(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc)
+#else
+int TLSSessionCache::ticketKey(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, HMAC_CTX* mac, int enc)
+#endif
+{
+	TLSSessionCache* const self(fromContext(SSL_get_SSL_CTX(ssl)));
+	if (!self) return -1;
+	ticket_key_t key;
+	int found(1); // 1 = new ticket or current key, 2 = decrypted and the ticket should be renewed
+	{
+		boost::mutex::scoped_lock lock(self->m_mutex);
+		if (enc) {
+			key = self->m_keys[0];
+		} else if (std::memcmp(name, self->m_keys[0].name, sizeof(key.name)) == 0) {
+			key = self->m_keys[0];
+#ifdef TLS1_3_VERSION
+			// TLS 1.3 resumption gets a new ticket only if renewed, clients use each ticket once
+			if (SSL_version(ssl) == TLS1_3_VERSION) found = 2;
+#endif
+		} else if (std::memcmp(name, self->m_keys[1].name, sizeof(key.name)) == 0) {
+			key = self->m_keys[1];
+			found = 2;
+		} else {
+			return 0; // unknown or expired key, full handshake follows
+		}
+	}
+	if (enc) {
+		std::memcpy(name, key.name, sizeof(key.name));
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) return -1;
+		if (EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), 0, key.aes, iv) != 1) return -1;
+	} else {
+		if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), 0, key.aes, iv) != 1) return -1;
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac, sizeof(key.hmac)),
+		OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+		OSSL_PARAM_construct_end()
+	};
+	if (EVP_MAC_CTX_set_params(mac, params) != 1) return -1;
+#else
+	if (HMAC_Init_ex(mac, key.hmac, sizeof(key.hmac), EVP_sha256(), 0) != 1) return -1;
+#endif
+	return found;
+}
+
+}
+}
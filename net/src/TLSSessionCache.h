@@ -0,0 +1,101 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+#include <deque>
+
+namespace scarlet {
+namespace net {
+
+class TLSSessionCache;
+typedef boost::shared_ptr<TLSSessionCache> TLSSessionCachePtr;
+
+/** TLSSessionCache: TLS session resumption shared by SSL contexts of all IO services. SO_REUSEPORT
+ * spreads reconnections of a client among IO services, so a cache or ticket key of one context
+ * would rarely resume a session. Sessions are kept serialized in one cache with a bound on their
+ * count, session tickets are encrypted with a key which is replaced every session lifetime and
+ * still accepted for one more lifetime, so a ticket never outlives two.
+ */
+class TLSSessionCache : public boost::enable_shared_from_this<TLSSessionCache> {
+	TLSSessionCache(TLSSessionCache const&) = delete;
+	void operator=(TLSSessionCache const&) = delete;
+	TLSSessionCache(size_t max_sessions, long lifetime);
+public:
+	enum { DEFAULT_MAX_SESSIONS = 20480 };
+	/// seconds a session can be resumed and a ticket key is used for new tickets
+	enum { DEFAULT_LIFETIME = 3600 };
+	struct stats_t {
+		size_t          sessions;///< in the cache
+		boost::uint64_t full;///< handshakes creating a new session
+		boost::uint64_t resumed;///< handshakes resuming a cached session or ticket
+		boost::uint64_t failed;
+		boost::uint64_t evicted;///< sessions dropped from the full cache
+		boost::uint64_t rotations;///< ticket keys replaced
+	};
+	/** @param max_sessions sessions in the cache, 0 leaves only tickets
+	 * @param lifetime seconds a session can be resumed
+	 */
+	static TLSSessionCachePtr create(size_t max_sessions, long lifetime);
+	/// makes ssl_context resume sessions from this cache and tickets with its keys
+	void attach(boost::asio::ssl::context& ssl_context);
+	/// starts replacing ticket keys on the IO service
+	void startRotation(boost::asio::io_service& io_service);
+	void stopRotation(void);
+	/// counts a finished server handshake
+	void handshake(bool resumed) { if (resumed) ++m_resumed; else ++m_full; }
+	void handshakeFailed(void) { ++m_failed; }
+	stats_t stats(void) const;
+private:
+	struct ticket_key_t {
+		unsigned char name[16];
+		unsigned char aes[32];
+		unsigned char hmac[32];
+	};
+	typedef boost::unordered_map<std::string, std::string> SessionMap;///< id -> DER encoded session
+	static void rotate(boost::weak_ptr<TLSSessionCache> weak_self, boost::system::error_code const& ec);
+	void armRotation(void);
+	/// replaces the current ticket key with a new random one, keeps it as the previous key
+	void rotateKeys(void);
+	/// OpenSSL callbacks, cache is found in ex_data of the SSL_CTX
+	static TLSSessionCache* fromContext(SSL_CTX* ctx);
+	static int newSession(SSL* ssl, SSL_SESSION* session);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	static SSL_SESSION* getSession(SSL* ssl, unsigned char* id, int id_length, int* copy);
+#else
+	static SSL_SESSION* getSession(SSL* ssl, const unsigned char* id, int id_length, int* copy);
+#endif
+	static void removeSession(SSL_CTX* ctx, SSL_SESSION* session);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	static int ticketKey(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc);
+#else
+	static int ticketKey(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, HMAC_CTX* mac, int enc);
+#endif
+	size_t const                   m_max_sessions;
+	long const                     m_lifetime;
+	mutable boost::mutex           m_mutex;
+	SessionMap                     m_sessions;
+	std::deque<std::string>        m_order;///< ids in the order of insertion, oldest is evicted first
+	ticket_key_t                   m_keys[2];///< current and previous ticket key
+	boost::scoped_ptr<boost::asio::deadline_timer> m_rotation_timer;
+	boost::atomic<boost::uint64_t> m_full;
+	boost::atomic<boost::uint64_t> m_resumed;
+	boost::atomic<boost::uint64_t> m_failed;
+	boost::atomic<boost::uint64_t> m_evicted;
+	boost::atomic<boost::uint64_t> m_rotations;
+};
+
+}
+}
+
+#endif // TLS_SESSION_CACHE_H
@@ -0,0 +1,103 @@
+#include "scarlet/net/TimingWheel.h"
+#include <boost/bind.hpp>
+#include <boost/asio/placeholders.hpp>
+
+namespace scarlet {
+namespace net {
+
+TimingWheel::TimingWheel(boost::asio::io_service& io_service)
+	: m_mutex()
+	, m_current(0)
+	, m_ticking(false)
+	, m_timer(io_service)
+	, m_next_tick()
+{
+	for (size_t i = 0; i < SLOTS; ++i)
+		m_slots[i].m_prev = m_slots[i].m_next = &m_slots[i];
+}
+
+TimingWheel::~TimingWheel()
+{
+	// owners of entries keep the wheel alive, still linked entries are only the heads
+	for (size_t i = 0; i < SLOTS; ++i) {
+		assert(m_slots[i].m_next == &m_slots[i]);
+		m_slots[i].m_prev = m_slots[i].m_next = 0;
+	}
+}
+
+void TimingWheel::start(void)
+{
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	if (m_ticking) return;
+	m_ticking = true;
+	m_next_tick = boost::asio::deadline_timer::traits_type::now();
+	armTick();
+}
+
+void TimingWheel::stop(void)
+{
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	m_ticking = false;
+	boost::system::error_code ec;
+	m_timer.cancel(ec);
+}
+
+void TimingWheel::schedule(Entry& entry, boost::uint32_t seconds)
+{
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	unlink(entry);
+	if (seconds == 0) return;
+	// the current slot is partially elapsed, one more tick makes sure entry doesn't expire early
+	boost::uint32_t const ticks(seconds * TICKS_PER_SECOND + 1);
+	Entry& head(m_slots[(m_current + ticks) % SLOTS]);
+	entry.m_rounds = (ticks - 1) / SLOTS;
+	entry.m_prev = head.m_prev;
+	entry.m_next = &head;
+	head.m_prev->m_next = &entry;
+	head.m_prev = &entry;
+}
+
+void TimingWheel::cancel(Entry& entry)
+{
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	unlink(entry);
+}
+
+void TimingWheel::unlink(Entry& entry)
+{
+	if (!entry.m_prev) return;
+	entry.m_prev->m_next = entry.m_next;
+	entry.m_next->m_prev = entry.m_prev;
+	entry.m_prev = entry.m_next = 0;
+}
+
+void TimingWheel::armTick(void)
+{
+	// assumes that the wheel lock has already been acquired
+	m_next_tick += boost::posix_time::milliseconds(long(1000 / TICKS_PER_SECOND));
+	m_timer.expires_at(m_next_tick);
+	m_timer.async_wait(boost::bind(&TimingWheel::handleTick, this, boost::asio::placeholders::error));
+}
+
+void TimingWheel::handleTick(boost::system::error_code const& ec)
+{
+	if (ec) return; // canceled
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	if (!m_ticking) return;
+	m_current = (m_current + 1) % SLOTS;
+	Entry& head(m_slots[m_current]);
+	for (Entry* e = head.m_next; e != &head; ) {
+		Entry* const next(e->m_next);
+		if (e->m_rounds > 0) {
+			--e->m_rounds;
+		} else {
+			unlink(*e);
+			e->m_expire();
+		}
+		e = next;
+	}
+	armTick();
+}
+
+}
+}
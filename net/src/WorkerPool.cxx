@@ -0,0 +1,99 @@
+#include "scarlet/net/WorkerPool.h"
+#include <bmu/Logger.h>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+
+namespace scarlet {
+namespace net {
+
+WorkerPool::WorkerPool(size_t num_threads, size_t max_pending)
+	: m_mutex()
+	, m_thread_pool(num_threads > 0 ? num_threads : 1)
+	, m_service()
+	, m_work()
+	, m_max_pending(max_pending > 0 ? max_pending : 1)
+	, m_pending(0)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::processWork(void)
+{
+	LOGMSG(" Entered storage worker loop");
+	m_service.run(); // jobs don't throw, see execute()
+	LOGMSG(" Exiting from storage worker loop");
+}
+
+void WorkerPool::start(void)
+{
+	boost::mutex::scoped_lock pool_lock(m_mutex);
+	LOGMSG("Starting storage workers");
+	if (!m_work) {
+		m_service.reset();
+		m_work = boost::make_shared<boost::asio::io_service::work>(m_service);
+		for (size_t n = 0; n < m_thread_pool.size(); ++n) {
+			m_thread_pool[n] = boost::make_shared<boost::thread>(boost::bind(&WorkerPool::processWork, this));
+		}
+	}
+}
+
+void WorkerPool::stop(void)
+{
+	LOGMSG("Shutting down storage workers");
+	boost::mutex::scoped_lock pool_lock(m_mutex);
+	if (m_work) {
+		m_work.reset();
+		m_service.stop();
+		pool_lock.unlock(); // running jobs may still call post()
+		boost::thread current_thread;
+		for (size_t n = 0; n < m_thread_pool.size(); ++n) {
+			if (m_thread_pool[n] && *m_thread_pool[n] != current_thread) {
+				m_thread_pool[n]->join();
+				m_thread_pool[n].reset();
+			}
+		}
+		pool_lock.lock();
+		m_pending = 0;
+	}
+	LOGMSG("The storage workers have shutdown");
+}
+
+bool WorkerPool::post(boost::function<void(void)> const& job)
+{
+	{
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		if (!m_work || m_pending >= m_max_pending)
+			return false;
+		++m_pending;
+	}
+	m_service.post(boost::bind(&WorkerPool::execute, this, job));
+	return true;
+}
+
+void WorkerPool::execute(boost::function<void(void)> const& job)
+{
+	try {
+		job();
+	}
+	catch (std::exception& e) {
+		LOGMSG(" Error from storage job " << e.what());
+	}
+	catch (...) {
+		LOGMSG(" Error from storage job " << "caught unrecognized exception");
+	}
+	boost::mutex::scoped_lock pool_lock(m_mutex);
+	--m_pending;
+}
+
+size_t WorkerPool::pending(void) const
+{
+	boost::mutex::scoped_lock pool_lock(m_mutex);
+	return m_pending;
+}
+
+}
+}
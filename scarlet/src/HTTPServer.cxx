@@ -1,6 +1,7 @@
 #include "HTTPServer.h"
 #include "SvcXcap.h"
 #include <scarlet/http/MsgReader.h>
+#include <scarlet/http/Pipeline.h>
 #include <scarlet/http/RequestHandler.h>
 #include <boost/make_shared.hpp>
 #include <boost/filesystem.hpp>
@@ -20,6 +21,7 @@ void HTTPServer::initialize(void)
     if(!ssl_filepath.empty()) {
 		scarlet::net::TCPServer::setSSLFlag(true);
 		scarlet::net::TCPServer::setSSLKeyFile(ssl_filepath);
+		scarlet::net::TCPServer::setSSLSessions(Options::instance().ssl_sessions(), long(Options::instance().ssl_session_lifetime()));
     }
     m_resources = Options::instance().xcap_roots();
     std::wclog << "Server configured for these XCAP root URIs:\n";
@@ -35,15 +37,89 @@ void HTTPServer::initialize(void)
     assert(!m_resources.empty());
 }
 
+std::string HTTPServer::find_xsd_dir(void)
+{
+	boost::filesystem::path xsddir;
+	boost::filesystem::path tmp;
+	tmp = boost::filesystem::path(Options::instance().topdir()) / Options::instance().subdir_xsd();
+	if (boost::filesystem::exists(tmp))
+		xsddir = tmp;
+	if (xsddir.empty()) {
+		tmp = boost::filesystem::path(Options::instance().topdir()) / ".." / Options::instance().subdir_xsd();
+		if (boost::filesystem::exists(tmp))
+			xsddir = tmp;
+	}
+	if (xsddir.empty()) {
+		tmp = boost::filesystem::path(Options::instance().startdir()) / Options::instance().subdir_xsd();
+		if (boost::filesystem::exists(tmp))
+			xsddir = tmp;
+	}
+	if (xsddir.empty()) {
+		tmp = boost::filesystem::path(Options::instance().startdir()) / ".." / Options::instance().subdir_xsd();
+		if (boost::filesystem::exists(tmp))
+			xsddir = tmp;
+	}
+
+	if (xsddir.empty()) {
+		std::wclog << "Fatal error, cannot locate XSD dir " << Options::instance().subdir_xsd() << " in search path.\n"
+			<< "Terminating server." << std::endl;
+		std::terminate();//(FATAL)
+	}
+
+	return boost::filesystem::system_complete(xsddir).string();
+}
+
 /** creates a new HTTPServer object
  * @param scheduler the WorkScheduler that will be used to manage worker threads
  * @param endpoint TCP endpoint used to listen for new connections (see ASIO docs)
  */
 HTTPServer::HTTPServer(const boost::asio::ip::tcp::endpoint& endpoint)
-    : TCPServer(endpoint, Options::instance().concurrency(), 8)
+    : TCPServer(endpoint, Options::instance().concurrency(), Options::instance().io_threads(), Options::instance().io_pinned())
     , m_max_content_length(scarlet::http::HTTPDefs::DEFAULT_MAX_BODY_SIZE)
+    , m_header_timeout(Options::instance().header_timeout())
+    , m_body_timeout(Options::instance().body_timeout())
+    , m_idle_timeout(Options::instance().idle_timeout())
+    , m_workers()
+    , m_reqhandler()
 {
     initialize();
+    setLimits(Options::instance().max_connections(), Options::instance().max_connections_per_ip()
+        , Options::instance().max_requests());
+    if (Options::instance().storage_workers() > 0) {
+        m_workers = boost::make_shared<scarlet::net::WorkerPool>(
+            Options::instance().storage_workers(), Options::instance().storage_workers_queue());
+    }
+	boost::shared_ptr<XcapResponseContext> xcacontext(boost::make_shared<XcapResponseContext>(
+		Options::instance().locale()
+		, find_xsd_dir()
+		, Options::instance().namespace_schema()
+		, Options::instance().domain()
+		, Options::instance().storage_backend()
+#if defined(WITH_BACKEND_POSTGRESQL)
+		, Options::instance().connect_options()
+#else
+		, std::string()
+#endif
+		, Options::instance().topdir()
+		, Options::instance().db_xtable()
+		, Options::instance().db_utable()
+		, Options::instance().db_pool_size()
+		, Options::instance().dom_cache_size()
+		));
+	// service and handler live as long as server, they are shared by all connections and threads
+	m_reqhandler = scarlet::http::RequestHandler::create(SvcXcap::create(m_resources, xcacontext), m_workers);
+}
+
+void HTTPServer::beforeStarting(void)
+{
+    if (m_workers) m_workers->start();
+    m_reqhandler->startMaintenance(getIOService());
+}
+
+void HTTPServer::afterStopping(void)
+{
+    m_reqhandler->stopMaintenance();
+    if (m_workers) m_workers->stop();
 }
 
 void HTTPServer::handleConnection(scarlet::net::TCPConnectionPtr tcp_conn)
@@ -57,6 +133,7 @@ void HTTPServer::handleConnection(scarlet::net::TCPConnectionPtr tcp_conn)
         , scarlet::http::MsgReader::READ_AS_REQUEST
         , m_max_content_length
     );
+    reader_ptr->setTimeouts(m_header_timeout, m_body_timeout, m_idle_timeout);
     DBGMSGAT("Starting reading");
 	reader_ptr->receive(); 
 	// receive() ne blokira, samo ce zadati da se poziva MsgReader::consumeBytes
@@ -74,57 +151,43 @@ void HTTPServer::handleRequest(scarlet::http::MsgParserPtr http_request, scarlet
 {
 	//TODO: naci resurs koji pocinje kombinacijom server:port koju izvadis iz http_request - get_requested_resource()
 	// ako postoji takav resurs koristi njemu dodijeljeni servis (handler) za obradu ovog request-a
-    DBGMSGAT("Creating XCAP response task");
-	static boost::filesystem::path xsddir;
-	if (xsddir.empty()) {
-		boost::filesystem::path tmp;
-		tmp = boost::filesystem::path(Options::instance().topdir()) / Options::instance().subdir_xsd();
-		if (boost::filesystem::exists(tmp))
-			xsddir = tmp;
-		if (xsddir.empty()) {
-			tmp = boost::filesystem::path(Options::instance().topdir()) / ".." / Options::instance().subdir_xsd();
-			if (boost::filesystem::exists(tmp))
-				xsddir = tmp;
-		}
-		if (xsddir.empty()) {
-			tmp = boost::filesystem::path(Options::instance().startdir()) / Options::instance().subdir_xsd();
-			if (boost::filesystem::exists(tmp))
-				xsddir = tmp;
-		}
-		if (xsddir.empty()) {
-			tmp = boost::filesystem::path(Options::instance().startdir()) / ".." / Options::instance().subdir_xsd();
-			if (boost::filesystem::exists(tmp))
-				xsddir = tmp;
-		}
-
-		if (xsddir.empty()) {
-			std::wclog << "Fatal error, cannot locate XSD dir " << Options::instance().subdir_xsd() << " in search path.\n"
-				<< "Terminating server." << std::endl;
-			std::terminate();//(FATAL)
-		}
+	if (m_workers && tcp_conn->getPipelined()) {
+		// naredni zahtjevi su vec u read bufferu, obradjuju se paralelno u workerima
+		handlePipelined(scarlet::http::Pipeline::create(tcp_conn, boost::bind(&HTTPServer::finishConnection, this, _1))
+			, http_request, tcp_conn);
+		return;
+	}
+	m_reqhandler->handleRequest(tcp_conn, boost::bind(&HTTPServer::finishConnection, this, _1), http_request);
+}
 
-		xsddir = boost::filesystem::system_complete(xsddir);
+void HTTPServer::handlePipelined(scarlet::http::PipelinePtr pipeline, scarlet::http::MsgParserPtr http_request
+	, scarlet::net::TCPConnectionPtr tcp_conn)
+{
+	pipeline->add(http_request, tcp_conn->getKeepAlive());
+	if (!tcp_conn->getPipelined() || pipeline->full()) {
+		dispatchPipelined(pipeline, tcp_conn);
+		return;
 	}
-	static boost::shared_ptr<XcapResponseContext> xcacontext(boost::make_shared<XcapResponseContext>(
-		Options::instance().locale()
-		, xsddir.string()
-		, Options::instance().namespace_schema()
-		, Options::instance().domain()
-		, Options::instance().storage_backend()
-#if defined(WITH_BACKEND_POSTGRESQL)
-		, Options::instance().connect_options()
-#else
-		, std::string()
-#endif
-		, Options::instance().topdir()
-		, Options::instance().db_xtable()
-		, Options::instance().db_utable()
-		));
+	// parsira se samo ono sto je u bufferu, socket se cita tek kad se posalju svi odzivi
+	scarlet::http::MsgReaderPtr reader_ptr(scarlet::http::MsgReader::create(
+		tcp_conn
+		, boost::bind(&HTTPServer::handlePipelined, this, pipeline, _1, _2)
+		, boost::bind(&HTTPServer::dispatchPipelined, this, pipeline, _1)
+		, scarlet::http::MsgReader::READ_AS_REQUEST
+		, m_max_content_length
+	));
+	reader_ptr->setBufferedOnly(true);
+	reader_ptr->receive();
+}
 
-	// try to handle the request
-	SvcXcapPtr xcasvc(SvcXcap::create(m_resources, xcacontext));
-	scarlet::http::RequestHandlerPtr reqhandler(scarlet::http::RequestHandler::create(xcasvc));
-	reqhandler->handleRequest(tcp_conn, boost::bind(&HTTPServer::finishConnection, this, _1), http_request);
+void HTTPServer::dispatchPipelined(scarlet::http::PipelinePtr pipeline, scarlet::net::TCPConnectionPtr tcp_conn)
+{
+	DBGMSGAT("Dispatching " << pipeline->size() << " pipelined requests");
+	pipeline->close(tcp_conn->getLifecycle());
+	for (size_t i = 0; i < pipeline->size(); ++i) {
+		m_reqhandler->handleRequest(tcp_conn, boost::bind(&scarlet::http::Pipeline::finished, pipeline, i, _1)
+			, pipeline->request(i), boost::bind(&scarlet::http::Pipeline::whenTurn, pipeline, i, _1));
+	}
 }
 
 }
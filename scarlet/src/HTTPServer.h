@@ -2,7 +2,9 @@
 #define SCARLET_HTTP_SERVER_H
 #include "Options.h"
 #include <scarlet/net/TCPServer.h>
+#include <scarlet/net/WorkerPool.h>
 #include <scarlet/http/HTTPDefs.h>
+#include <scarlet/http/RequestHandler.h>
 #include <string>
 
 namespace scarlet {
@@ -13,7 +15,16 @@ class HTTPServer : public net::TCPServer {
     std::vector<std::string> m_resources;
 	/// maximum length for HTTP request payload content
 	std::size_t m_max_content_length;
+	/// read timeouts of connections in seconds, see http::MsgReader::setTimeouts
+	unsigned m_header_timeout;
+	unsigned m_body_timeout;
+	unsigned m_idle_timeout;
+	/// threads processing storage requests, null if processed in network threads
+	net::WorkerPoolPtr m_workers;
+	/// handles requests of all connections, keeps authentication cache between requests
+	http::RequestHandlerPtr m_reqhandler;
 
+    static std::string find_xsd_dir(void);
     static std::string get_configured_ssl(void);
 	/** handles a new TCP connection
 	 * @param tcp_conn the new TCP connection to handle
@@ -24,7 +35,15 @@ class HTTPServer : public net::TCPServer {
 	 * @param tcp_conn TCP connection containing a new request
 	 */
 	void handleRequest(http::MsgParserPtr http_request, net::TCPConnectionPtr tcp_conn);
+	/// adds the request to the pipeline and parses the next one if it is already in the read buffer
+	void handlePipelined(http::PipelinePtr pipeline, http::MsgParserPtr http_request, net::TCPConnectionPtr tcp_conn);
+	/// hands all requests of the pipeline to workers, responses are sent in request order
+	void dispatchPipelined(http::PipelinePtr pipeline, net::TCPConnectionPtr tcp_conn);
     void initialize(void);
+	/// starts storage workers and authentication cache expiry
+	virtual void beforeStarting(void);
+	/// stops storage workers and authentication cache expiry
+	virtual void afterStopping(void);
 
 public:
 	/// default destructor
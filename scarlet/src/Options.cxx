@@ -19,12 +19,22 @@ using boost::program_options::command_line_parser;
 #define DEFAULT_OPTION_BASE_DIR boost::filesystem::current_path()
 #define DEFAULT_OPTION_CONFIG_NAME "scarlet.config"
 #define DEFAULT_OPTION_XSD_SUBDIR "xsd"
+#define DEFAULT_OPTION_DOM_CACHE_MB 64
 #define DEFAULT_OPTION_DOMAIN_NAME "localdomain"
 #define DEFAULT_OPTION_ROOT_URI "localhost"
 #define DEFAULT_OPTION_ROOT_URI_2 "127.0.0.1"
 #define DEFAULT_OPTION_DB_CONNECT_STRING "host=/tmp dbname=postgres"
 #define DEFAULT_OPTION_DB_XML_TABLE "xcaptree"
 #define DEFAULT_OPTION_DB_USER_TABLE "xcapusers"
+#define DEFAULT_OPTION_WORKERS_QUEUE 1024
+#define DEFAULT_OPTION_HEADER_TIMEOUT 10
+#define DEFAULT_OPTION_BODY_TIMEOUT 30
+#define DEFAULT_OPTION_IDLE_TIMEOUT 15
+#define DEFAULT_OPTION_MAX_CONNECTIONS 10000
+#define DEFAULT_OPTION_MAX_CONNECTIONS_PER_IP 256
+#define DEFAULT_OPTION_MAX_REQUESTS 2048
+#define DEFAULT_OPTION_SSL_SESSIONS 20480
+#define DEFAULT_OPTION_SSL_SESSION_LIFETIME 3600
 //#define DEFAULT_OPTION_STORAGE "filesystem"
 //#define DEFAULT_OPTION_STORAGE "postgresql"
 #define DEFAULT_OPTION_STORAGE "sqlite3"
@@ -39,22 +49,36 @@ Options& Options::instance(void)
 
 Options::Options(void)
  : _nthreads(std::max(1u, boost::thread::hardware_concurrency()))
+ , _io_threads(1)
+ , _io_pinned(true)
+ , _header_timeout(DEFAULT_OPTION_HEADER_TIMEOUT)
+ , _body_timeout(DEFAULT_OPTION_BODY_TIMEOUT)
+ , _idle_timeout(DEFAULT_OPTION_IDLE_TIMEOUT)
+ , _max_connections(DEFAULT_OPTION_MAX_CONNECTIONS)
+ , _max_connections_per_ip(DEFAULT_OPTION_MAX_CONNECTIONS_PER_IP)
+ , _max_requests(DEFAULT_OPTION_MAX_REQUESTS)
  , _locale(DEFAULT_OPTION_LOCALE)
  , _base_path(DEFAULT_OPTION_STORAGE_DIR.string())
  , _start_path(DEFAULT_OPTION_BASE_DIR.string())
  , _config_file((DEFAULT_OPTION_BASE_DIR / DEFAULT_OPTION_CONFIG_NAME).string())
  , _xsd_subdir(DEFAULT_OPTION_XSD_SUBDIR)
+ , _dom_cache_mb(DEFAULT_OPTION_DOM_CACHE_MB)
  , _disabled_services()
  , _nsxsd()
  , _domain(DEFAULT_OPTION_DOMAIN_NAME)
  , _xcap_roots()
  , _tcp_port(0)
  , _tcp_ssl_pem()
+ , _ssl_sessions(DEFAULT_OPTION_SSL_SESSIONS)
+ , _ssl_session_lifetime(DEFAULT_OPTION_SSL_SESSION_LIFETIME)
 #if defined(WITH_BACKEND_POSTGRESQL)
  , _connect_options(DEFAULT_OPTION_DB_CONNECT_STRING)
 #endif
  , _xtable(DEFAULT_OPTION_DB_XML_TABLE)
  , _utable(DEFAULT_OPTION_DB_USER_TABLE)
+ , _db_pool_size(0)
+ , _nworkers(WORKERS_UNSET)
+ , _workers_queue(DEFAULT_OPTION_WORKERS_QUEUE)
  , _storage(DEFAULT_OPTION_STORAGE)
 { 
 }
@@ -90,17 +114,30 @@ bool Options::reset(int argc, char** argv)
 
 	//IMPORTANT: after comma there must be only one letter otherwise fails assertion in newer boost versions.
     config.add_options()
-        ("threads-count,c", value(&_nthreads), "default threads count")
+        ("threads-count,c", value(&_nthreads), "default threads count, also number of IO services each with its own acceptor")
+        ("network.threads-per-service", value(&_io_threads), "threads running each IO service, 1 for thread per core")
+        ("network.pin-threads", value(&_io_pinned), "pin threads of each IO service to one CPU")
+        ("network.header-timeout", value(&_header_timeout), "seconds to wait for more of request line and headers, 0 to wait forever")
+        ("network.body-timeout", value(&_body_timeout), "seconds to wait for more of request body, 0 to wait forever")
+        ("network.idle-timeout", value(&_idle_timeout), "seconds kept alive connection waits for the next request, 0 to wait forever")
+        ("network.max-connections", value(&_max_connections), "open connections, accepting pauses at this many, 0 for no limit")
+        ("network.max-connections-per-ip", value(&_max_connections_per_ip), "open connections from one client address, 0 for no limit")
+        ("network.max-requests", value(&_max_requests), "requests in flight, more get 503 with Retry-After, 0 for no limit")
         ("locale,l", value(&_locale), "Localization of XML documents for XML backend")
         ("base-dir,b", value(&_base_path), "server's root path (top directory)")
         ("xmlparser.xsd-subdir,x", value(&_xsd_subdir), "subdirectory under root where XML Schemas are stored (*.xsd)")
+        ("xmlparser.dom-cache-mb", value(&_dom_cache_mb), "memory budget in MB for cached DOM trees of stored documents, 0 disables cache")
         ("domain,d", value(&_domain), "name of default domain which Scarlet serves")
         ("port,p", value(&_tcp_port), "TCP port for Scarlet server")
         ("ssl-pem-file", value(&_tcp_ssl_pem), "use secure TCP connections with this certificate in Scarlet server")
+        ("ssl.session-cache", value(&_ssl_sessions), "SSL sessions cached for resumption by all IO services, 0 to resume only from session tickets")
+        ("ssl.session-lifetime", value(&_ssl_session_lifetime), "seconds an SSL session can be resumed, also period of session ticket key rotation, 0 disables resumption")
 #if defined(WITH_BACKEND_POSTGRESQL)
 		("database.connect-options,o", value(&_connect_options), "database connection string, database name, username, password etc.")
 #endif
         ("storage,s", value(&_storage), "storage backend for Scarlet services")
+        ("storage.workers", value(&_nworkers), "threads processing storage requests, 0 to process them in network threads, default threads-count")
+        ("storage.workers-queue", value(&_workers_queue), "maximum queued storage requests, over it server responds 503")
         ("disable-service,n", value(&_disabled_services)->composing(), "don't start this services")
         ("xcap-root,r", value(&_xcap_roots)->composing(), "XCAP root URIs (server resources)")
         ;
@@ -108,6 +145,7 @@ bool Options::reset(int argc, char** argv)
     config_only.add_options()
         ("database.table-xml", value(&_xtable), "name of table in database which Scarlet serves")
         ("database.table-users", value(&_utable), "name of table in database whith users")
+        ("database.pool-size", value(&_db_pool_size), "number of pooled database connections, 0 for threads-count")
         ("xmlparser.schema.http://www.w3.org/XML/1998/namespace"
             , value(&_nsxsd["http://www.w3.org/XML/1998/namespace"]))
         ("xmlparser.schema.urn:ietf:params:xml:ns:xcap-error"
@@ -7,43 +7,73 @@ namespace scarlet {
 
 class Options {
     size_t                              _nthreads;
+    size_t                              _io_threads;//threads of each IO service
+    bool                                _io_pinned;
+    unsigned                            _header_timeout;//seconds
+    unsigned                            _body_timeout;
+    unsigned                            _idle_timeout;
+    size_t                              _max_connections;//of whole server, 0 unlimited
+    size_t                              _max_connections_per_ip;
+    size_t                              _max_requests;//in flight
     std::string                         _locale;//en_US
     std::string                         _base_path;
 	std::string                         _start_path;
 	std::string                         _config_file;
     std::string                         _xsd_subdir;
+    size_t                              _dom_cache_mb;
     std::vector<std::string>            _disabled_services;
     std::map<std::string, std::string>  _nsxsd;
     std::string                         _domain;
     std::vector<std::string>            _xcap_roots;
 	unsigned short                      _tcp_port;
     std::string                         _tcp_ssl_pem;
+    size_t                              _ssl_sessions;//cached, 0 means only tickets
+    unsigned                            _ssl_session_lifetime;//0 disables resumption
 #if defined(WITH_BACKEND_POSTGRESQL)
 	std::string                         _connect_options;
 #endif
     std::string                         _xtable;
     std::string                         _utable;
+    size_t                              _db_pool_size;//0 means same as _nthreads
+    size_t                              _nworkers;//0 means processing in network threads, WORKERS_UNSET same as _nthreads
+    size_t                              _workers_queue;
     std::string                         _storage;
 
+    enum { WORKERS_UNSET = ~size_t(0) };
+
     Options(void);
 
 public:
     size_t concurrency(void) const { return _nthreads; }
+    size_t io_threads(void) const { return _io_threads; }
+    bool io_pinned(void) const { return _io_pinned; }
+    unsigned header_timeout(void) const { return _header_timeout; }
+    unsigned body_timeout(void) const { return _body_timeout; }
+    unsigned idle_timeout(void) const { return _idle_timeout; }
+    size_t max_connections(void) const { return _max_connections; }
+    size_t max_connections_per_ip(void) const { return _max_connections_per_ip; }
+    size_t max_requests(void) const { return _max_requests; }
     std::string const& locale(void) const { return _locale; }
 	std::string const& topdir(void) const { return _base_path; }
 	std::string const& startdir(void) const { return _start_path; } // executable location
 	std::string const& subdir_xsd(void) const { return _xsd_subdir; }
+    size_t dom_cache_size(void) const { return _dom_cache_mb * 1024 * 1024; } // bytes
     std::vector<std::string> const& disabled_services(void) const { return _disabled_services; }
     std::map<std::string, std::string> const& namespace_schema(void) const { return _nsxsd; }
     std::string const& domain(void) const { return _domain; }
     std::vector<std::string> const& xcap_roots(void) const { return _xcap_roots; }
     unsigned short port(void) const { return _tcp_port; }
     std::string const& ssl_pem(void) const { return _tcp_ssl_pem; }
+    size_t ssl_sessions(void) const { return _ssl_sessions; }
+    unsigned ssl_session_lifetime(void) const { return _ssl_session_lifetime; }
 #if defined(WITH_BACKEND_POSTGRESQL)
 	std::string const& connect_options(void) const { return _connect_options; }
 #endif
     std::string const& db_xtable(void) const { return _xtable; }
     std::string const& db_utable(void) const { return _utable; }
+    size_t db_pool_size(void) const { return _db_pool_size ? _db_pool_size : _nthreads; }
+    size_t storage_workers(void) const { return _nworkers != size_t(WORKERS_UNSET) ? _nworkers : _nthreads; }
+    size_t storage_workers_queue(void) const { return _workers_queue; }
     std::string const& storage_backend(void) const { return _storage; }
     ///\return false ako se trazio help (ne treba nastavljati izvrsavanje programa)
     bool reset(int argc, char** argv);
@@ -4,27 +4,36 @@
 #include "scarlet/xcap/XCAccess.h"
 #include "scarlet/xcap/XCAccessMgr.h"
 #include "scarlet/xcap/URIParser.h"
+#include "scarlet/xcap/DocumentCache.h"
+#include "scarlet/xml/XMLBase.h"
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 
 boost::thread_specific_ptr<scarlet::xcap::XCAccessMgr> XcapResponseContext::amgr;
 boost::thread_specific_ptr<scarlet::xcap::URIParser>   XcapResponseContext::xuriparser;
 boost::shared_ptr<scarlet::xcap::Storage>              XcapResponseContext::storage;
+boost::shared_ptr<scarlet::xcap::DocumentCache>        XcapResponseContext::doccache;
 
 XcapResponseContext::XcapResponseContext(std::string const& locale, std::string const& xsd_dir
 	, std::map<std::string, std::string> const& xsdmap, std::string const& default_domain
 	, std::string const& bkend, std::string const& db_options, std::string const& storage_dir
-	, std::string const& db_xtable, std::string const& db_utable)
+	, std::string const& db_xtable, std::string const& db_utable, size_t db_pool_size
+	, size_t dom_cache_size)
 	: locale(locale)
 	, xsd_dir(xsd_dir)
 	, xsdmap(xsdmap)
 	, default_domain(default_domain)
+	, xerces_scope(scarlet::xml::XercesScope::create(locale))
+	, grammars(scarlet::xml::XMLGrammars::create(xerces_scope, xsdmap, xsd_dir))
 {
 	//Allow only one instance of this type
 	BOOST_ASSERT(!amgr.get());
 	BOOST_ASSERT(!xuriparser.get());
 	BOOST_ASSERT(!storage);
-	XcapResponseContext::storage = XcapResponseContext::create_storage(bkend, db_options, storage_dir, db_xtable, db_utable);
+	BOOST_ASSERT(!doccache);
+	XcapResponseContext::storage = XcapResponseContext::create_storage(bkend, db_options, storage_dir, db_xtable, db_utable, db_pool_size);
+	if (dom_cache_size > 0)
+		XcapResponseContext::doccache = boost::make_shared<scarlet::xcap::DocumentCache>(dom_cache_size);
 }
 
 boost::shared_ptr<scarlet::xcap::Storage> XcapResponseContext::getStorage(void) const
@@ -35,7 +44,7 @@ boost::shared_ptr<scarlet::xcap::Storage> XcapResponseContext::getStorage(void)
 boost::thread_specific_ptr<scarlet::xcap::XCAccessMgr> const& XcapResponseContext::getManager(void)
 { 
 	if (!amgr.get()) // thread specific instance
-		amgr.reset(new scarlet::xcap::XCAccessMgr(locale, xsd_dir, xsdmap, default_domain, storage));
+		amgr.reset(new scarlet::xcap::XCAccessMgr(locale, xsd_dir, xsdmap, default_domain, storage, doccache));
 	return amgr;
 }
 
@@ -47,7 +56,8 @@ boost::thread_specific_ptr<scarlet::xcap::URIParser> const& XcapResponseContext:
 }
 
 boost::shared_ptr<scarlet::xcap::Storage> XcapResponseContext::create_storage(
-	std::string const& bkend, std::string const& db_options, std::string const& storage_dir, std::string const& db_xtable, std::string const& db_utable)
+	std::string const& bkend, std::string const& db_options, std::string const& storage_dir, std::string const& db_xtable, std::string const& db_utable
+	, size_t db_pool_size)
 {
 	try {
 		if (bkend.empty() || bkend == "filesystem")
@@ -56,12 +66,12 @@ boost::shared_ptr<scarlet::xcap::Storage> XcapResponseContext::create_storage(
 #if defined(WITH_BACKEND_POSTGRESQL)
 		else if (bkend == "postgresql")
 			return boost::shared_ptr<scarlet::xcap::Storage>(
-				new scarlet::xcap::StoragePostgreSql(db_options)); //("host=/tmp dbname=postgres");
+				new scarlet::xcap::StoragePostgreSql(db_options, db_xtable, db_utable, db_pool_size)); //("host=/tmp dbname=postgres");
 #endif
 #if defined(WITH_BACKEND_SQLITE3)
 		else if (bkend == "sqlite3")
 			return boost::shared_ptr<scarlet::xcap::Storage>(
-				new scarlet::xcap::StorageSqlite3(boost::filesystem::system_complete(storage_dir) / "xca.sqlite", db_xtable, db_utable));
+				new scarlet::xcap::StorageSqlite3(boost::filesystem::system_complete(storage_dir) / "xca.sqlite", db_xtable, db_utable, db_pool_size));
 #endif
 		std::wclog << "Fatal error, unknown storage backend type " << bkend << "\n"
 			<< "Expecting one of values: filesystem, posgresql or sqlite3.\n"
@@ -179,6 +189,7 @@ private:
 	std::string& reEtagOut(void) { return rsp->etag; }
 	std::string& reMimeOut(void) { return rsp->mime; }
 	std::map<std::string, std::string>& reExtraHeadersOut(void) { return rsp->extra_hdrs; }
+	bool reBodyWriter(body_writer_t const& writer) { rsp->body_writer = writer; return true; }
 
 	boost::shared_ptr<xcarequest_t>                  req;
 	boost::shared_ptr<scarlet::http::httpresponse_t> rsp;
@@ -8,6 +8,7 @@ namespace scarlet {
 namespace xcap {
 class XCAccessMgr;
 class URIParser;
+class DocumentCache;
 }
 }
 
@@ -18,21 +19,25 @@ public:
 	XcapResponseContext(std::string const& locale, std::string const& xsd_dir
 		, std::map<std::string, std::string> const& xsdmap, std::string const& default_domain
 		, std::string const& bkend, std::string const& db_options, std::string const& storage_dir
-		, std::string const& db_xtable, std::string const& db_utable);
+		, std::string const& db_xtable, std::string const& db_utable, size_t db_pool_size
+		, size_t dom_cache_size);
 	boost::shared_ptr<scarlet::xcap::Storage> getStorage(void) const;
 	boost::thread_specific_ptr<scarlet::xcap::XCAccessMgr> const& getManager(void);
 	boost::thread_specific_ptr<scarlet::xcap::URIParser> const& getURIParser(void);
 private:
 	static boost::shared_ptr<scarlet::xcap::Storage> create_storage(
 		std::string const& bkend, std::string const& db_options, std::string const& storage_dir
-		, std::string const& db_xtable, std::string const& db_utable);
+		, std::string const& db_xtable, std::string const& db_utable, size_t db_pool_size);
 	std::string const                        locale;
 	std::string const                        xsd_dir;
 	std::map<std::string, std::string> const xsdmap;
 	std::string const                        default_domain;
+	scarlet::xml::XercesScopePtr const       xerces_scope;
+	scarlet::xml::XMLGrammarsPtr const       grammars; // shared by parsers in all threads
 	static boost::thread_specific_ptr<scarlet::xcap::XCAccessMgr> amgr;
 	static boost::thread_specific_ptr<scarlet::xcap::URIParser>   xuriparser;
 	static boost::shared_ptr<scarlet::xcap::Storage>              storage;
+	static boost::shared_ptr<scarlet::xcap::DocumentCache>        doccache;
 };
 
 class SvcXcap;
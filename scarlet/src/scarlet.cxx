@@ -1,10 +1,14 @@
 #include "Options.h"
 #include <bmu/Logger.h>
 #include "HTTPServer.h"
+#include <scarlet/net/ListenerHandoff.h>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
 #ifndef WIN32
 #   include <signal.h>
+#   include <unistd.h>
+#   include <fcntl.h>
+#   include <cerrno>
 #endif
 
 #if defined(_MSC_VER) && _MSC_VER>=19
@@ -51,6 +55,7 @@ extern "C" FILE * __cdecl __iob_func(void)
 /// ShutdownManager: used to manage shutdown for the main thread
 class ShutdownManager {
 public:
+#ifdef WIN32
 	// default constructor & destructor
 	ShutdownManager(void) : m_shutdown_now(false) {}
 	~ShutdownManager() {}
@@ -62,17 +67,63 @@ public:
 		m_shutdown_cond.notify_all();
 	}
 
-	/// blocks until the shutdown condition has been signaled
-	inline void wait(void) {
+	/** blocks until the shutdown condition has been signaled
+	 * @return always false, upgrade is not supported
+	 */
+	inline bool wait(void) {
 		boost::mutex::scoped_lock shutdown_lock(m_shutdown_mutex);
 		while (!m_shutdown_now)
 			m_shutdown_cond.wait(shutdown_lock);
+		return false;
 	}
 
 private:
 	bool					m_shutdown_now;
 	boost::mutex			m_shutdown_mutex;
 	boost::condition		m_shutdown_cond;
+#else
+	/// events written by signal handlers to the self-pipe
+	enum { SHUTDOWN = 's', UPGRADE = 'u' };
+	ShutdownManager(void) { m_pipe[0] = m_pipe[1] = -1; }
+	~ShutdownManager() {}
+
+	/// creates the self-pipe, must be called before signal handlers are installed
+	inline bool open(void) {
+		if (::pipe(m_pipe) != 0) return false;
+		// full pipe must not block signal handler, new process must not inherit it
+		::fcntl(m_pipe[1], F_SETFL, ::fcntl(m_pipe[1], F_GETFL) | O_NONBLOCK);
+		::fcntl(m_pipe[0], F_SETFD, FD_CLOEXEC);
+		::fcntl(m_pipe[1], F_SETFD, FD_CLOEXEC);
+		return true;
+	}
+
+	/// signals shutdown or upgrade, async-signal-safe so it is called from signal handlers
+	inline void notify(char event) {
+		int const saved_errno(errno);
+		ssize_t const written(::write(m_pipe[1], &event, 1));
+		(void)written; // pipe full means that events are already waiting
+		errno = saved_errno;
+	}
+
+	/** blocks until the shutdown or upgrade has been signaled
+	 * @return true for upgrade, it is signaled again by the next upgrade
+	 */
+	inline bool wait(void) {
+		for (;;) {
+			char event;
+			ssize_t const n(::read(m_pipe[0], &event, 1));
+			if (n == 1) {
+				std::wclog << (event == UPGRADE ? "upgrade detected posix" : "ctrl detected posix") << std::endl;
+				return event == UPGRADE;
+			}
+			if (n < 0 && errno == EINTR) continue;
+			return false; // self-pipe failed, leave
+		}
+	}
+
+private:
+	int						m_pipe[2];
+#endif
 };
 
 /// static shutdown manager instance used to control shutdown of main()
@@ -97,8 +148,12 @@ BOOL WINAPI console_ctrl_handler(DWORD ctrl_type)
 #else
 void handle_signal(int sig)
 {
-	std::wclog << "ctrl detected posix" << std::endl;
-	main_shutdown_manager.shutdown();
+	main_shutdown_manager.notify(ShutdownManager::SHUTDOWN);
+}
+
+void handle_upgrade_signal(int sig)
+{
+	main_shutdown_manager.notify(ShutdownManager::UPGRADE);
 }
 #endif
 
@@ -120,7 +175,12 @@ int main(int argc, char* argv[])
 #ifdef WIN32
 	::SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
 #else
+	if (!main_shutdown_manager.open()) {
+		std::wcerr << "Unable to create pipe for signals" << std::endl;
+		return 1;
+	}
 	::signal(SIGINT, handle_signal);
+	::signal(SIGUSR2, handle_upgrade_signal);
 #endif
 
 	try {
@@ -135,8 +195,23 @@ int main(int argc, char* argv[])
 		//TODO: iz config procitaj (IP:PORT, resource/xcap_domain) parove pa inicijalizuj
 		// poseban ioservice za svaki IP:PORT
 		scarlet::HTTPServer server(tcp::endpoint(tcp::v4(), get_configured_port()));
+		// started by upgrade of a running server, listen on its sockets
+		int const handoff(scarlet::net::ListenerHandoff::inherited());
+		if (handoff >= 0)
+			server.adoptListeningSockets(scarlet::net::ListenerHandoff::receive(handoff));
 		server.start();
-		main_shutdown_manager.wait();
+		if (handoff >= 0)
+			scarlet::net::ListenerHandoff::ready(handoff);
+		// on SIGUSR2 new process takes over listening sockets, this one stops accepting and
+		// waits for its connections to finish while leaving
+		while (main_shutdown_manager.wait()) {
+			std::wclog << "Passing listening sockets to a new process" << std::endl;
+			if (scarlet::net::ListenerHandoff::spawn(argv, server.getListeningSockets())) {
+				std::wclog << "New process is listening, finishing connections" << std::endl;
+				break;
+			}
+			std::wclog << "New process failed, server keeps running" << std::endl;
+		}
 	}
 	catch (...) {
 		std::wclog << "Exception encountered in server" << std::endl;
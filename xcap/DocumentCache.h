@@ -0,0 +1,107 @@
+#ifndef SCARLET_XCAP_DOCUMENT_CACHE_H
+#define SCARLET_XCAP_DOCUMENT_CACHE_H
+#include "scarlet/xcap/xcadefs.h"
+#include "scarlet/xml/XMLSelect.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+#include <list>
+
+namespace XERCES_CPP_NAMESPACE {
+class DOMDocument;
+}
+
+namespace scarlet {
+namespace xcap {
+
+/** LRU cache of schema validated DOM trees of stored documents shared by all threads. Entry is
+  identified by document (domain, auid, xui, docname) and is valid only for one etag, so lookup
+  with etag just read from storage never returns stale tree. Memory budget is estimated from
+  size of serialized document, growth of attribute index is added with grow().
+ */
+class DocumentCache : public boost::noncopyable {
+public:
+    /** cached tree, DOM is not thread safe so lock mutex while using doc or index. Index of
+     * attribute predicates is built lazily by selections on doc, new version of document gets
+     * new entry with empty index.
+     */
+    struct entry_t {
+        boost::shared_ptr<xercesc::DOMDocument> const doc;
+        boost::mutex                                  mutex;
+        xml::AttributeIndex                           index;
+        explicit entry_t(boost::shared_ptr<xercesc::DOMDocument> const& doc) : doc(doc), mutex(), index() { }
+    };
+    typedef boost::shared_ptr<entry_t> entry_ptr;
+
+    struct stats_t {
+        size_t          entries;
+        size_t          used;      ///< estimated bytes of all cached trees and their indexes
+        size_t          budget;
+        boost::uint64_t hits;
+        boost::uint64_t misses;
+        boost::uint64_t evictions;
+    };
+
+    /// @return null if document with etag is not cached
+    entry_ptr find(document_selector_t const& uri, std::string const& domain, std::string const& etag);
+
+    /** caches tree of document version etag, replaces any other version of same document
+     * @param xml_size size of serialized document, base for memory estimate
+     */
+    entry_ptr insert(
+        document_selector_t const& uri
+        , std::string const& domain
+        , std::string const& etag
+        , boost::shared_ptr<xercesc::DOMDocument> const& doc
+        , size_t xml_size
+    );
+
+    /** adds bytes to estimated memory of cached version etag, e.g. after its index grew, and
+     * evicts least recently used documents if over budget
+     */
+    void grow(
+        document_selector_t const& uri
+        , std::string const& domain
+        , std::string const& etag
+        , size_t bytes
+    );
+
+    /// removes any version of document
+    void invalidate(document_selector_t const& uri, std::string const& domain);
+
+    stats_t stats(void) const;
+
+    /// @param budget estimated memory in bytes which cached trees may take
+    explicit DocumentCache(size_t budget);
+
+private:
+    /// rough ratio of DOM tree memory to size of serialized XML
+    enum { DOM_BYTES_PER_XML_BYTE = 4 };
+
+    typedef std::list<std::string> lru_list_t;
+    struct slot_t {
+        std::string          etag;
+        entry_ptr            entry;
+        size_t               cost;
+        lru_list_t::iterator lru;
+    };
+    typedef boost::unordered_map<std::string, slot_t> slots_map_t;
+
+    static std::string make_key(document_selector_t const& uri, std::string const& domain);
+    void erase(slots_map_t::iterator it);
+
+    mutable boost::mutex m_mutex;
+    size_t const         m_budget;
+    size_t               m_used;
+    lru_list_t           m_lru;//front je zadnji koristeni
+    slots_map_t          m_slots;
+    boost::uint64_t      m_hits;
+    boost::uint64_t      m_misses;
+    boost::uint64_t      m_evictions;
+};
+
+}
+}
+#endif // SCARLET_XCAP_DOCUMENT_CACHE_H
@@ -1,10 +1,22 @@
 #include <scarlet/xcap/xcadefs.h>
 #include <boost/filesystem/operations.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/cstdint.hpp>
 
 namespace scarlet {
 namespace xcap {
 
+/// Connection pool counters of database backends
+struct storage_pool_stats_t {
+    size_t          size;          ///< number of pooled connections
+    size_t          in_use;        ///< connections checked out at the moment
+    size_t          peak_in_use;   ///< maximum of in_use since start
+    boost::uint64_t checkouts;     ///< total number of checkouts
+    boost::uint64_t contended;     ///< checkouts which had to wait for free connection
+    boost::uint64_t wait_usec;     ///< total time spent waiting for free connection
+    boost::uint64_t max_wait_usec; ///< longest single wait for free connection
+};
+
 struct Storage {
     virtual int get(
         u8vector_t& doc
@@ -63,7 +75,9 @@ public:
 
     int user(std::string& digest, std::string const& username);
 
-    StoragePostgreSql(std::string const& options, std::string const& db_xtable, std::string const& db_utable);
+    storage_pool_stats_t pool_stats(void) const;
+
+    StoragePostgreSql(std::string const& options, std::string const& db_xtable, std::string const& db_utable, size_t pool_size = 1);
 
     ~StoragePostgreSql();
 };
@@ -99,7 +113,9 @@ public:
 
 	int user(std::string& digest, std::string const& username);
 
-	StorageSqlite3(boost::filesystem::path const& dbpath, std::string const& db_xtable /*Options::instance().db_xtable()*/, std::string const& db_utable /*Options::instance().db_utable()*/);
+	storage_pool_stats_t pool_stats(void) const;
+
+	StorageSqlite3(boost::filesystem::path const& dbpath, std::string const& db_xtable /*Options::instance().db_xtable()*/, std::string const& db_utable /*Options::instance().db_utable()*/, size_t pool_size = 1 /*Options::instance().db_pool_size()*/);
 
 	~StorageSqlite3();
 };
@@ -3,6 +3,7 @@
 
 #include "scarlet/xcap/XMLEngine.h"
 #include "scarlet/xcap/xcadefs.h"
+#include "scarlet/xcap/DocumentCache.h"
 
 namespace scarlet {
 namespace xcap {
@@ -77,6 +78,12 @@ struct xcacontext_t {
 	virtual void reMime(std::string const& mime) { reMimeOut() = mime; }
 	virtual std::string& reMimeOut() = 0;
 	virtual std::map<std::string, std::string>& reExtraHeadersOut(void) = 0;
+	/// pise citavo tijelo odziva u sink, false ako nije uspjelo
+	typedef boost::function<bool (xml::u8sink_t const&)> body_writer_t;
+	/** tijelo odziva ce formirati writer tek kad se odziv salje, u istom threadu
+	  @return false ako context to ne podrzava, tijelo tada treba upisati u reBodyOut()
+	 */
+	virtual bool reBodyWriter(body_writer_t const& /*writer*/) { return false; }
 };
 
 class XCAccess : protected XMLMethods {
@@ -84,6 +91,7 @@ class XCAccess : protected XMLMethods {
     //xcap_applications_e const _type;
     app_usage_t  app_info;
     boost::shared_ptr<Storage> storage;
+    boost::shared_ptr<DocumentCache> doccache;
 
     explicit XCAccess(void); //NE
 
@@ -128,7 +136,26 @@ protected:
         WRITE_ACCESS
     };
 
-    u8vector_t xml_invalid_error(void) const;
+    u8vector_t xml_invalid_error(xml::xml_validity_e validity, std::vector<std::string> const& xml_msg) const;
+
+    /** DOM stablo dokumenta iz storage, iz kesa ako je tu ta verzija (etag) dokumenta,
+      inace parsira i validira doc i stavlja ga u kes. Null ako kes nije postavljen.
+     */
+    DocumentCache::entry_ptr stored_tree(
+        u8vector_t const& doc
+        , std::string const& etag
+        , xcapuri_t const& rquri
+        , std::string const& domain
+    ) const;
+
+    /// azurira kes nakon upisa nove verzije dokumenta, xr_doc je null ako dokument vise ne postoji
+    void stored_changed(
+        xcapuri_t const& rquri
+        , std::string const& domain
+        , std::string const& etag
+        , doctree_ptr const& xr_doc
+        , size_t xml_size
+    ) const;
 
     virtual bool authorized(
         std::string const& username
@@ -156,6 +183,7 @@ public:
 
     //static Storage& storage(void);
     void set(boost::shared_ptr<Storage> strg);
+    void set(boost::shared_ptr<DocumentCache> cache);
 
     virtual ~XCAccess() { }
 };
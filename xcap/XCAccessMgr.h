@@ -11,6 +11,7 @@ namespace xcap {
 
 class XCAccess;
 struct Storage;
+class DocumentCache;
 
 
 // u jednoj niti dovoljna je samo po jedna instanca svake od aplikacija jer se
@@ -25,7 +26,8 @@ public:
 
     boost::shared_ptr<XCAccess> find(std::string const& auid) const;
 
-    XCAccessMgr(std::string const& locale, std::string const& xsd_dir, std::map<std::string, std::string> const& xsdmap, std::string const& default_domain, boost::shared_ptr<Storage> storage);
+    XCAccessMgr(std::string const& locale, std::string const& xsd_dir, std::map<std::string, std::string> const& xsdmap, std::string const& default_domain, boost::shared_ptr<Storage> storage
+        , boost::shared_ptr<DocumentCache> doccache = boost::shared_ptr<DocumentCache>());
 };
 
 }
@@ -20,6 +20,7 @@ class XMLTree;
 class XMLFragment;
 class XMLSubtree;
 class XMLSelect;
+class AttributeIndex;
 }
 
 namespace xcap {
@@ -32,6 +33,11 @@ class XMLEngine {
     XMLEngine& operator=(XMLEngine const&) = delete; //NE
 public:
     doctree_ptr parse(u8unit_t const* xml_str, size_t xml_str_size) const;
+    /** Za dokument iz storage koji je upisan sa serialize_stored, provjerava samo da li je
+        well-formed. Baca invalid_stored_document ako nije jer je tada potrebna intervencija
+        administratora baze.
+     */
+    doctree_ptr parse_stored(u8vector_t const& doc) const;
     xml::xml_validity_e document_validity(void) const;
     xml::xml_validity_e fragment_validity(void) const;
     std::vector<std::string> const& document_errors(void) const;
@@ -40,6 +46,13 @@ public:
     //Samo jedinstveni cvor
     void serialize(u8vector_t& xml_out, xml::XMLSelect const& r) const;
     void serialize(u8vector_t& xml_out, doctree_ptr const& xr_doc) const;
+    /** Serijalizacija validiranog stabla za upis u storage, sa atributima koje je dodala validacija
+        (default vrijednosti) i vrijednostima normalizovanim prema semi, pa parse_stored bez
+        validacije daje isto stablo kao parse.
+     */
+    void serialize_stored(u8vector_t& xml_out, doctree_ptr const& xr_doc) const;
+    //XML cvora se predaje u out kako nastaje
+    bool serialize(xml::u8sink_t const& xml_out, xercesc::DOMNode const* xr_node) const;
     docsubtree_ptr parse(doctree_ptr const& xr_doc, u8unit_t const* part
 		, size_t part_size, u8vector_t const& default_ns) const;
     xercesc::DOMNode* put(xercesc::DOMNode* near_node, docsubtree_ptr const& docpart, xml::put_node_context_t ctx) const;
@@ -48,6 +61,7 @@ public:
 private:
 	boost::scoped_ptr<xml::XMLTree> tree;
 	boost::scoped_ptr<xml::XMLFragment> lsio;
+	boost::scoped_ptr<xml::XMLFragment> lsio_stored;
 	boost::scoped_ptr<xml::XMLSubtree> subtree;
 };
 
@@ -101,6 +115,19 @@ public:
         , xml::nsbindings_t const& prefixes
     ) const;
 
+    //isto kao prethodni ali nad vec parsiranim i validnim dokumentom, ako element nije null
+    //nadjeni element se ne serijalizuje u docpart nego vraca u element, index se zadaje samo
+    //za stablo koje se ne mijenja (kesirano)
+	response_code_e get_xpath(
+        u8vector_t& docpart
+        , std::string& mimetype
+        , doctree_ptr const& xr_doc
+        , std::vector<xml::nodestep_t> const& nodexpath
+        , xml::nsbindings_t const& prefixes
+        , xercesc::DOMNode const** element = 0
+        , xml::AttributeIndex* index = 0
+    ) const;
+
 	response_code_e put_xpath(
         u8vector_t& docnew
         , u8vector_t const& docprev
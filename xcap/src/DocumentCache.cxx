@@ -0,0 +1,129 @@
+#include "scarlet/xcap/DocumentCache.h"
+
+namespace scarlet {
+namespace xcap {
+
+DocumentCache::DocumentCache(size_t budget)
+ : m_mutex()
+ , m_budget(budget)
+ , m_used(0)
+ , m_lru()
+ , m_slots()
+ , m_hits(0)
+ , m_misses(0)
+ , m_evictions(0)
+ { }
+
+std::string DocumentCache::make_key(document_selector_t const& uri, std::string const& domain)
+{
+    std::string key(domain);
+    key.push_back('\0');
+    key.append(uri.auid.begin(), uri.auid.end());
+    key.push_back('\0');
+    key.append(uri.xui.begin(), uri.xui.end());
+    key.push_back('\0');
+    key.append(uri.docname.begin(), uri.docname.end());
+    return key;
+}
+
+void DocumentCache::erase(slots_map_t::iterator it)
+{
+    m_used -= it->second.cost;
+    m_lru.erase(it->second.lru);
+    m_slots.erase(it);
+}
+
+DocumentCache::entry_ptr DocumentCache::find(
+    document_selector_t const& uri
+    , std::string const& domain
+    , std::string const& etag
+)
+{
+    std::string const key(make_key(uri, domain));
+    boost::mutex::scoped_lock lock(m_mutex);
+    slots_map_t::iterator it(m_slots.find(key));
+    if(it == m_slots.end() || it->second.etag != etag) {
+        ++m_misses;
+        return entry_ptr();
+    }
+    ++m_hits;
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    return it->second.entry;
+}
+
+DocumentCache::entry_ptr DocumentCache::insert(
+    document_selector_t const& uri
+    , std::string const& domain
+    , std::string const& etag
+    , boost::shared_ptr<xercesc::DOMDocument> const& doc
+    , size_t xml_size
+)
+{
+    entry_ptr entry(new entry_t(doc));
+    size_t const cost(xml_size * DOM_BYTES_PER_XML_BYTE);
+    std::string const key(make_key(uri, domain));
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    slots_map_t::iterator it(m_slots.find(key));
+    if(it != m_slots.end()) erase(it);
+
+    if(cost > m_budget) return entry;//radi samo za ovaj zahtjev
+
+    while(m_used + cost > m_budget && !m_lru.empty()) {
+        erase(m_slots.find(m_lru.back()));
+        ++m_evictions;
+    }
+
+    m_lru.push_front(key);
+    slot_t& slot(m_slots[key]);
+    slot.etag = etag;
+    slot.entry = entry;
+    slot.cost = cost;
+    slot.lru = m_lru.begin();
+    m_used += cost;
+    return entry;
+}
+
+void DocumentCache::grow(
+    document_selector_t const& uri
+    , std::string const& domain
+    , std::string const& etag
+    , size_t bytes
+)
+{
+    std::string const key(make_key(uri, domain));
+    boost::mutex::scoped_lock lock(m_mutex);
+    slots_map_t::iterator it(m_slots.find(key));
+    if(it == m_slots.end() || it->second.etag != etag) return;//vec izbacen ili zamijenjen
+
+    it->second.cost += bytes;
+    m_used += bytes;
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+
+    while(m_used > m_budget && m_lru.size() > 1) {
+        erase(m_slots.find(m_lru.back()));
+        ++m_evictions;
+    }
+    if(m_used > m_budget) {//sam je preko budzeta, radi samo za zahtjeve koji ga vec imaju
+        erase(it);
+        ++m_evictions;
+    }
+}
+
+void DocumentCache::invalidate(document_selector_t const& uri, std::string const& domain)
+{
+    std::string const key(make_key(uri, domain));
+    boost::mutex::scoped_lock lock(m_mutex);
+    slots_map_t::iterator it(m_slots.find(key));
+    if(it != m_slots.end()) erase(it);
+}
+
+DocumentCache::stats_t DocumentCache::stats(void) const
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    stats_t st = { m_slots.size(), m_used, m_budget, m_hits, m_misses, m_evictions };
+    return st;
+}
+
+}
+}
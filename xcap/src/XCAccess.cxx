@@ -6,12 +6,18 @@
 #include <boost/uuid/uuid.hpp> //boost version >= 1.42
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <boost/bind.hpp>
 
 namespace scarlet {
 namespace xcap {
 
 std::string const app_usage_t::w3namespace("http://www.w3.org/XML/1998/namespace");
 
+static void append_to(u8vector_t& out, u8unit_t const* data, size_t length)
+{
+    out.append(data, data + length);
+}
+
 //    xmlstring schemaLocations(transcoded<XMLCh>(
 //      "http://example.com                     test_schema.xsd       "
 //      "http://www.w3.org/XML/1998/namespace   xml.xsd               "
@@ -85,6 +91,11 @@ void XCAccess::set(boost::shared_ptr<Storage> newstorage)
     storage = newstorage;
 }
 
+void XCAccess::set(boost::shared_ptr<DocumentCache> cache)
+{
+    doccache = cache;
+}
+
 bool XCAccess::perform_method(
     std::vector<std::string> const& ifetags
     , std::vector<std::string> const& ifnoetags
@@ -136,6 +147,44 @@ int XCAccess::deldoc(
     return storage->del(rquri.docpath, etagprev, domain);
 }
 
+DocumentCache::entry_ptr XCAccess::stored_tree(
+    u8vector_t const& doc
+    , std::string const& etag
+    , xcapuri_t const& rquri
+    , std::string const& domain
+) const
+{
+    if(!doccache) return DocumentCache::entry_ptr();
+
+    DocumentCache::entry_ptr entry(doccache->find(rquri.docpath, domain, etag));
+    if(entry) {
+        DBGMSGAT("Using cached DOM tree for etag " << etag);
+        return entry;
+    }
+
+    //NOTE: dokument je uzet iz storage sto znaci ako nije uspjelo parsiranje onda
+    // se u bazi nalazi los dokument. Znaci potrebna je intervencija administratora baze.
+    doctree_ptr xr_doc(XMLEngine::parse_stored(doc));
+
+    return doccache->insert(rquri.docpath, domain, etag, xr_doc, doc.size());
+}
+
+void XCAccess::stored_changed(
+    xcapuri_t const& rquri
+    , std::string const& domain
+    , std::string const& etag
+    , doctree_ptr const& xr_doc
+    , size_t xml_size
+) const
+{
+    if(!doccache) return;
+
+    if(xr_doc.get() && !etag.empty())
+        doccache->insert(rquri.docpath, domain, etag, xr_doc, xml_size);
+    else
+        doccache->invalidate(rquri.docpath, domain);
+}
+
 response_code_e XCAccess::get(xcacontext_t& ctx) const
 {
 	ctx.reBodyOut().clear();
@@ -163,14 +212,28 @@ response_code_e XCAccess::get(xcacontext_t& ctx) const
         return XCAP_OK;
     }
 
+    DocumentCache::entry_ptr cached(stored_tree(doc, ctx.reEtagOut(), ctx.rqUri(), ctx.rqDomain()));
+    if(cached) {
+        boost::mutex::scoped_lock lock(cached->mutex);
+        xercesc::DOMNode const* element(0);
+        size_t const indexed(cached->index.bytes());
+        response_code_e const rstatus(get_xpath(ctx.reBodyOut(), ctx.reMimeOut(), cached->doc, ctx.rqUri().npath, ctx.rqUri().prefixes, &element, &cached->index));
+        if(cached->index.bytes() != indexed) //indeks raste lijeno, racuna se u memoriju kesa
+            doccache->grow(ctx.rqUri().docpath, ctx.rqDomain(), ctx.reEtagOut(), cached->index.bytes() - indexed);
+        //element se serijalizuje pod lockom direktno u tijelo odziva, slanje ne drzi lock
+        if(element && !XMLEngine::serialize(boost::bind(&append_to, boost::ref(ctx.reBodyOut()), _1, _2), element))
+            return XCAP_ERROR_INTERNAL;
+        return rstatus;
+    }
+
     return get_xpath(ctx.reBodyOut(), ctx.reMimeOut(), doc, ctx.rqUri().npath, ctx.rqUri().prefixes);
 }
 
-u8vector_t XCAccess::xml_invalid_error(void) const
+u8vector_t XCAccess::xml_invalid_error(xml::xml_validity_e validity, std::vector<std::string> const& xml_msg) const
 {
     std::string elstart;
 
-    switch(XMLEngine::document_validity()) {
+    switch(validity) {
     case xml::XML_NOT_SCHEMA_VALID: {
         elstart = "<schema-validation-error"; // />
         break;
@@ -185,7 +248,6 @@ u8vector_t XCAccess::xml_invalid_error(void) const
     }
 
     std::string msg;
-    std::vector<std::string> const& xml_msg(XMLEngine::document_errors());
 
     if(!xml_msg.empty()) {
         for(size_t i=0; i<xml_msg.size(); ++i) {
@@ -235,9 +297,12 @@ response_code_e XCAccess::put(xcacontext_t& ctx) const
 
     u8vector_t docnew;//za izmjene unutar dokumenta
     rawcontent_t docactual = {0, 0};
+    doctree_ptr xr_doc;
 
 	response_code_e rstatus_path(XCAP_OK);
 
+    //8.2.2 Verifying Document Content and 8.2.5 Validation
+
     if(!ctx.rqUri().npath.empty()) {
         if(doc.empty())
             return XCAP_FAIL_NOT_FOUND;
@@ -259,21 +324,22 @@ response_code_e XCAccess::put(xcacontext_t& ctx) const
         docactual = ctx.rqBody();
     }
 
-    //8.2.2 Verifying Document Content and 8.2.5 Validation
-
-    doctree_ptr xr_doc(XMLEngine::parse(docactual.content, docactual.length));
+    //I izmijenjeni dokument se parsira sa validacijom jer umetnuti dio nije validiran i nema
+    //default atribute iz seme. Validirano stablo se koristi za constraints i kes.
+    xr_doc = XMLEngine::parse(docactual.content, docactual.length);
 
     assert((XMLEngine::document_validity() == xml::XML_VALID && xr_doc.get())
            || XMLEngine::document_validity() != xml::XML_VALID);
 
     if(XMLEngine::document_validity() != xml::XML_VALID) {
-		ctx.reBodyOut() = xml_invalid_error();
+		ctx.reBodyOut() = xml_invalid_error(XMLEngine::document_validity(), XMLEngine::document_errors());
         return XCAP_FAIL_CONSTRAINTS;
     }
 
     if(ctx.rqUri().npath.empty() //inace je vec obavljena takva provjera
        && ctx.rqMime() != app_info.mime)
         return XCAP_FAIL_MIME;
+
     {
 		response_code_e rstatus = constraints(ctx.reBodyOut(), xr_doc, ctx.rqUri(), doc);//defined by subtype
         if((rstatus&(-2)) != XCAP_OK) return rstatus;
@@ -281,12 +347,22 @@ response_code_e XCAccess::put(xcacontext_t& ctx) const
 	
 	ctx.reEtagOut() = boost::uuids::to_string(boost::uuids::random_generator()());//novi etag
 
+    //u storage ide serijalizacija validiranog stabla, ne tijelo zahtjeva, da bi parse_stored
+    //bez validacije dao isto stablo
+    u8vector_t docstored;
+    XMLEngine::serialize_stored(docstored, xr_doc);
+    rawcontent_t const docstoredwrapp = { docstored.data(), docstored.size() };
+
     if(putdoc(ctx.rqUri()
-              , docactual
+              , docstoredwrapp
               , ctx.reEtagOut()
               , etag
-              , ctx.rqDomain()) != 0) //NOTE: etag.empty() ? Storage insert : Storage update
+              , ctx.rqDomain()) != 0) { //NOTE: etag.empty() ? Storage insert : Storage update
+        stored_changed(ctx.rqUri(), ctx.rqDomain(), std::string(), doctree_ptr(), 0);
         return XCAP_ERROR_INTERNAL;
+    }
+
+    stored_changed(ctx.rqUri(), ctx.rqDomain(), ctx.reEtagOut(), xr_doc, docstored.size());
 
     //TODO: 8.2.7 Resource Interdependencies
 
@@ -322,7 +398,9 @@ response_code_e XCAccess::del(xcacontext_t& ctx) const
         return XCAP_FAIL_IF_PERFORM;
 
     if(ctx.rqUri().npath.empty()) { //citav dokument
-        if(deldoc(ctx.rqUri(), etag, ctx.rqDomain()) != 0)
+        int const deleted(deldoc(ctx.rqUri(), etag, ctx.rqDomain()));
+        stored_changed(ctx.rqUri(), ctx.rqDomain(), std::string(), doctree_ptr(), 0);
+        if(deleted != 0)
             return XCAP_ERROR_INTERNAL;
         //As long as the document still exists after the delete operation, any successful response
         //to DELETE MUST include the entity tag of the document.
@@ -355,7 +433,7 @@ response_code_e XCAccess::del(xcacontext_t& ctx) const
            || XMLEngine::document_validity() != xml::XML_VALID);
 
     if(XMLEngine::document_validity() != xml::XML_VALID) {
-		ctx.reBodyOut() = xml_invalid_error();
+		ctx.reBodyOut() = xml_invalid_error(XMLEngine::document_validity(), XMLEngine::document_errors());
         return XCAP_FAIL_CONSTRAINTS;
     }
 
@@ -363,13 +441,18 @@ response_code_e XCAccess::del(xcacontext_t& ctx) const
     if((rstatus&(-2)) != XCAP_OK)  return rstatus;//trebalo bi da je XCAP_FAIL_CONSTRAINTS ili XCAP_OK
 
 	ctx.reEtagOut() = boost::uuids::to_string(boost::uuids::random_generator()());//novi etag
+    XMLEngine::serialize_stored(docnew, xr_doc);//kao u put, upisuje se validirano stablo
     rawcontent_t docnewwrapp = { docnew.data(), docnew.size() };
     if(putdoc(ctx.rqUri()
               , docnewwrapp
               , ctx.reEtagOut()//novi etag
               , etag
-              , ctx.rqDomain()) != 0)
+              , ctx.rqDomain()) != 0) {
+        stored_changed(ctx.rqUri(), ctx.rqDomain(), std::string(), doctree_ptr(), 0);
         return XCAP_ERROR_INTERNAL;
+    }
+
+    stored_changed(ctx.rqUri(), ctx.rqDomain(), ctx.reEtagOut(), xr_doc, docnew.size());
 
     //TODO: 8.2.7 Resource Interdependencies
 
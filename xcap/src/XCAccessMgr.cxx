@@ -57,7 +57,7 @@ public:
 };
 
 XCAccessMgr::XCAccessMgr(std::string const& locale, std::string const& xsd_dir, std::map<std::string, std::string> const& xsdmap
-	, std::string const& default_domain, boost::shared_ptr<Storage> storage)
+	, std::string const& default_domain, boost::shared_ptr<Storage> storage, boost::shared_ptr<DocumentCache> doccache)
 	 : xerces_scope(xml::XercesScope::create(locale))
 {
     XCACapabilities* xcaps(new XCACapabilities(xerces_scope, xsd_dir, xsdmap));
@@ -85,6 +85,7 @@ XCAccessMgr::XCAccessMgr(std::string const& locale, std::string const& xsd_dir,
 
     for(size_t i(0); i<apps.size(); ++i) {
         apps[i]->set(storage);
+        apps[i]->set(doccache);
     }
 }
 
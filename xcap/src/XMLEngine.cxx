@@ -15,10 +15,12 @@ XMLEngine::XMLEngine(xml::XercesScopePtr xerces_scope
                      , std::string const& xsd_dir)
  : tree(new xml::XMLTree(xerces_scope, nsxsd_map, xsd_dir))
  , lsio(new xml::XMLFragment(xerces_scope))
+ , lsio_stored(new xml::XMLFragment(xerces_scope, false))
  , subtree(new xml::XMLSubtree(xerces_scope))
 {
     assert(tree.get());
     assert(lsio.get());
+    assert(lsio_stored.get());
     assert(subtree.get());
 }
 
@@ -29,6 +31,17 @@ doctree_ptr XMLEngine::parse(u8unit_t const* xml_str, size_t xml_str_size) const
     return tree->parse(xml_str, xml_str_size);
 }
 
+doctree_ptr XMLEngine::parse_stored(u8vector_t const& doc) const
+{
+    doctree_ptr xr_doc(tree->parse(doc.data(), doc.size(), false));
+    if(tree->validity() != xml::XML_VALID)
+        throw boost::enable_current_exception(invalid_stored_document()) << bmu::errinfo_message(
+                "XML document from storage not well-formed!"
+        );
+    assert(xr_doc.get());
+    return xr_doc;
+}
+
 xml::xml_validity_e XMLEngine::document_validity(void) const
 {
     return tree->validity();
@@ -71,6 +84,19 @@ void XMLEngine::serialize(u8vector_t& xml_out, doctree_ptr const& xr_doc) const
     lsio->serialize(xml_out, xr_root);
 }
 
+void XMLEngine::serialize_stored(u8vector_t& xml_out, doctree_ptr const& xr_doc) const
+{
+    assert(xr_doc.get());//logicka greska
+    xercesc::DOMDocument* xr_root(xr_doc.get());
+    lsio_stored->serialize(xml_out, xr_root);
+}
+
+bool XMLEngine::serialize(xml::u8sink_t const& xml_out, xercesc::DOMNode const* xr_node) const
+{
+    assert(xr_node);//logicka greska
+    return lsio->serialize(xml_out, xr_node);
+}
+
 docsubtree_ptr XMLEngine::parse(
     doctree_ptr const& xr_doc
     , u8unit_t const* part
@@ -190,21 +216,33 @@ XMLMethods::get_xpath(
     , std::vector<xml::nodestep_t> const& nodexpath
     , xml::nsbindings_t const& prefixes
 ) const
+{
+    //NOTE: za get dokument je uzet iz storage sto znaci ako nije uspjelo parsiranje onda
+    // se u bazi nalazi los dokument. Znaci potrebna je intervencija administratora baze.
+    doctree_ptr xr_doc(XMLEngine::parse_stored(docprev));
+
+    return get_xpath(docpart, mimetype, xr_doc, nodexpath, prefixes);
+}
+
+response_code_e
+XMLMethods::get_xpath(
+    u8vector_t& docpart
+    , std::string& mimetype
+    , doctree_ptr const& xr_doc
+    , std::vector<xml::nodestep_t> const& nodexpath
+    , xml::nsbindings_t const& prefixes
+    , xercesc::DOMNode const** element
+    , xml::AttributeIndex* index
+) const
 {
     assert(!nodexpath.empty());
+    assert(xr_doc.get());
+
+    if(element) *element = 0;
 
     docpart.clear();
     mimetype.clear();
 
-    doctree_ptr xr_doc(XMLEngine::parse(docprev.data(), docprev.size()));
-    //NOTE: za get dokument je uzet iz storage sto znaci ako nije uspjelo parsiranje onda
-    // se u bazi nalazi los dokument. Znaci potrebna je intervencija administratora baze.
-    if(XMLEngine::document_validity() != xml::XML_VALID)
-        throw boost::enable_current_exception(invalid_stored_document()) << bmu::errinfo_message(
-                "XML document from storage not valid!"
-        );
-    assert(xr_doc.get());
-
     size_t steps(nodexpath.size());
 
     if(nodexpath.back().type == xml::nodestep_t::NODE_NAMESPACE) {
@@ -216,7 +254,8 @@ XMLMethods::get_xpath(
                    , nodexpath
                    , steps
                    , prefixes
-                   , default_ns);
+                   , default_ns
+                   , index);
 
     if(!found.node()) {
         //DBGMSGAT("Not found [" << utf8_string(fullpath) << "] in document:\n" << utf8_string(docprev));
@@ -229,7 +268,8 @@ XMLMethods::get_xpath(
         mimetype = "application/xcap-att+xml";
     } break;
     case xml::nodestep_t::NODE_ELEMENT: {
-        XMLEngine::serialize(docpart, found);
+        if(element) *element = found.node();
+        else XMLEngine::serialize(docpart, found);
         mimetype = "application/xcap-el+xml";
     } break;
     case xml::nodestep_t::NODE_NAMESPACE: {
@@ -354,12 +394,7 @@ response_code_e XMLMethods::put_xpath(
 
     docnew.clear();
 
-    doctree_ptr xr_doc(XMLEngine::parse(docprev.data(), docprev.size()));
-    if(XMLEngine::document_validity() != xml::XML_VALID)
-        throw boost::enable_current_exception(invalid_stored_document()) << bmu::errinfo_message(
-                "XML document from storage not valid!"
-        );
-    assert(xr_doc.get());
+    doctree_ptr xr_doc(XMLEngine::parse_stored(docprev));
 
     DBGMSGAT("Selecting parent");
 	xml::XMLSelect rctx(xr_doc
@@ -468,12 +503,7 @@ response_code_e XMLMethods::del_xpath(
 
     docnew.clear();
 
-    doctree_ptr xr_doc(XMLEngine::parse(docprev.data(), docprev.size()));
-    if(XMLEngine::document_validity() != xml::XML_VALID)
-        throw boost::enable_current_exception(invalid_stored_document()) << bmu::errinfo_message(
-                "XML document from storage not valid!"
-        );
-    assert(xr_doc.get());
+    doctree_ptr xr_doc(XMLEngine::parse_stored(docprev));
 	xml::XMLSelect found(xr_doc
                    , nodexpath
                    , nodexpath.size()
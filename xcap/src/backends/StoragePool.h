@@ -0,0 +1,100 @@
+#ifndef SCARLET_XCAP_STORAGE_POOL_H
+#define SCARLET_XCAP_STORAGE_POOL_H
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+namespace scarlet {
+namespace xcap {
+
+/** Pool of database connections shared by all worker threads. Each pooled object owns its own
+  connection, prepared statements and scratch row, so it is used by exactly one thread between
+  checkout and checkin. Checkout blocks while all connections are in use.
+ */
+template<class Conn>
+class StoragePool : public boost::noncopyable {
+    mutable boost::mutex                   m_mutex;
+    boost::condition_variable              m_available;
+    std::vector<boost::shared_ptr<Conn> >  m_all;
+    std::vector<Conn*>                     m_idle;
+    storage_pool_stats_t                   m_stats;
+
+    Conn* acquire(void)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        ++m_stats.checkouts;
+        if (m_idle.empty()) {
+            ++m_stats.contended;
+            boost::posix_time::ptime const start(boost::posix_time::microsec_clock::universal_time());
+            while (m_idle.empty())
+                m_available.wait(lock);
+            boost::uint64_t const waited(
+                (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds());
+            m_stats.wait_usec += waited;
+            if (waited > m_stats.max_wait_usec)
+                m_stats.max_wait_usec = waited;
+        }
+        Conn* c(m_idle.back());
+        m_idle.pop_back();
+        ++m_stats.in_use;
+        if (m_stats.in_use > m_stats.peak_in_use)
+            m_stats.peak_in_use = m_stats.in_use;
+        return c;
+    }
+
+    void release(Conn* c)
+    {
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            m_idle.push_back(c);
+            --m_stats.in_use;
+        }
+        m_available.notify_one();
+    }
+
+public:
+    /// scoped checkout of one pooled connection
+    class lease : public boost::noncopyable {
+        StoragePool& pool;
+        Conn* const  conn;
+    public:
+        explicit lease(StoragePool& pool) : pool(pool), conn(pool.acquire()) { }
+        ~lease() { pool.release(conn); }
+        Conn* operator->(void) const { return conn; }
+    };
+
+    /** creates pool of size connections
+     * @param make factory called size times, returns newly allocated connection object
+     */
+    template<class Factory>
+    StoragePool(size_t size, Factory make)
+     : m_mutex()
+     , m_available()
+     , m_all()
+     , m_idle()
+     , m_stats()
+    {
+        if (size < 1) size = 1;
+        m_all.reserve(size);
+        m_idle.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            m_all.push_back(boost::shared_ptr<Conn>(make()));
+            m_idle.push_back(m_all.back().get());
+        }
+        m_stats.size = size;
+    }
+
+    storage_pool_stats_t stats(void) const
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        return m_stats;
+    }
+};
+
+}
+}
+
+#endif // SCARLET_XCAP_STORAGE_POOL_H
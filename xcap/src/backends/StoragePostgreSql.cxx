@@ -1,13 +1,19 @@
 #include "scarlet/xcap/Storage.h"
 #if defined(WITH_BACKEND_POSTGRESQL)
 #include "StoragePostgreSqlDb.h"
+#include "StoragePool.h"
+#include <boost/bind.hpp>
+#include <boost/functional/factory.hpp>
 #include <iostream>
 
 
 namespace scarlet {
 namespace xcap {
 
-class StoragePostgreSqlImpl {
+/** One database connection with its own prepared statements and scratch row. Not thread safe,
+  StoragePostgreSqlImpl hands it to one thread at a time.
+ */
+class StoragePostgreSqlConn {
     pqxx::connection dbconn;
 
     table_xcap_row_t row;
@@ -26,7 +32,7 @@ class StoragePostgreSqlImpl {
     GetUserStatement   userget_statement;
     GetUserApply       userget_apply;
 
-    explicit StoragePostgreSqlImpl(void); //NE
+    explicit StoragePostgreSqlConn(void); //NE
 
     void set_row(std::string const& etag
                  , document_selector_t const& uri
@@ -54,11 +60,11 @@ public:
 
     int user(std::string& digest, std::string const& username);
 
-    StoragePostgreSqlImpl(std::string const& options, std::string const& db_xtable, std::string const& db_utable);
+    StoragePostgreSqlConn(std::string const& options, std::string const& db_xtable, std::string const& db_utable);
 };
 
 
-StoragePostgreSqlImpl::StoragePostgreSqlImpl(std::string const& options, std::string const& db_xtable, std::string const& db_utable)
+StoragePostgreSqlConn::StoragePostgreSqlConn(std::string const& options, std::string const& db_xtable, std::string const& db_utable)
  : dbconn(options)
  , row()
  , userrow()
@@ -78,7 +84,7 @@ StoragePostgreSqlImpl::StoragePostgreSqlImpl(std::string const& options, std::st
 }
 
 
-void StoragePostgreSqlImpl::set_row(
+void StoragePostgreSqlConn::set_row(
     std::string const& etag
     , document_selector_t const& uri
     , rawcontent_t const& doc
@@ -97,7 +103,7 @@ void StoragePostgreSqlImpl::set_row(
 }
 
 
-int StoragePostgreSqlImpl::get(
+int StoragePostgreSqlConn::get(
     u8vector_t& doc
     , std::string& etag
     , document_selector_t const& uri
@@ -121,7 +127,7 @@ int StoragePostgreSqlImpl::get(
 }
 
 
-int StoragePostgreSqlImpl::put(
+int StoragePostgreSqlConn::put(
     document_selector_t const& uri
     , rawcontent_t const& doc
     , std::string const& etagnew
@@ -147,7 +153,7 @@ int StoragePostgreSqlImpl::put(
 }
 
 
-int StoragePostgreSqlImpl::del(document_selector_t const& uri, std::string const& etagprev, std::string const& domain)
+int StoragePostgreSqlConn::del(document_selector_t const& uri, std::string const& etagprev, std::string const& domain)
 {
     rawcontent_t nulldoc = { 0, 0 };
     assert(!etagprev.empty());
@@ -163,7 +169,7 @@ int StoragePostgreSqlImpl::del(document_selector_t const& uri, std::string const
 }
 
 
-int StoragePostgreSqlImpl::user(std::string& digest, std::string const& username)
+int StoragePostgreSqlConn::user(std::string& digest, std::string const& username)
 {
     to_digest.clear();
     userrow = username;
@@ -181,14 +187,71 @@ int StoragePostgreSqlImpl::user(std::string& digest, std::string const& username
 }
 
 
-StoragePostgreSqlImpl* create_StoragePostgreSqlImpl(std::string const& options, std::string const& db_xtable, std::string const& db_utable)
+class StoragePostgreSqlImpl {
+    StoragePool<StoragePostgreSqlConn> pool;
+
+    explicit StoragePostgreSqlImpl(void); //NE
+
+public:
+    int get(
+        u8vector_t& doc
+        , std::string& etag
+        , document_selector_t const& uri
+        , std::string const& domain
+    )
+    {
+        StoragePool<StoragePostgreSqlConn>::lease conn(pool);
+        return conn->get(doc, etag, uri, domain);
+    }
+
+    int put(
+        document_selector_t const& uri
+        , rawcontent_t const& doc
+        , std::string const& etagnew
+        , std::string const& etagprev
+        , std::string const& domain
+    )
+    {
+        StoragePool<StoragePostgreSqlConn>::lease conn(pool);
+        return conn->put(uri, doc, etagnew, etagprev, domain);
+    }
+
+    int del(document_selector_t const& uri, std::string const& etag, std::string const& domain)
+    {
+        StoragePool<StoragePostgreSqlConn>::lease conn(pool);
+        return conn->del(uri, etag, domain);
+    }
+
+    int user(std::string& digest, std::string const& username)
+    {
+        StoragePool<StoragePostgreSqlConn>::lease conn(pool);
+        return conn->user(digest, username);
+    }
+
+    storage_pool_stats_t stats(void) const { return pool.stats(); }
+
+    StoragePostgreSqlImpl(std::string const& options, std::string const& db_xtable, std::string const& db_utable, size_t pool_size)
+     : pool(pool_size, boost::bind(boost::factory<StoragePostgreSqlConn*>(), options, db_xtable, db_utable))
+     { }
+
+    ~StoragePostgreSqlImpl()
+    {
+        storage_pool_stats_t const st(pool.stats());
+        std::wclog << "Storage pool: " << st.size << " connections, " << st.checkouts << " checkouts, "
+            << st.contended << " contended, waited " << st.wait_usec << "us (max " << st.max_wait_usec << "us)"
+            << ", peak in use " << st.peak_in_use << std::endl;
+    }
+};
+
+
+StoragePostgreSqlImpl* create_StoragePostgreSqlImpl(std::string const& options, std::string const& db_xtable, std::string const& db_utable, size_t pool_size)
 {
-    std::wclog << "Connecting to database with options: " << options << std::endl;
+    std::wclog << "Connecting to database with options: " << options << " (" << pool_size << " connections)" << std::endl;
 
     StoragePostgreSqlImpl* p = 0;
 
     try {
-        p = new StoragePostgreSqlImpl(options, db_xtable, db_utable);
+        p = new StoragePostgreSqlImpl(options, db_xtable, db_utable, pool_size);
     } catch(...) {
         p = 0;
         pqxx_exception_handler();
@@ -200,8 +263,8 @@ StoragePostgreSqlImpl* create_StoragePostgreSqlImpl(std::string const& options,
 }
 
 
-StoragePostgreSql::StoragePostgreSql(std::string const& options, std::string const& db_xtable, std::string const& db_utable)
- : impl(create_StoragePostgreSqlImpl(options, db_xtable, db_utable))
+StoragePostgreSql::StoragePostgreSql(std::string const& options, std::string const& db_xtable, std::string const& db_utable, size_t pool_size)
+ : impl(create_StoragePostgreSqlImpl(options, db_xtable, db_utable, pool_size))
  { }
 
 
@@ -242,6 +305,12 @@ int StoragePostgreSql::user(std::string& digest, std::string const& username)
     return impl->user(digest, username);
 }
 
+
+storage_pool_stats_t StoragePostgreSql::pool_stats(void) const
+{
+    return impl->stats();
+}
+
 }
 }
 #else // WITH_BACKEND_POSTGRESQL
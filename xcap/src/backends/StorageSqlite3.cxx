@@ -1,12 +1,20 @@
 #include "scarlet/xcap/Storage.h"
 #if defined(WITH_BACKEND_SQLITE3)
 #include "StorageSqlite3Db.h"
+#include "StoragePool.h"
+#include <boost/bind.hpp>
+#include <boost/functional/factory.hpp>
 #include <iostream>
+#include <string>
 
 namespace scarlet {
 namespace xcap {
 
-class StorageSqlite3Impl {
+/** One database connection with its own prepared statements and scratch row. Not thread safe,
+  StorageSqlite3Impl hands it to one thread at a time.
+ */
+class StorageSqlite3Conn {
+    enum { BUSY_TIMEOUT = 5000 /*ms*/ };
     sqlite3xx::connection dbconn;
     table_xcap_row_t   row;
     std::string        userrow;
@@ -20,7 +28,7 @@ class StorageSqlite3Impl {
     DelDocStatement    docdel_statement;
     GetUserStatement   userget_statement;
     GetUserApply       userget_apply;
-    explicit StorageSqlite3Impl(void); //NE
+    explicit StorageSqlite3Conn(void); //NE
     void set_row(std::string const& etag
                  , document_selector_t const& uri
                  , rawcontent_t const& doc
@@ -42,10 +50,10 @@ public:
     );
     int del(document_selector_t const& uri, std::string const& etag, std::string const& domain);
     int user(std::string& digest, std::string const& username);
-    StorageSqlite3Impl(boost::filesystem::path const& dbpath, std::string const& db_xpath, std::string const& db_upath);
+    StorageSqlite3Conn(boost::filesystem::path const& dbpath, std::string const& db_xpath, std::string const& db_upath);
 };
 
-StorageSqlite3Impl::StorageSqlite3Impl(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable)
+StorageSqlite3Conn::StorageSqlite3Conn(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable)
  : dbconn(dbpath.string())
  , row()
  , userrow()
@@ -62,9 +70,13 @@ StorageSqlite3Impl::StorageSqlite3Impl(boost::filesystem::path const& dbpath, st
 {
     row.document.content = 0;
     row.document.length = 0;
+    //konekcije iz pool-a pisu istovremeno, bez busy timeout-a sqlite odmah vraca SQLITE_BUSY
+    sqlite3xx::work dbwork(dbconn);
+    dbwork.exec("PRAGMA busy_timeout = " + std::to_string(BUSY_TIMEOUT));
+    dbwork.commit();
 }
 
-void StorageSqlite3Impl::set_row(
+void StorageSqlite3Conn::set_row(
     std::string const& etag
     , document_selector_t const& uri
     , rawcontent_t const& doc
@@ -81,7 +93,7 @@ void StorageSqlite3Impl::set_row(
     row.document = doc;
 }
 
-int StorageSqlite3Impl::get(
+int StorageSqlite3Conn::get(
     u8vector_t& doc
     , std::string& etag
     , document_selector_t const& uri
@@ -100,7 +112,7 @@ int StorageSqlite3Impl::get(
     return 0;
 }
 
-int StorageSqlite3Impl::put(
+int StorageSqlite3Conn::put(
     document_selector_t const& uri
     , rawcontent_t const& doc
     , std::string const& etagnew
@@ -126,7 +138,7 @@ int StorageSqlite3Impl::put(
     return 0;
 }
 
-int StorageSqlite3Impl::del(document_selector_t const& uri, std::string const& etagprev, std::string const& domain)
+int StorageSqlite3Conn::del(document_selector_t const& uri, std::string const& etagprev, std::string const& domain)
 {
     rawcontent_t nulldoc = { 0, 0 };
     assert(!etagprev.empty());
@@ -142,7 +154,7 @@ int StorageSqlite3Impl::del(document_selector_t const& uri, std::string const& e
     return 0;
 }
 
-int StorageSqlite3Impl::user(std::string& digest, std::string const& username)
+int StorageSqlite3Conn::user(std::string& digest, std::string const& username)
 {
     to_digest.clear();
     userrow = username;
@@ -159,13 +171,59 @@ int StorageSqlite3Impl::user(std::string& digest, std::string const& username)
     return 0;
 }
 
-StorageSqlite3Impl* create_StorageSqlite3Impl(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable)
+class StorageSqlite3Impl {
+    StoragePool<StorageSqlite3Conn> pool;
+    explicit StorageSqlite3Impl(void); //NE
+public:
+    int get(
+        u8vector_t& doc
+        , std::string& etag
+        , document_selector_t const& uri
+        , std::string const& domain)
+    {
+        StoragePool<StorageSqlite3Conn>::lease conn(pool);
+        return conn->get(doc, etag, uri, domain);
+    }
+    int put(
+        document_selector_t const& uri
+        , rawcontent_t const& doc
+        , std::string const& etagnew
+        , std::string const& etagprev
+        , std::string const& domain)
+    {
+        StoragePool<StorageSqlite3Conn>::lease conn(pool);
+        return conn->put(uri, doc, etagnew, etagprev, domain);
+    }
+    int del(document_selector_t const& uri, std::string const& etag, std::string const& domain)
+    {
+        StoragePool<StorageSqlite3Conn>::lease conn(pool);
+        return conn->del(uri, etag, domain);
+    }
+    int user(std::string& digest, std::string const& username)
+    {
+        StoragePool<StorageSqlite3Conn>::lease conn(pool);
+        return conn->user(digest, username);
+    }
+    storage_pool_stats_t stats(void) const { return pool.stats(); }
+    StorageSqlite3Impl(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable, size_t pool_size)
+     : pool(pool_size, boost::bind(boost::factory<StorageSqlite3Conn*>(), dbpath, db_xtable, db_utable))
+     { }
+    ~StorageSqlite3Impl()
+    {
+        storage_pool_stats_t const st(pool.stats());
+        std::wclog << "Storage pool: " << st.size << " connections, " << st.checkouts << " checkouts, "
+            << st.contended << " contended, waited " << st.wait_usec << "us (max " << st.max_wait_usec << "us)"
+            << ", peak in use " << st.peak_in_use << std::endl;
+    }
+};
+
+StorageSqlite3Impl* create_StorageSqlite3Impl(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable, size_t pool_size)
 {
-    std::wclog << "Connecting to database file: " << dbpath << std::endl;
+    std::wclog << "Connecting to database file: " << dbpath << " (" << pool_size << " connections)" << std::endl;
     StorageSqlite3Impl* p = 0;
     try {
 		EnsureSqliteDb(dbpath.string(), db_xtable, db_utable);
-        p = new StorageSqlite3Impl(dbpath, db_xtable, db_utable);
+        p = new StorageSqlite3Impl(dbpath, db_xtable, db_utable, pool_size);
     } catch(...) {
         p = 0;
         sqlitexx_exception_handler();
@@ -176,8 +234,8 @@ StorageSqlite3Impl* create_StorageSqlite3Impl(boost::filesystem::path const& dbp
     return p;
 }
 
-StorageSqlite3::StorageSqlite3(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable)
- : impl(create_StorageSqlite3Impl(dbpath, db_xtable, db_utable))
+StorageSqlite3::StorageSqlite3(boost::filesystem::path const& dbpath, std::string const& db_xtable, std::string const& db_utable, size_t pool_size)
+ : impl(create_StorageSqlite3Impl(dbpath, db_xtable, db_utable, pool_size))
  { }
 
 StorageSqlite3::~StorageSqlite3() { }
@@ -211,6 +269,11 @@ int StorageSqlite3::user(std::string& digest, std::string const& username)
     return impl->user(digest, username);
 }
 
+storage_pool_stats_t StorageSqlite3::pool_stats(void) const
+{
+    return impl->stats();
+}
+
 }
 }
 #else // WITH_BACKEND_POSTGRESQL
@@ -3,6 +3,10 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/tss.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/function.hpp>
+#include <map>
 #include <xercesc/sax/EntityResolver.hpp>
 #include <xercesc/sax/ErrorHandler.hpp>
 #include <xercesc/parsers/XercesDOMParser.hpp>
@@ -20,6 +24,7 @@ namespace XERCES_CPP_NAMESPACE {
     class DOMLSInput;
     class DOMDocumentFragment;
     class DOMImplementationLS;
+    class XMLGrammarPool;
 }
 
 namespace scarlet {
@@ -62,6 +67,29 @@ private:
 	std::string               xl_locale;
 };
 
+/** XML seme kompajlirane jednom pri startu servera i zajednicke za sve parsere u svim nitima.
+  Nakon ucitavanja pool se zakljucava pa je samo za citanje i moze se koristiti istovremeno.
+ */
+class XMLGrammars : public boost::noncopyable {
+	XMLGrammars(void) = delete;
+	XMLGrammars(XercesScopePtr xersces_scope);
+public:
+	/** ucitava seme i zakljucava pool, postaje dostupno kroz instance()
+	 * @param nsxsd uparuje namespace URI sa imenom *.xsd fajla u xsd_dir
+	 */
+	static XMLGrammarsPtr create(XercesScopePtr xersces_scope
+		, std::map<std::string, std::string> const& nsxsd, std::string const& xsd_dir);
+	/// @return null ako seme nisu unaprijed ucitane
+	static XMLGrammarsPtr instance(void);
+	xercesc::XMLGrammarPool* pool(void) const { return grammar_pool.get(); }
+	~XMLGrammars();
+private:
+	static boost::mutex                        mutex;
+	static boost::weak_ptr<XMLGrammars>        one;
+	XercesScopePtr                             xersces_scope;
+	boost::scoped_ptr<xercesc::XMLGrammarPool> grammar_pool;
+};
+
 bool is_valid_utf8(u8unit_t const* str, size_t length);
 
 class EntityLocator : public xercesc::EntityResolver {
@@ -126,10 +154,11 @@ class XMLTree
         ErrReporterBase::error(errCode, msgDomain, errType, errorText
                                , systemId, publicId, lineNum, colNum);
     }
+    /// ukljucuje/iskljucuje validaciju prema semama za sljedece parsiranje
+    void schema_validation(bool enable);
 public:
     void* operator new(size_t size) { return XercesDOMParser::operator new(size); }
     void operator delete(void* p) { return XercesDOMParser::operator delete(p); }
-    //void schema_validation(bool enable = true);
     /** \param nsxsdmap Uparuje namespace URIje sa njihovim semama, ovako treba da izgleda:
      <code>
      char const* nsxsdmap =
@@ -140,14 +169,19 @@ public:
      \param base Putanja pod kojom su svi konfiguracioni resursi servera.
      \param subxsd Podputanja od \ref base pod kojom su sve XML seme servera.
     */
-	XMLTree(XercesScopePtr xersces_scope, std ::string const& nsxsdmap, std::string const& xsd_dir);
+	XMLTree(XercesScopePtr xersces_scope, std ::string const& nsxsdmap, std::string const& xsd_dir
+		, XMLGrammarsPtr grammars = XMLGrammars::instance());
     /** U rezultatu daje pokazivac DOM stabla zadanog dokumenta. Pokazivac je 0 u slucaju greske.
         S DOM stablom nemas sta direktno raditi, koristitis ga samo kao argument XmlXpath::query.
+        \param validate false samo za dokumente koji su upisani kao serijalizacija validiranog stabla
+        (iz storage), tada se provjerava samo da li je dokument well-formed.
      */
-    doctree_ptr parse(u8unit_t const* xml_str, size_t xml_str_size);
+    doctree_ptr parse(u8unit_t const* xml_str, size_t xml_str_size, bool validate = true);
 private:
 	XercesScopePtr xersces_scope;
+	XMLGrammarsPtr grammars;
     EntityLocator  entities;
+    bool           validating;
 };
 
 class XMLSubtree
@@ -168,13 +202,15 @@ class XMLSubtree
         ErrReporterBase::error(errCode, msgDomain, errType, errorText
                                , systemId, publicId, lineNum, colNum);
     }
-    static size_t nelements(xercesc::DOMNodeList const* nodelist);
-    static xercesc::DOMNode* element_node(xercesc::DOMNodeList const* nodelist);
+    /// broj djece tipa ELEMENT_NODE
+    static size_t nelements(xercesc::DOMNode const* parent);
+    /// prvo dijete tipa ELEMENT_NODE
+    static xercesc::DOMNode* element_node(xercesc::DOMNode const* parent);
     docsubtree_ptr null_with_error(xml_validity_e eval);
 public:
     void* operator new(size_t size) { return DOMLSParserImpl::operator new(size); }
     void operator delete(void* p) { return DOMLSParserImpl::operator delete(p); }
-    XMLSubtree(XercesScopePtr xersces_scope);
+    XMLSubtree(XercesScopePtr xersces_scope, XMLGrammarsPtr grammars = XMLGrammars::instance());
     ~XMLSubtree(void);
     docsubtree_ptr parse(
         doctree_ptr const& xr_doc
@@ -190,11 +226,16 @@ public:
     doctree_ptr parse_document(u8vector_t const& document);
 private:
 	XercesScopePtr                         xersces_scope;
+	XMLGrammarsPtr                         grammars;
 	boost::shared_ptr<xercesc::DOMLSInput> target_input;
 };
 
+/// prima uzastopne dijelove serijalizovanog XML-a
+typedef boost::function<void (u8unit_t const*, size_t)> u8sink_t;
+
 class u8fmttarget_t : public xercesc::XMLFormatTarget {
-    u8vector_t& _str; //u ovo se pise
+    u8vector_t* _str; //u ovo se pise
+    u8sink_t    _sink; //ili se ovome predaje ako nema _str
     enum { BLOCK_SIZE = 1024 };
     explicit u8fmttarget_t(const u8fmttarget_t&); //NE
     u8fmttarget_t& operator=(const u8fmttarget_t&); //NE
@@ -203,6 +244,7 @@ class u8fmttarget_t : public xercesc::XMLFormatTarget {
                     , xercesc::XMLFormatter* const /*formatter*/);
 public:
     u8fmttarget_t(u8vector_t& str);
+    u8fmttarget_t(u8sink_t const& sink);
 };
 
 /** Pretvaranje DOM podstabla u XML fragment:
@@ -216,8 +258,14 @@ class XMLFragment {
 public:
     void serialize(xercesc::DOMNode const* node) const;
     bool serialize(u8vector_t& xml_str, xercesc::DOMNode const* node) const;
+    /// isto ali se XML predaje u out dio po dio kako nastaje, bez citavog u memoriji
+    bool serialize(u8sink_t const& out, xercesc::DOMNode const* node) const;
     XMLFragment(void) = delete;
-	XMLFragment(XercesScopePtr xersces_scope);
+    /** \param discard_defaults false ako treba ispisati i atribute koje je dodala validacija prema
+        semi (default vrijednosti), tako ispisan dokument ne treba ponovo validirati da bi se
+        dobilo isto stablo.
+     */
+	XMLFragment(XercesScopePtr xersces_scope, bool discard_defaults = true);
 	~XMLFragment();
 };
 
@@ -3,6 +3,8 @@
 
 #include <bmu/tydefs.h>
 #include <scarlet/xml/xmldefs.h>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <map>
 #include <vector>
 
@@ -54,11 +56,21 @@ struct match_element_type : public std::unary_function<xmlnode_t*, bool> {
 };
 
 
+/// Xercesov tekst (UTF-16), isto kao xmlstring u XMLUni.h
+typedef std::basic_string<XMLCh> xmlstring;
+
+/** Poredi ime elementa (namespace URI i lokalno ime) ili atributa (samo lokalno ime) sa korakom.
+  Korak se transkodira u UTF-16 jednom pri konstrukciji pa se cvorovi porede bez transkodiranja.
+ */
 class match_prefixed_name : public std::unary_function<xmlnode_t*, bool> {
     u8vector_t const stepprefix;
     u8vector_t const steplocalname;
-    nsbindings_t const prefixes;
     u8vector_t const default_ns;
+    xmlstring        ns_uri;//namespace elementa, prazan ako prefiks nije vezan ili nije UTF-8
+    xmlstring        local_name;//prazno ako nije UTF-8
+    bool             wildcarded;
+
+    void transcode(nsbindings_t const& prefixes);
 
 public:
     bool operator()(xmlnode_t const* node) const;
@@ -71,32 +83,20 @@ public:
         nodestep_t const& step
         , u8vector_t const& default_ns
         , nsbindings_t const& prefixes = nsbindings_t()
-    )
-     : stepprefix(step.prefix)
-     , steplocalname(step.localname)
-     , prefixes(prefixes)
-     , default_ns(default_ns)
-     { }
+    );
 
     match_prefixed_name(
         u8vector_t const& steplocalname
         , u8vector_t const& default_ns
         , u8vector_t const& stepprefix = u8vector_t()
         , nsbindings_t const& prefixes = nsbindings_t()
-    )
-     : stepprefix(stepprefix)
-     , steplocalname(steplocalname)
-     , prefixes(prefixes)
-     , default_ns(default_ns)
-     { }
+    );
 };
 
 
 class match_attvalue : public std::unary_function<xmlnode_t*, bool> {
     match_prefixed_name same_name;
-    u8vector_t const attvalue;
-    nsbindings_t const prefixes;
-    u8vector_t const default_ns;
+    xmlstring           attvalue;//prazno ako nije UTF-8
 
 public:
     //true ako ima bar jedan atribut sa zadanim prefiksom imenom i vrijednoscu
@@ -106,12 +106,52 @@ public:
         nodestep_t const& step
         , u8vector_t const& default_ns
         , nsbindings_t const& prefixes
-    )
-     : same_name(step.attname, default_ns, step.attprefix, prefixes)
-     , attvalue(step.attvalue)
-     , prefixes(prefixes)
-     , default_ns(default_ns)
-     { }
+    );
+};
+
+/** Indeks elemenata po vrijednosti atributa za korake oblika prefix:name[@att="value"], tako
+  se element nalazi bez prolaza kroz svu djecu i bez transkodiranja pri svakom poredjenju. Gradi se
+  lijeno, za djecu jednog roditelja pri prvom takvom koraku nad njima. Vrijedi samo dok se stablo
+  ne mijenja pa se koristi za kesirana stabla, nije thread safe.
+ */
+class AttributeIndex {
+public:
+    /** Bira djecu context-a kao XMLSelect za korak sa predikatom atributa.
+     * @return false ako se korak ne razrjesava indeksom (pozicija ili wildcard), out je tada prazan
+     */
+    bool select(
+        std::vector<xmlnode_t*>& out
+        , xmlnode_t* context
+        , nodestep_t const& step
+        , nsbindings_t const& prefixes
+        , u8vector_t const& default_ns
+    );
+
+    /// broj indeksiranih (element, atribut) parova
+    size_t size(void) const { return nentries; }
+
+    /// procjena memorije koju zauzima indeks, u bajtovima
+    size_t bytes(void) const { return nbytes; }
+
+    AttributeIndex(void) : parents(), names(), elements(), nentries(0), nbytes(0) { }
+
+private:
+    /// namespace URI i ime elementa sa imenom atributa u UTF-8, svako jednom, daje redni broj za kljuc
+    typedef boost::unordered_map<u8vector_t, size_t> names_map_t;
+    /// kljuc: roditelj, redni broj imena iz names i vrijednost atributa u UTF-8
+    typedef boost::unordered_map<u8vector_t, std::vector<xmlnode_t*> > elements_map_t;
+
+    static void append_name(u8vector_t& name, u8vector_t const& ns, u8vector_t const& elname
+        , u8vector_t const& attname);
+    static void append_key(u8vector_t& key, xmlnode_t const* parent, size_t name_id
+        , u8vector_t const& attvalue);
+    void index_children(xmlnode_t const* parent);
+
+    boost::unordered_set<xmlnode_t const*> parents;//ciju djecu je vec indeksirao
+    names_map_t                            names;
+    elements_map_t                         elements;
+    size_t                                 nentries;
+    size_t                                 nbytes;
 };
 
 typedef boost::shared_ptr<xmldoc_t> doctree_ptr;
@@ -124,13 +164,14 @@ class XMLSelect {
 
     static void dump(xmlnode_t* xr_node);
 
-    //selected direct children
+    //selected direct children, using index for attribute predicate if not null
     static void select(
         std::vector<xmlnode_t*>& out
         , xmlnode_t* context
         , nodestep_t const& step
         , nsbindings_t const& prefixes
         , u8vector_t const& default_ns
+        , AttributeIndex* index = 0
     );
 public:
     //select document element (root node)
@@ -144,11 +185,13 @@ public:
     }
 
     //selected descendant nodes, each step until last must select unique child node of previous node
+    //index se smije zadati samo za stablo koje se ne mijenja
     XMLSelect(doctree_ptr const& xr_doc
               , std::vector<nodestep_t> const& steps
               , size_t count
               , nsbindings_t const& prefixes
-              , u8vector_t const& default_ns);
+              , u8vector_t const& default_ns
+              , AttributeIndex* index = 0);
 
     //selected direct children
     XMLSelect(XMLSelect const& context
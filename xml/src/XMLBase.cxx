@@ -3,7 +3,6 @@
 #include "bmu/Logger.h"
 #include <xercesc/internal/XMLScanner.hpp>
 #include <xercesc/dom/DOMNamedNodeMap.hpp>
-#include <xercesc/dom/DOMNodeList.hpp>
 #include <xercesc/dom/DOMElement.hpp>
 #include <xercesc/dom/DOMDocument.hpp>
 #include <xercesc/dom/DOMDocumentFragment.hpp>
@@ -17,8 +16,13 @@
 #include <xercesc/sax/SAXParseException.hpp>
 #include <xercesc/util/OutOfMemoryException.hpp>
 #include <xercesc/dom/DOMException.hpp>
+#include <xercesc/internal/XMLGrammarPoolImpl.hpp>
+#include <xercesc/validators/common/Grammar.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
 #include <map>
+#include <algorithm>
 
 namespace scarlet {
 namespace xml {
@@ -40,15 +44,13 @@ XercesScope* XercesScope::one(0);
 XercesScopePtr XercesScope::create(std::string const& locale)
 {
 	boost::mutex::scoped_lock lock(mutex);
-	if (!one) {
-		one = new XercesScope(locale);
-		std::wclog << "Created new XercesScope instance " << std::endl;
-	}
-	else {
+	if (one) {
 		std::wclog << "Using existing XercesScope instance " << std::endl;
+		return one->shared_from_this(); // already reference counted, don't make second owner
 	}
-	BOOST_ASSERT(one);
-	return XercesScopePtr(one)->shared_from_this(); // start reference counting then get second reference
+	one = new XercesScope(locale);
+	std::wclog << "Created new XercesScope instance " << std::endl;
+	return XercesScopePtr(one); // start reference counting
 }
 
 XercesScopePtr XercesScope::instance(void)
@@ -95,6 +97,68 @@ XercesScope::~XercesScope()
 	xercesc::XMLPlatformUtils::Terminate();
 }
 
+boost::mutex XMLGrammars::mutex;
+boost::weak_ptr<XMLGrammars> XMLGrammars::one;
+
+XMLGrammars::XMLGrammars(XercesScopePtr xersces_scope)
+	: xersces_scope(xersces_scope)
+	, grammar_pool(new xercesc::XMLGrammarPoolImpl(xercesc::XMLPlatformUtils::fgMemoryManager))
+{
+}
+
+XMLGrammars::~XMLGrammars()
+{
+	grammar_pool.reset(); // prije xersces_scope
+}
+
+XMLGrammarsPtr XMLGrammars::create(XercesScopePtr xersces_scope
+	, std::map<std::string, std::string> const& nsxsd, std::string const& xsd_dir)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	XMLGrammarsPtr grammars(one.lock());
+	if (grammars) {
+		std::wclog << "Using existing XML grammar pool" << std::endl;
+		return grammars;
+	}
+	grammars.reset(new XMLGrammars(xersces_scope));
+	{
+		// parser samo za ucitavanje, kompajlirane seme ostaju u pool-u
+		EntityLocator entities(xsd_dir);
+		xercesc::XercesDOMParser loader(0, xercesc::XMLPlatformUtils::fgMemoryManager, grammars->pool());
+		loader.setDoNamespaces(true);
+		loader.setDoSchema(true);
+		loader.setValidationSchemaFullChecking(true);
+		loader.setEntityResolver(&entities);
+		std::map<std::string, std::string>::const_iterator it(nsxsd.begin());
+		for (; it != nsxsd.end(); ++it) {
+			std::string const xsd_name(boost::algorithm::trim_copy(it->second));
+			boost::filesystem::path const xsd_path(boost::filesystem::path(xsd_dir) / xsd_name);
+			if (xsd_name.empty() || !boost::filesystem::exists(xsd_path)) {
+				std::wclog << "Schema for namespace " << it->first << " not found: " << xsd_path.string() << std::endl;
+				continue;
+			}
+			try {
+				xercesc::LocalFileInputSource src(_TRLCP(xsd_path.string().c_str()).c_str());
+				if (!loader.loadGrammar(src, xercesc::Grammar::SchemaGrammarType, true))
+					std::wclog << "Failed loading schema: " << xsd_path.string() << std::endl;
+			}
+			catch (...) {
+				xml_engine_exception_handler();
+			}
+		}
+	}
+	grammars->pool()->lockPool();
+	std::wclog << "Loaded and locked XML grammar pool" << std::endl;
+	one = grammars;
+	return grammars;
+}
+
+XMLGrammarsPtr XMLGrammars::instance(void)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return one.lock();
+}
+
 //vidljivo iz XMLUni.h
 xml_engine_transcoder_t const* tr(void)
 {
@@ -253,57 +317,69 @@ void ErrReporterBase::error(unsigned int const errCode
 
 ///////////////////////////////////////////////////////////////
 
-XMLTree::XMLTree(XercesScopePtr xersces_scope, std::string const& nsxsdmap, std::string const& xsd_dir)
- : xersces_scope(xersces_scope)
- , ErrReporterBase()
- , xercesc::XercesDOMParser()
- , entities(xsd_dir)
+/// podesavanja za validaciju prema semama, Parser je XercesDOMParser
+template <typename Parser>
+void schema_validating(Parser& parser, xercesc::XMLErrorReporter* reporter, EntityLocator* entities
+                       , std::string const& nsxsdmap, bool cached_grammars)
 {
-    ///XercesDOMParser::useScanner(transcoded<XMLCh>("SGXMLScanner").c_str());
-
-    XercesDOMParser::setDoNamespaces(true);//Enable namespaces
+    parser.setDoNamespaces(true);//Enable namespaces
 
     //enable checking of all Schema constraints
-    XercesDOMParser::setValidationScheme(xercesc::XercesDOMParser::Val_Always);//enable schema validation
-    XercesDOMParser::setDoSchema(true);
+    parser.setValidationScheme(Parser::Val_Always);//enable schema validation
+    parser.setDoSchema(true);
     // particle unique attribution constraint checking and particle derivation restriction checking
-    XercesDOMParser::setValidationSchemaFullChecking(true);
-    XercesDOMParser::setLoadSchema(true);
-    XercesDOMParser::cacheGrammarFromParse(true);
-    XercesDOMParser::setValidationConstraintFatal(true);
+    parser.setValidationSchemaFullChecking(true);
+    parser.setLoadSchema(true);
+    if(cached_grammars) {
+        //seme su vec u zakljucanom zajednickom pool-u, ne ucitavaju se ponovo
+        parser.useCachedGrammarInParse(true);
+    } else {
+        parser.cacheGrammarFromParse(true);
+    }
+    parser.setValidationConstraintFatal(true);
 
-    //XercesDOMParser::setErrorHandler(&errors);// when detects violations of the schema.
-    XercesDOMParser::getScanner()->setErrorReporter(this);
-    XercesDOMParser::setEntityResolver(&entities);//find the schema and resolve schema imports/includes.
+    //parser.setErrorHandler(&errors);// when detects violations of the schema.
+    parser.getScanner()->setErrorReporter(reporter);
+    parser.setEntityResolver(entities);//find the schema and resolve schema imports/includes.
 
     std::wclog << "NS xsd map " << (nsxsdmap.empty() ? "is" : "not") << " empty" << std::endl;
 
     xmlstring schemaLocations = _TRLCP(nsxsdmap.c_str());
-    XercesDOMParser::setExternalSchemaLocation(schemaLocations.c_str());
+    parser.setExternalSchemaLocation(schemaLocations.c_str());
+}
+
+XMLTree::XMLTree(XercesScopePtr xersces_scope, std::string const& nsxsdmap, std::string const& xsd_dir
+                 , XMLGrammarsPtr grammars)
+ : xersces_scope(xersces_scope)
+ , ErrReporterBase()
+ , xercesc::XercesDOMParser(0, xercesc::XMLPlatformUtils::fgMemoryManager, grammars ? grammars->pool() : 0)
+ , grammars(grammars)
+ , entities(xsd_dir)
+ , validating(true)
+{
+    ///XercesDOMParser::useScanner(transcoded<XMLCh>("SGXMLScanner").c_str());
+
+    schema_validating<xercesc::XercesDOMParser>(*this, this, &entities, nsxsdmap, grammars.get() != 0);
 
     std::wclog << "Created XML parser." << std::endl;
 }
 
 
-//void XMLTree::schema_validation(bool enable)
-//{
-//    if(enable) {
-//        XercesDOMParser::setValidationScheme(xercesc::XercesDOMParser::Val_Always);//enable schema validation
-//        XercesDOMParser::setDoSchema(true);
-//        // particle unique attribution constraint checking and particle derivation restriction checking
-//        XercesDOMParser::setValidationSchemaFullChecking(true);
-//        XercesDOMParser::setLoadSchema(true);
-//        XercesDOMParser::cacheGrammarFromParse(true);
-//        XercesDOMParser::setValidationConstraintFatal(true);
-//    } else {
-//        XercesDOMParser::setValidationScheme(xercesc::XercesDOMParser::Val_Never);//disable schema validation
-//        XercesDOMParser::setDoSchema(false);
-//        XercesDOMParser::setValidationSchemaFullChecking(false);
-//        XercesDOMParser::setLoadSchema(false);
-//        XercesDOMParser::cacheGrammarFromParse(false);
-//        XercesDOMParser::setValidationConstraintFatal(false);
-//    }
-//}
+void XMLTree::schema_validation(bool enable)
+{
+    if(enable) {
+        XercesDOMParser::setValidationScheme(xercesc::XercesDOMParser::Val_Always);//enable schema validation
+        XercesDOMParser::setDoSchema(true);
+        // particle unique attribution constraint checking and particle derivation restriction checking
+        XercesDOMParser::setValidationSchemaFullChecking(true);
+    } else {
+        //seme ostaju ucitane, samo se ne koriste dok se validacija opet ne ukljuci
+        XercesDOMParser::setValidationScheme(xercesc::XercesDOMParser::Val_Never);//disable schema validation
+        XercesDOMParser::setDoSchema(false);
+        XercesDOMParser::setValidationSchemaFullChecking(false);
+    }
+    validating = enable;
+}
 
 
 /* All XML processors MUST be able to read entities in both the UTF-8 and UTF-16 encodings.
@@ -334,10 +410,11 @@ with a text declaration (see 4.3.1 The Text Declaration) containing an encoding
 // xr_doc->getXmlEncoding() je postavljeno samo ako postoji u xml deklaraciji
 // xr_doc->getInputEncoding() je uvijek postavljen ako je uspjelo parsiranje
 // xr_doc vec je normalizovan u parse(...), ne treba xr_doc->normalize();
-doctree_ptr XMLTree::parse(u8unit_t const* xml_str, size_t xml_str_size)
+doctree_ptr XMLTree::parse(u8unit_t const* xml_str, size_t xml_str_size, bool validate)
 {
 	try {
 		if(xml_str && xml_str_size>0) {
+			if(validate != validating) schema_validation(validate);
 			ErrReporterBase::clear_messages();
 			xercesc::MemBufInputSource src((XMLByte const*)xml_str, xml_str_size, "tmp_doc_istream");
 			XercesDOMParser::parse(src);
@@ -376,10 +453,11 @@ doctree_ptr XMLTree::parse(u8unit_t const* xml_str, size_t xml_str_size)
 ///////////////////////////////////////////////////
 
 
-XMLSubtree::XMLSubtree(XercesScopePtr xersces_scope)
+XMLSubtree::XMLSubtree(XercesScopePtr xersces_scope, XMLGrammarsPtr grammars)
  : xersces_scope(xersces_scope)
  , ErrReporterBase()
- , DOMLSParserImpl()
+ , DOMLSParserImpl(0, xercesc::XMLPlatformUtils::fgMemoryManager, grammars ? grammars->pool() : 0)
+ , grammars(grammars)
  , target_input(domls()->createLSInput(), &releaser<xercesc::DOMLSInput>)
 {
     assert(target_input.get());
@@ -402,25 +480,24 @@ XMLSubtree::XMLSubtree(XercesScopePtr xersces_scope)
 XMLSubtree::~XMLSubtree() { }
 
 
-size_t XMLSubtree::nelements(xercesc::DOMNodeList const* nodelist)
+size_t XMLSubtree::nelements(xercesc::DOMNode const* parent)
 {
-    if(!nodelist) return 0;
+    if(!parent) return 0;
 
     size_t count(0);
-    for(size_t i=0; i<nodelist->getLength(); ++i) {
-        if(nodelist->item(i)->getNodeType() == xercesc::DOMNode::ELEMENT_NODE)
+    for(xercesc::DOMNode const* child(parent->getFirstChild()); child; child = child->getNextSibling()) {
+        if(child->getNodeType() == xercesc::DOMNode::ELEMENT_NODE)
             count ++;
     }
     return count;
 }
 
 
-xercesc::DOMNode* XMLSubtree::element_node(xercesc::DOMNodeList const* nodelist)
+xercesc::DOMNode* XMLSubtree::element_node(xercesc::DOMNode const* parent)
 {
-    for(size_t i=0; i<nodelist->getLength(); ++i) {
-        xercesc::DOMNode* element(nodelist->item(i));
-        if(element->getNodeType() == xercesc::DOMNode::ELEMENT_NODE)
-            return element;
+    for(xercesc::DOMNode* child(parent->getFirstChild()); child; child = child->getNextSibling()) {
+        if(child->getNodeType() == xercesc::DOMNode::ELEMENT_NODE)
+            return child;
     }
     return 0;
 }
@@ -489,10 +566,9 @@ docsubtree_ptr
         return null_with_error(XML_NOT_UTF8);
 
     xercesc::DOMElement* const fr_root(frdoc->getDocumentElement());
-    xercesc::DOMNodeList* const frnodes(fr_root ? fr_root->getChildNodes() : 0);
 
     //body has to be a well-balanced region of an XML document, including only a SINGLE element.
-    if(!frnodes || nelements(frnodes) != 1)
+    if(!fr_root || nelements(fr_root) != 1)
         return null_with_error(XML_NOT_WELL_FORMED);
 
     docsubtree_ptr holder(
@@ -504,8 +580,8 @@ docsubtree_ptr
 
     //I whitespace cvorovi se prema RFC 4825 kopiraju iako mora biti samo jedan ELEMENT_NODE
     try {
-        for(size_t i=0; i<frnodes->getLength(); ++i)
-            holder->appendChild(xr_doc->importNode(frnodes->item(i), true));
+        for(xercesc::DOMNode* frnode(fr_root->getFirstChild()); frnode; frnode = frnode->getNextSibling())
+            holder->appendChild(xr_doc->importNode(frnode, true));
 
         return holder;
     } catch (...) {
@@ -523,10 +599,10 @@ xercesc::DOMNode*
 {
     assert(near_node);
     assert(docpart.get());
-    assert(XMLSubtree::nelements(docpart->getChildNodes()) == 1);
+    assert(XMLSubtree::nelements(docpart.get()) == 1);
 
     xercesc::DOMNode* const parent(near_node->getParentNode());
-    xercesc::DOMNode* const element(XMLSubtree::element_node(docpart->getChildNodes()));//ELEMENT_NODE
+    xercesc::DOMNode* const element(XMLSubtree::element_node(docpart.get()));//ELEMENT_NODE
     assert(element->getNodeType() == xercesc::DOMNode::ELEMENT_NODE);
 
     try {
@@ -552,10 +628,19 @@ xercesc::DOMNode*
 
 
 u8fmttarget_t::u8fmttarget_t(u8vector_t& str)
- : _str(str)
+ : _str(&str)
+ , _sink()
 {
 //    _str.clear();
-    _str.reserve(BLOCK_SIZE);
+    _str->reserve(BLOCK_SIZE);
+}
+
+
+u8fmttarget_t::u8fmttarget_t(u8sink_t const& sink)
+ : _str(0)
+ , _sink(sink)
+{
+    assert(_sink);
 }
 
 
@@ -563,18 +648,67 @@ void u8fmttarget_t::writeChars(const XMLByte* const toWrite
                                , const XMLSize_t      count
                                , xercesc::XMLFormatter* const /*formatter*/)
 {
-    size_t const full(_str.size() + count);
-    if(full > _str.capacity())
-        _str.reserve(_str.capacity() + ((size_t)full/BLOCK_SIZE)*BLOCK_SIZE);
+    if(!_str) {
+        _sink(toWrite, count);
+        return;
+    }
+
+    size_t const full(_str->size() + count);
+    if(full > _str->capacity())
+        _str->reserve(_str->capacity() + ((size_t)full/BLOCK_SIZE)*BLOCK_SIZE);
+
+    _str->append(toWrite, toWrite + count);
+}
+
+
+namespace {
+
+void append_to(u8vector_t& out, u8unit_t const* data, size_t length)
+{
+    out.append(data, data + length);
+}
+
+/** Propusta samo ono sto je izmedju prvog znaka '\n' i zavrsnog "\n</fragment>", vidi
+  XMLFragment::serialize. Zadrzava samo zadnjih TAIL_SIZE bajta pa fragment ne mora biti u memoriji.
+ */
+class fragment_trim_t {
+    u8sink_t const& out;
+    bool            started;
+    u8vector_t      tail;
+public:
+    enum { TAIL_SIZE = sizeof("\n</fragment>") - 1 };
+    explicit fragment_trim_t(u8sink_t const& out) : out(out), started(false), tail() { }
+    void write(u8unit_t const* data, size_t length)
+    {
+        if(!started) {
+            u8unit_t const* const nl(std::find(data, data + length, '\n'));
+            if(nl == data + length) return;
+            started = true;
+            length -= nl + 1 - data;
+            data = nl + 1;
+        }
+        if(length >= TAIL_SIZE) {
+            if(!tail.empty()) out(tail.data(), tail.size());
+            if(length > TAIL_SIZE) out(data, length - TAIL_SIZE);
+            tail.assign(data + length - TAIL_SIZE, data + length);
+        } else {
+            tail.append(data, data + length);
+            if(tail.size() > TAIL_SIZE) {
+                size_t const extra(tail.size() - TAIL_SIZE);
+                out(tail.data(), extra);
+                tail.erase(0, extra);
+            }
+        }
+    }
+};
 
-    _str.append(toWrite, toWrite + count);
 }
 
 
 ///////////////////////////////////////////////////
 
 
-XMLFragment::XMLFragment(XercesScopePtr xersces_scope)
+XMLFragment::XMLFragment(XercesScopePtr xersces_scope, bool discard_defaults)
  : xersces_scope(xersces_scope)
  , serializer(domls()->createLSSerializer(), &releaser<xercesc::DOMLSSerializer>)
  , target_output(domls()->createLSOutput(), &releaser<xercesc::DOMLSOutput>)
@@ -584,7 +718,7 @@ XMLFragment::XMLFragment(XercesScopePtr xersces_scope)
 
     DBGMSGAT("Setting features on DOMLSSerializer");
     SET_FEATURE(serializer, xercesc::XMLUni::fgDOMWRTSplitCdataSections, false);
-    SET_FEATURE(serializer, xercesc::XMLUni::fgDOMWRTDiscardDefaultContent, true);
+    SET_FEATURE(serializer, xercesc::XMLUni::fgDOMWRTDiscardDefaultContent, discard_defaults);
     SET_FEATURE(serializer, xercesc::XMLUni::fgDOMWRTFormatPrettyPrint, false);// turn off "pretty print"
     SET_FEATURE(serializer, xercesc::XMLUni::fgDOMWRTBOM, false);
 
@@ -611,12 +745,17 @@ void XMLFragment::serialize(xercesc::DOMNode const* node) const
 //2. DOMLSSerializerFilteru se ne prosledjuju atributi pa ni xmlns
 //Zato kopiram podstablo pod cvor 'fragment' izmedju dva tekst cvora "\n", serializer ce
 //tako xmlns direktivu pridruziti cvoru 'fragment' a podstablo (bez xmlns direktive) ce biti
-//u privremenom stringu izmedju prvog i zadnjeg znaka '\n' sto na kraju kopiram u izlazni string.
+//u izlazu izmedju prvog i zadnjeg znaka '\n', fragment_trim_t propusta samo taj dio.
 bool XMLFragment::serialize(u8vector_t& xml_str, xercesc::DOMNode const* node) const
 {
-    assert(node);
-
     xml_str.clear();
+    return serialize(boost::bind(&append_to, boost::ref(xml_str), _1, _2), node);
+}
+
+
+bool XMLFragment::serialize(u8sink_t const& out, xercesc::DOMNode const* node) const
+{
+    assert(node);
 
     XMLCh const* const prev_encoding(target_output->getEncoding());
     target_output->setEncoding(xercesc::XMLUni::fgUTF8EncodingString);
@@ -629,6 +768,7 @@ bool XMLFragment::serialize(u8vector_t& xml_str, xercesc::DOMNode const* node) c
         xercesc::DOMDocument const* docnode(static_cast<xercesc::DOMDocument const*>(node));
         //"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
 
+        u8vector_t xml_str;
         xml_str.append((u8unit_t*)"<?xml");
         {
             XMLCh const* version(docnode->getXmlVersion());
@@ -658,8 +798,9 @@ bool XMLFragment::serialize(u8vector_t& xml_str, xercesc::DOMNode const* node) c
         }
 
         xml_str.append((u8unit_t*)"?>\n");
+        out(xml_str.data(), xml_str.size());
 
-        u8fmttarget_t targetu8str(xml_str);
+        u8fmttarget_t targetu8str(out);
         target_output->setByteStream(&targetu8str);
 
         try{
@@ -674,7 +815,7 @@ bool XMLFragment::serialize(u8vector_t& xml_str, xercesc::DOMNode const* node) c
         //root nema ELEMENT_NODE ancestora pa ni njihovih xmlns direktiva
         //tako da ne treba workaround sa fragment elementom
 
-        u8fmttarget_t targetu8str(xml_str);
+        u8fmttarget_t targetu8str(out);
         target_output->setByteStream(&targetu8str);
 
         try{
@@ -698,14 +839,12 @@ bool XMLFragment::serialize(u8vector_t& xml_str, xercesc::DOMNode const* node) c
         fr_node->appendChild(node->cloneNode(true));
         fr_node->appendChild((xercesc::DOMNode*)xdoc->createTextNode(_TRLCP("\n").c_str()));
 
-        u8vector_t fragment_str;
-        u8fmttarget_t targetu8str(fragment_str);
-        target_output->setByteStream(&targetu8str);//switch to string target
+        fragment_trim_t trimmed(out);
+        u8fmttarget_t targetu8str(boost::bind(&fragment_trim_t::write, &trimmed, _1, _2));
+        target_output->setByteStream(&targetu8str);//switch to trimming target
 
         try{
             status = serializer->write(fr_node, target_output.get());
-            xml_str.assign(++std::find(fragment_str.begin(), fragment_str.end(), '\n')
-                           , (++std::find(fragment_str.rbegin(), fragment_str.rend(), '\n')).base());
         } catch(...) {
             xml_engine_exception_handler();
         }
@@ -2,7 +2,6 @@
 #include "XMLUni.h"
 #include "bmu/itemlist_iterator.h"
 #include "bmu/Logger.h"
-#include <xercesc/dom/DOMNodeList.hpp>
 #include <xercesc/dom/DOMElement.hpp>
 #include <xercesc/dom/DOMDocument.hpp>
 #include <xercesc/dom/DOMAttr.hpp>
@@ -10,14 +9,6 @@
 #include <xercesc/dom/DOMNamedNodeMap.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
 
-/** Specjalizacija za DOMNodeList (getLength za duzinu liste i item(index) za elemente liste. */
-template <>
-struct bmu::itemlist_traits<xercesc::DOMNodeList const, xercesc::DOMNode*>
-{
-	static size_t size(xercesc::DOMNodeList const& __c) { return __c.getLength(); }
-	static xercesc::DOMNode* item(xercesc::DOMNodeList const& __c, size_t idx) { return __c.item(idx); }
-};
-
 /** Specjalizacija za DOMNamedNodeMap (getLength za duzinu liste i item(index) za elemente liste. */
 template <>
 struct bmu::itemlist_traits<xercesc::DOMNamedNodeMap const, xercesc::DOMNode*>
@@ -35,50 +26,197 @@ bool match_element_type::operator()(xercesc::DOMNode const* node) const
     return node->getNodeType() == xercesc::DOMNode::ELEMENT_NODE;
 }
 
+match_prefixed_name::match_prefixed_name(nodestep_t const& step
+                                         , u8vector_t const& default_ns
+                                         , nsbindings_t const& prefixes)
+ : stepprefix(step.prefix)
+ , steplocalname(step.localname)
+ , default_ns(default_ns)
+ , ns_uri()
+ , local_name()
+ , wildcarded(false)
+{
+    transcode(prefixes);
+}
+
+match_prefixed_name::match_prefixed_name(u8vector_t const& steplocalname
+                                         , u8vector_t const& default_ns
+                                         , u8vector_t const& stepprefix
+                                         , nsbindings_t const& prefixes)
+ : stepprefix(stepprefix)
+ , steplocalname(steplocalname)
+ , default_ns(default_ns)
+ , ns_uri()
+ , local_name()
+ , wildcarded(false)
+{
+    transcode(prefixes);
+}
+
+void match_prefixed_name::transcode(nsbindings_t const& prefixes)
+{
+    //transcode_utf8 ne uspijeva za prazan niz pa prazan namespace ili ime ne uparuje nista
+    if(stepprefix.empty()) {
+        if(!_TRUTF8(ns_uri, default_ns)) ns_uri.clear();
+    } else {
+        nsbindings_t::const_iterator const it(prefixes.find(stepprefix));
+        if(it == prefixes.end() || !_TRUTF8(ns_uri, it->second)) ns_uri.clear();
+    }
+    wildcarded = (steplocalname == (u8unit_t*)"*");
+    if(!wildcarded && !_TRUTF8(local_name, steplocalname)) local_name.clear();
+}
+
 bool match_prefixed_name::operator()(xercesc::DOMNode const* node) const
 {
     switch(node->getNodeType()) {
-    case xercesc::DOMNode::ELEMENT_NODE:
+    case xercesc::DOMNode::ELEMENT_NODE: {
+        XMLCh const* const node_ns(node->getNamespaceURI());
+        if(ns_uri.empty() || !node_ns || !xercesc::XMLString::equals(ns_uri.c_str(), node_ns)) return false;
+    } break;
     case xercesc::DOMNode::ATTRIBUTE_NODE:
         break;
     default:
         return false;
     }
-    u8vector_t tmp;
-    if(node->getNodeType() == xercesc::DOMNode::ELEMENT_NODE) {
-        XMLCh const* const ns_uri(node->getNamespaceURI());
-        if(!_TRUTF8(tmp, ns_uri, xercesc::XMLString::stringLen(ns_uri))) return false;//not-utf8
-        if(stepprefix.empty()) {
-            if(default_ns != tmp) return false;
-        } else {
-            nsbindings_it it(const_cast<nsbindings_t&>(prefixes).find(stepprefix));
-            if(it == prefixes.end() || it->second != tmp) return false;
-        }
-    }
-    if(steplocalname != (u8unit_t*)"*") {//not wildcarded
-        XMLCh const* const local_name(node->getLocalName());
-        if(!_TRUTF8(tmp, local_name, xercesc::XMLString::stringLen(local_name))) return false;//not-utf8
-        if(steplocalname != tmp) return false;
-    }
-    return true;
+    if(wildcarded) return true;
+    XMLCh const* const node_name(node->getLocalName());
+    return !local_name.empty() && node_name && xercesc::XMLString::equals(local_name.c_str(), node_name);
+}
+
+match_attvalue::match_attvalue(nodestep_t const& step
+                               , u8vector_t const& default_ns
+                               , nsbindings_t const& prefixes)
+ : same_name(step.attname, default_ns, step.attprefix, prefixes)
+ , attvalue()
+{
+    if(!_TRUTF8(attvalue, step.attvalue)) attvalue.clear();
 }
 
 //true ako ima bar jedan atribut sa zadanim prefiksom imenom i vrijednoscu
 bool match_attvalue::operator()(xercesc::DOMNode const* el_node) const
 {
     assert(el_node->getNodeType() == xercesc::DOMNode::ELEMENT_NODE);
+    if(attvalue.empty()) return false;
     xercesc::DOMNamedNodeMap const* const attribs(el_node->getAttributes());
     for(size_t i=0, nattr=attribs->getLength(); i<nattr; ++i) {
         xercesc::DOMNode* attr(attribs->item(i));
         if(!same_name(attr)) continue;
-        u8vector_t tmp;
         XMLCh const* const value(attr->getNodeValue());
-        if(!_TRUTF8(tmp, value, xercesc::XMLString::stringLen(value))) return false;//not-utf8
-        if(attvalue == tmp) return true;
+        if(value && xercesc::XMLString::equals(attvalue.c_str(), value)) return true;
     }
     return false;
 }
 
+/// procjena memorije cvora unordered kontejnera: vrijednost, veza na sljedeci i mjesto u bucketu
+template <typename Value>
+inline size_t hashed_node_bytes(void) { return sizeof(Value) + 2*sizeof(void*); }
+
+void AttributeIndex::append_name(u8vector_t& name
+                                 , u8vector_t const& ns
+                                 , u8vector_t const& elname
+                                 , u8vector_t const& attname)
+{
+    //duzine ispred imena da se razlikuju kljucevi ciji se dijelovi samo drugacije granicaju
+    size_t const sizes[] = { ns.size(), elname.size() };
+    name.append(reinterpret_cast<u8unit_t const*>(sizes), sizeof(sizes));
+    name.append(ns).append(elname).append(attname);
+}
+
+void AttributeIndex::append_key(u8vector_t& key
+                                , xercesc::DOMNode const* parent
+                                , size_t name_id
+                                , u8vector_t const& attvalue)
+{
+    key.append(reinterpret_cast<u8unit_t const*>(&parent), sizeof(parent));
+    key.append(reinterpret_cast<u8unit_t const*>(&name_id), sizeof(name_id));
+    key.append(attvalue);
+}
+
+void AttributeIndex::index_children(xercesc::DOMNode const* parent)
+{
+    parents.insert(parent);
+    nbytes += hashed_node_bytes<xercesc::DOMNode const*>();
+    u8vector_t ns, elname, attname, attvalue, name, key;
+    for(xercesc::DOMNode* child(parent->getFirstChild()); child; child = child->getNextSibling()) {
+        if(child->getNodeType() != xercesc::DOMNode::ELEMENT_NODE) continue;
+        XMLCh const* const ns_uri(child->getNamespaceURI());
+        XMLCh const* const local_name(child->getLocalName());
+        if(!_TRUTF8(ns, ns_uri, xercesc::XMLString::stringLen(ns_uri))
+           || !_TRUTF8(elname, local_name, xercesc::XMLString::stringLen(local_name))) continue;//not-utf8
+        //kao match_attvalue: atribut se poredi samo po lokalnom imenu, ukljucujuci xmlns atribute
+        xercesc::DOMNamedNodeMap const* const attribs(child->getAttributes());
+        for(size_t i=0, nattr=attribs->getLength(); i<nattr; ++i) {
+            xercesc::DOMNode const* const attr(attribs->item(i));
+            XMLCh const* const att_name(attr->getLocalName());
+            XMLCh const* const value(attr->getNodeValue());
+            if(!_TRUTF8(attname, att_name, xercesc::XMLString::stringLen(att_name))
+               || !_TRUTF8(attvalue, value, xercesc::XMLString::stringLen(value))) continue;//not-utf8
+            name.clear();
+            append_name(name, ns, elname, attname);
+            std::pair<names_map_t::iterator, bool> const named(names.insert(std::make_pair(name, names.size())));
+            if(named.second) nbytes += hashed_node_bytes<names_map_t::value_type>() + name.size();
+            key.clear();
+            append_key(key, parent, named.first->second, attvalue);
+            std::pair<elements_map_t::iterator, bool> const keyed(elements.insert(std::make_pair(key, std::vector<xercesc::DOMNode*>())));
+            if(keyed.second) nbytes += hashed_node_bytes<elements_map_t::value_type>() + key.size();
+            std::vector<xercesc::DOMNode*>& found(keyed.first->second);
+            if(found.empty() || found.back() != child) {//isti element sa dva takva atributa
+                size_t const capacity(found.capacity());
+                found.push_back(child);
+                nbytes += (found.capacity() - capacity) * sizeof(xercesc::DOMNode*);
+                ++nentries;
+            }
+        }
+    }
+}
+
+bool AttributeIndex::select(std::vector<xercesc::DOMNode*>& out
+            , xercesc::DOMNode* context
+            , nodestep_t const& step
+            , nsbindings_t const& prefixes
+            , u8vector_t const& default_ns)
+{
+    assert(out.empty());
+    if(step.type != nodestep_t::NODE_ELEMENT || step.attvalue.empty() || step.position > 0
+       || step.localname == (u8unit_t*)"*")
+        return false;
+    u8vector_t const* ns(&default_ns);
+    if(!step.prefix.empty()) {
+        nsbindings_t::const_iterator const it(prefixes.find(step.prefix));
+        if(it == prefixes.end()) return true;//no-match
+        ns = &it->second;
+    }
+    if(parents.find(context) == parents.end()) index_children(context);
+    u8vector_t name;
+    append_name(name, *ns, step.localname, step.attname);
+    names_map_t::const_iterator const named(names.find(name));
+    if(named != names.end()) {//inace nijedan indeksirani element nema takav atribut
+        u8vector_t key;
+        append_key(key, context, named->second, step.attvalue);
+        elements_map_t::const_iterator const it(elements.find(key));
+        if(it != elements.end()) out.assign(it->second.begin(), it->second.end());
+    }
+    DBGMSGAT("Found " << out.size() << " indexed elements with attribute: @name=value = '@"
+            << bmu::utf8_string(step.attname) << "=" << bmu::utf8_string(step.attvalue) << "'");
+    return true;
+}
+
+/** Prolaz kroz djecu cvora preko getFirstChild/getNextSibling. Djeca su u Xercesu povezana lista pa
+    DOMNodeList::item(idx) svaki put ide od prvog djeteta, a prolaz kroz svu djecu tako je kvadratican.
+ */
+class child_iterator {
+    xercesc::DOMNode* current;
+public:
+    //bez roditelja je kraj liste
+    explicit child_iterator(xercesc::DOMNode const* parent = 0)
+     : current(parent ? parent->getFirstChild() : 0)
+     { }
+    xercesc::DOMNode* operator*() const { return current; }
+    child_iterator& operator++() { current = current->getNextSibling(); return *this; }
+    bool operator==(child_iterator const& other) const { return current == other.current; }
+    bool operator!=(child_iterator const& other) const { return current != other.current; }
+};
+
 //ovo je copy_if za __GXX_EXPERIMENTAL_CXX0X__
 template<typename _InputIterator, typename _OutputIterator,
    typename _Predicate>
@@ -108,52 +246,43 @@ void XMLSelect::select(std::vector<xercesc::DOMNode*>& out
             , xercesc::DOMNode* context
             , nodestep_t const& step
             , nsbindings_t const& prefixes
-            , u8vector_t const& default_ns)
+            , u8vector_t const& default_ns
+            , AttributeIndex* index)
 {
     assert(context);
     assert(out.empty());
     DBGMSGAT("Selecting step: prefix='" << bmu::utf8_string(step.prefix) << "' and name='" << bmu::utf8_string(step.localname) << "'");
+    if(index && index->select(out, context, step, prefixes, default_ns)) return;
     switch(step.type) {
     case nodestep_t::NODE_ELEMENT: {
-        xercesc::DOMNodeList* allnodes(context->getChildNodes());
-        assert(allnodes);
-        DBGMSGAT("Working on list of " << allnodes->getLength() << " elements");
-//#ifndef NDEBUG
-//        for(size_t i=0; i<allnodes->getLength(); ++i) XMLSelect::dump(allnodes->item(i));
-//#endif
-        std::vector<xercesc::DOMNode*> allnamed;
-        {
-			bmu::itemlist_iterator<xercesc::DOMNodeList const, xercesc::DOMNode*> itall(*allnodes);
-            copyto_if(itall, itall.end(), std::back_inserter(allnamed)
-                      , match_prefixed_name(step, default_ns, prefixes));
-        }
-        DBGMSGAT("Found " << allnamed.size() << " elements: prefix:name='"
-                << bmu::utf8_string(step.prefix) << ":" << bmu::utf8_string(step.localname) << "'");
-//#ifndef NDEBUG
-//        for(size_t i=0; i<allnamed.size(); ++i) XMLSelect::dump(allnamed[i]);
-//#endif
+        match_prefixed_name const same_name(step, default_ns, prefixes);
         if(step.position > 0) {
-            if(step.position > allnamed.size()) {
+            //prolaz staje na elementu na trazenoj poziciji medju istoimenim
+            DBGMSGAT("Getting element at " << step.position-1);
+            size_t nnamed(0);
+            xercesc::DOMNode* child(context->getFirstChild());
+            for(; child; child = child->getNextSibling()) {
+                if(same_name(child) && ++nnamed == step.position) break;
+            }
+            if(!child) {
                 DBGMSGAT("Requested position is to high, no-match");
                 return;//no-match
             }
-            DBGMSGAT("Getting element at " << step.position-1);
-            xercesc::DOMNode* tmpnode(allnamed[step.position-1]);
-            allnamed.clear();
-            allnamed.push_back(tmpnode);
-//#ifndef NDEBUG
-//            XMLSelect::dump(tmpnode);
-//#endif
-        }
-        if(!step.attvalue.empty()) {
+            if(step.attvalue.empty() || match_attvalue(step, default_ns, prefixes)(child))
+                out.push_back(child);
+        } else if(!step.attvalue.empty()) {
             DBGMSGAT("Getting element with attribute: @name=value = '@" << bmu::utf8_string(step.attname)
                     << "=" << bmu::utf8_string(step.attvalue) << "'");
-            copyto_if(allnamed.begin(), allnamed.end(), std::back_inserter(out)
-                      , match_attvalue(step, default_ns, prefixes));
+            match_attvalue const same_value(step, default_ns, prefixes);
+            for(xercesc::DOMNode* child(context->getFirstChild()); child; child = child->getNextSibling()) {
+                if(same_name(child) && same_value(child)) out.push_back(child);
+            }
         } else {
             DBGMSGAT("Getting all named elements");
-            out.assign(allnamed.begin(), allnamed.end());
+            copyto_if(child_iterator(context), child_iterator(), std::back_inserter(out), same_name);
         }
+        DBGMSGAT("Found " << out.size() << " elements: prefix:name='"
+                << bmu::utf8_string(step.prefix) << ":" << bmu::utf8_string(step.localname) << "'");
     } break;
     case nodestep_t::NODE_ATTRIBUTE: {
         assert(context->getNodeType() == xercesc::DOMNode::ELEMENT_NODE);
@@ -189,7 +318,8 @@ XMLSelect::XMLSelect(doctree_ptr const& xr_doc
                      , std::vector<nodestep_t> const& steps
                      , size_t count
                      , nsbindings_t const& prefixes
-                     , u8vector_t const& default_ns)
+                     , u8vector_t const& default_ns
+                     , AttributeIndex* index)
  : obj()
 {
     if(steps.empty() || count == 0 || count > steps.size()) {
@@ -209,7 +339,7 @@ XMLSelect::XMLSelect(doctree_ptr const& xr_doc
     tmp.push_back(subroot);
     for(size_t i=1; i<count; ++i) {
         tmp.clear();
-        select(tmp, subroot, steps[i], prefixes, default_ns);
+        select(tmp, subroot, steps[i], prefixes, default_ns, index);
         if(tmp.size() != 1) {
             DBGMSGAT("Requested step is no-match (multiple or no node)");
             return; //no-match
@@ -239,13 +369,11 @@ XMLSelect::XMLSelect(XMLSelect const& context
  : obj()
 {
     assert(context.node());
-    xercesc::DOMNodeList* allnodes(context.node()->getChildNodes());
-    assert(allnodes);
-	bmu::itemlist_iterator<xercesc::DOMNodeList const, xercesc::DOMNode*> itall(*allnodes);
+    child_iterator const itall(context.node());
     if(stepname.empty()) { //allchildren
-        copyto_if(itall, itall.end(), std::back_inserter(obj), match_element_type());
+        copyto_if(itall, child_iterator(), std::back_inserter(obj), match_element_type());
     } else { //named children
-        copyto_if(itall, itall.end(), std::back_inserter(obj)
+        copyto_if(itall, child_iterator(), std::back_inserter(obj)
                   , match_prefixed_name(stepname, default_ns, stepprefix, prefixes));
     }
 }
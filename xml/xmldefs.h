@@ -13,5 +13,7 @@ namespace scarlet {
 namespace xml {
 class XercesScope;
 typedef boost::shared_ptr<XercesScope> XercesScopePtr;
+class XMLGrammars;
+typedef boost::shared_ptr<XMLGrammars> XMLGrammarsPtr;
 }
 }
\ No newline at end of file